@@ -1,793 +1,10017 @@
-#include <iostream>
-#include <string>
-#include <vector>
-#include <map>
-#include <ctime>
-#include <iomanip>
-#include <algorithm>
-#include <fstream>
-#include <sstream>
-using namespace std;
-
-// ==================== Vehicle Class (Base) ====================
-class Vehicle
-{
-protected:
-    string vehicleNumber;
-    string vehicleType;
-    time_t entryTime;
-
-public:
-    Vehicle(string num, string type) : vehicleNumber(num), vehicleType(type)
-    {
-        entryTime = time(0);
-    }
-
-    virtual ~Vehicle() {}
-
-    string getVehicleNumber() const { return vehicleNumber; }
-    string getVehicleType() const { return vehicleType; }
-    time_t getEntryTime() const { return entryTime; }
-    void setEntryTime(time_t t) { entryTime = t; }
-
-    virtual double getHourlyRate() const = 0;
-
-    virtual void displayInfo() const
-    {
-        cout << "Vehicle: " << vehicleNumber << " | Type: " << vehicleType;
-    }
-};
-
-// ==================== Derived Vehicle Classes ====================
-class Bike : public Vehicle
-{
-public:
-    Bike(string num) : Vehicle(num, "Bike") {}
-
-    double getHourlyRate() const override
-    {
-        return 10.0;
-    }
-};
-
-class Car : public Vehicle
-{
-public:
-    Car(string num) : Vehicle(num, "Car") {}
-
-    double getHourlyRate() const override
-    {
-        return 20.0;
-    }
-};
-
-class Truck : public Vehicle
-{
-public:
-    Truck(string num) : Vehicle(num, "Truck") {}
-
-    double getHourlyRate() const override
-    {
-        return 40.0;
-    }
-};
-
-// ==================== Parking Slot Class ====================
-class ParkingSlot
-{
-private:
-    int slotNumber;
-    string slotType;
-    bool isOccupied;
-    Vehicle *parkedVehicle;
-
-public:
-    ParkingSlot(int num, string type)
-        : slotNumber(num), slotType(type), isOccupied(false), parkedVehicle(nullptr) {}
-
-    int getSlotNumber() const { return slotNumber; }
-    string getSlotType() const { return slotType; }
-    bool getOccupiedStatus() const { return isOccupied; }
-    Vehicle *getParkedVehicle() const { return parkedVehicle; }
-
-    bool parkVehicle(Vehicle *vehicle)
-    {
-        if (!isOccupied && vehicle->getVehicleType() == slotType)
-        {
-            parkedVehicle = vehicle;
-            isOccupied = true;
-            return true;
-        }
-        return false;
-    }
-
-    Vehicle *removeVehicle()
-    {
-        if (isOccupied)
-        {
-            Vehicle *temp = parkedVehicle;
-            parkedVehicle = nullptr;
-            isOccupied = false;
-            return temp;
-        }
-        return nullptr;
-    }
-
-    void displaySlot() const
-    {
-        if (isOccupied)
-        {
-            cout << "[X]";
-        }
-        else
-        {
-            cout << "[ ]";
-        }
-    }
-};
-
-// ==================== Ticket Class ====================
-class Ticket
-{
-private:
-    string ticketId;
-    string vehicleNumber;
-    int slotNumber;
-    time_t entryTime;
-    double hourlyRate;
-
-public:
-    Ticket(string vNum, int slot, double rate, time_t entry = 0)
-        : vehicleNumber(vNum), slotNumber(slot), hourlyRate(rate)
-    {
-        if (entry == 0)
-        {
-            entryTime = time(0);
-        }
-        else
-        {
-            entryTime = entry;
-        }
-        ticketId = "TKT" + to_string(entryTime) + to_string(slot);
-    }
-
-    string getTicketId() const { return ticketId; }
-    string getVehicleNumber() const { return vehicleNumber; }
-    int getSlotNumber() const { return slotNumber; }
-    time_t getEntryTime() const { return entryTime; }
-    double getHourlyRate() const { return hourlyRate; }
-
-    void displayTicket() const
-    {
-        cout << "\n╔════════════════════════════════════╗" << endl;
-        cout << "║         PARKING TICKET             ║" << endl;
-        cout << "╚════════════════════════════════════╝" << endl;
-        cout << "Ticket ID: " << ticketId << endl;
-        cout << "Vehicle: " << vehicleNumber << endl;
-        cout << "Slot: " << slotNumber << endl;
-        cout << "Entry Time: " << ctime(&entryTime);
-        cout << "Rate: ₹" << hourlyRate << "/hour" << endl;
-        cout << "════════════════════════════════════" << endl;
-    }
-};
-
-// ==================== Payment Class ====================
-class Payment
-{
-private:
-    double amount;
-    time_t paymentTime;
-    string paymentMethod;
-
-public:
-    Payment(double amt, string method)
-        : amount(amt), paymentMethod(method)
-    {
-        paymentTime = time(0);
-    }
-
-    void displayReceipt(string vehicleNum, double hours, double rate) const
-    {
-        cout << "\n╔════════════════════════════════════╗" << endl;
-        cout << "║         PAYMENT RECEIPT            ║" << endl;
-        cout << "╚════════════════════════════════════╝" << endl;
-        cout << "Vehicle: " << vehicleNum << endl;
-        cout << "Duration: " << fixed << setprecision(2) << hours << " hours" << endl;
-        cout << "Rate: ₹" << rate << "/hour" << endl;
-        cout << "Amount: ₹" << amount << endl;
-        cout << "Method: " << paymentMethod << endl;
-        cout << "Time: " << ctime(&paymentTime);
-        cout << "════════════════════════════════════" << endl;
-        cout << "    Thank you! Visit again!" << endl;
-        cout << "════════════════════════════════════" << endl;
-    }
-};
-
-// ==================== Monthly Pass Class ====================
-class MonthlyPass
-{
-private:
-    string passId;
-    string vehicleNumber;
-    time_t startDate;
-    time_t expiryDate;
-    bool isActive;
-
-public:
-    MonthlyPass(string vNum, time_t start = 0) : vehicleNumber(vNum)
-    {
-        if (start == 0)
-        {
-            startDate = time(0);
-        }
-        else
-        {
-            startDate = start;
-        }
-        expiryDate = startDate + (30 * 24 * 60 * 60);
-        passId = "PASS" + to_string(startDate);
-        isActive = true;
-    }
-
-    string getVehicleNumber() const { return vehicleNumber; }
-    string getPassId() const { return passId; }
-    time_t getStartDate() const { return startDate; }
-    time_t getExpiryDate() const { return expiryDate; }
-
-    bool checkValidity() const
-    {
-        return isActive && (time(0) < expiryDate);
-    }
-
-    void displayPass() const
-    {
-        cout << "\n╔════════════════════════════════════╗" << endl;
-        cout << "║         MONTHLY PASS               ║" << endl;
-        cout << "╚════════════════════════════════════╝" << endl;
-        cout << "Pass ID: " << passId << endl;
-        cout << "Vehicle: " << vehicleNumber << endl;
-        cout << "Start Date: " << ctime(&startDate);
-        cout << "Valid till: " << ctime(&expiryDate);
-        cout << "Status: " << (checkValidity() ? "✓ Active" : "✗ Expired") << endl;
-        cout << "════════════════════════════════════" << endl;
-    }
-};
-
-// ==================== Parking Floor Class ====================
-class ParkingFloor
-{
-private:
-    int floorNumber;
-    vector<ParkingSlot *> slots;
-
-public:
-    ParkingFloor(int num, int bikeSlots, int carSlots, int truckSlots)
-        : floorNumber(num)
-    {
-        int slotNum = floorNumber * 100;
-
-        for (int i = 0; i < bikeSlots; i++)
-        {
-            slots.push_back(new ParkingSlot(++slotNum, "Bike"));
-        }
-        for (int i = 0; i < carSlots; i++)
-        {
-            slots.push_back(new ParkingSlot(++slotNum, "Car"));
-        }
-        for (int i = 0; i < truckSlots; i++)
-        {
-            slots.push_back(new ParkingSlot(++slotNum, "Truck"));
-        }
-    }
-
-    ~ParkingFloor()
-    {
-        for (auto slot : slots)
-        {
-            delete slot;
-        }
-    }
-
-    int getFloorNumber() const { return floorNumber; }
-
-    ParkingSlot *findAvailableSlot(string vehicleType)
-    {
-        for (auto slot : slots)
-        {
-            if (!slot->getOccupiedStatus() && slot->getSlotType() == vehicleType)
-            {
-                return slot;
-            }
-        }
-        return nullptr;
-    }
-
-    ParkingSlot *findSlotByNumber(int slotNum)
-    {
-        for (auto slot : slots)
-        {
-            if (slot->getSlotNumber() == slotNum)
-            {
-                return slot;
-            }
-        }
-        return nullptr;
-    }
-
-    void displayFloorStatus() const
-    {
-        cout << "\n--- Floor " << floorNumber << " ---" << endl;
-        cout << "Bikes:  ";
-        for (auto slot : slots)
-        {
-            if (slot->getSlotType() == "Bike")
-            {
-                slot->displaySlot();
-                cout << " ";
-            }
-        }
-        cout << "\nCars:   ";
-        for (auto slot : slots)
-        {
-            if (slot->getSlotType() == "Car")
-            {
-                slot->displaySlot();
-                cout << " ";
-            }
-        }
-        cout << "\nTrucks: ";
-        for (auto slot : slots)
-        {
-            if (slot->getSlotType() == "Truck")
-            {
-                slot->displaySlot();
-                cout << " ";
-            }
-        }
-        cout << endl;
-    }
-
-    int getAvailableCount(string type) const
-    {
-        int count = 0;
-        for (auto slot : slots)
-        {
-            if (!slot->getOccupiedStatus() && slot->getSlotType() == type)
-            {
-                count++;
-            }
-        }
-        return count;
-    }
-};
-
-// ==================== Smart Parking System ====================
-class SmartParkingSystem
-{
-private:
-    vector<ParkingFloor *> floors;
-    map<string, Ticket *> activeTickets;
-    map<string, MonthlyPass *> monthlyPasses;
-    double totalRevenue;
-
-    // File storage functions
-    void saveTicketsToFile()
-    {
-        ofstream file("parking_tickets.txt");
-        for (auto &pair : activeTickets)
-        {
-            Ticket *t = pair.second;
-            file << t->getVehicleNumber() << ","
-                 << t->getSlotNumber() << ","
-                 << t->getHourlyRate() << ","
-                 << t->getEntryTime() << "\n";
-        }
-        file.close();
-    }
-
-    void loadTicketsFromFile()
-    {
-        ifstream file("parking_tickets.txt");
-        if (!file.is_open())
-            return;
-
-        string line;
-        while (getline(file, line))
-        {
-            stringstream ss(line);
-            string vNum, slotStr, rateStr, timeStr;
-
-            getline(ss, vNum, ',');
-            getline(ss, slotStr, ',');
-            getline(ss, rateStr, ',');
-            getline(ss, timeStr, ',');
-
-            int slot = stoi(slotStr);
-            double rate = stod(rateStr);
-            time_t entry = stoll(timeStr);
-
-            Ticket *ticket = new Ticket(vNum, slot, rate, entry);
-            activeTickets[vNum] = ticket;
-
-            // Recreate vehicle and park it
-            Vehicle *vehicle = nullptr;
-            if (rate == 10.0)
-                vehicle = new Bike(vNum);
-            else if (rate == 20.0)
-                vehicle = new Car(vNum);
-            else if (rate == 40.0)
-                vehicle = new Truck(vNum);
-
-            if (vehicle)
-            {
-                vehicle->setEntryTime(entry);
-                for (auto floor : floors)
-                {
-                    ParkingSlot *s = floor->findSlotByNumber(slot);
-                    if (s)
-                    {
-                        s->parkVehicle(vehicle);
-                        break;
-                    }
-                }
-            }
-        }
-        file.close();
-    }
-
-    void savePassesToFile()
-    {
-        ofstream file("monthly_passes.txt");
-        for (auto &pair : monthlyPasses)
-        {
-            MonthlyPass *p = pair.second;
-            file << p->getVehicleNumber() << ","
-                 << p->getPassId() << ","
-                 << p->getStartDate() << ","
-                 << p->getExpiryDate() << "\n";
-        }
-        file.close();
-    }
-
-    void loadPassesFromFile()
-    {
-        ifstream file("monthly_passes.txt");
-        if (!file.is_open())
-            return;
-
-        string line;
-        while (getline(file, line))
-        {
-            stringstream ss(line);
-            string vNum, passId, startStr, expiryStr;
-
-            getline(ss, vNum, ',');
-            getline(ss, passId, ',');
-            getline(ss, startStr, ',');
-            getline(ss, expiryStr, ',');
-
-            time_t start = stoll(startStr);
-            MonthlyPass *pass = new MonthlyPass(vNum, start);
-            monthlyPasses[vNum] = pass;
-        }
-        file.close();
-    }
-
-    void saveRevenueToFile()
-    {
-        ofstream file("revenue.txt");
-        file << totalRevenue;
-        file.close();
-    }
-
-    void loadRevenueFromFile()
-    {
-        ifstream file("revenue.txt");
-        if (file.is_open())
-        {
-            file >> totalRevenue;
-            file.close();
-        }
-    }
-
-public:
-    SmartParkingSystem(int numFloors) : totalRevenue(0.0)
-    {
-        for (int i = 1; i <= numFloors; i++)
-        {
-            floors.push_back(new ParkingFloor(i, 5, 5, 2));
-        }
-        loadTicketsFromFile();
-        loadPassesFromFile();
-        loadRevenueFromFile();
-    }
-
-    ~SmartParkingSystem()
-    {
-        saveTicketsToFile();
-        savePassesToFile();
-        saveRevenueToFile();
-
-        for (auto floor : floors)
-        {
-            delete floor;
-        }
-        for (auto &pair : activeTickets)
-        {
-            delete pair.second;
-        }
-        for (auto &pair : monthlyPasses)
-        {
-            delete pair.second;
-        }
-    }
-
-    void displayParkingStatus()
-    {
-        cout << "\n╔════════════════════════════════════╗" << endl;
-        cout << "║    PARKING SYSTEM STATUS           ║" << endl;
-        cout << "╚════════════════════════════════════╝" << endl;
-
-        for (auto floor : floors)
-        {
-            floor->displayFloorStatus();
-        }
-
-        cout << "\n--- Available Slots Summary ---" << endl;
-        int totalBike = 0, totalCar = 0, totalTruck = 0;
-        for (auto floor : floors)
-        {
-            totalBike += floor->getAvailableCount("Bike");
-            totalCar += floor->getAvailableCount("Car");
-            totalTruck += floor->getAvailableCount("Truck");
-        }
-        cout << "Bikes: " << totalBike << " | Cars: " << totalCar << " | Trucks: " << totalTruck << endl;
-        cout << "Legend: [ ] = Available, [X] = Occupied" << endl;
-    }
-
-    bool parkVehicle(string vehicleNum, string vehicleType)
-    {
-        if (monthlyPasses.find(vehicleNum) != monthlyPasses.end())
-        {
-            if (monthlyPasses[vehicleNum]->checkValidity())
-            {
-                cout << "\n✓ Monthly pass holder detected!" << endl;
-            }
-        }
-
-        Vehicle *vehicle = nullptr;
-        if (vehicleType == "Bike")
-        {
-            vehicle = new Bike(vehicleNum);
-        }
-        else if (vehicleType == "Car")
-        {
-            vehicle = new Car(vehicleNum);
-        }
-        else if (vehicleType == "Truck")
-        {
-            vehicle = new Truck(vehicleNum);
-        }
-        else
-        {
-            cout << "✗ Invalid vehicle type!" << endl;
-            return false;
-        }
-
-        for (auto floor : floors)
-        {
-            ParkingSlot *slot = floor->findAvailableSlot(vehicleType);
-            if (slot)
-            {
-                slot->parkVehicle(vehicle);
-                Ticket *ticket = new Ticket(vehicleNum, slot->getSlotNumber(), vehicle->getHourlyRate());
-                activeTickets[vehicleNum] = ticket;
-                ticket->displayTicket();
-                cout << "✓ Vehicle parked successfully on Floor " << floor->getFloorNumber() << "!" << endl;
-                saveTicketsToFile();
-                return true;
-            }
-        }
-
-        cout << "✗ No available slot for " << vehicleType << "!" << endl;
-        delete vehicle;
-        return false;
-    }
-
-    bool exitVehicle(string vehicleNum, string paymentMethod)
-    {
-        if (activeTickets.find(vehicleNum) == activeTickets.end())
-        {
-            cout << "✗ No active ticket found for this vehicle!" << endl;
-            return false;
-        }
-
-        Ticket *ticket = activeTickets[vehicleNum];
-        int slotNum = ticket->getSlotNumber();
-
-        Vehicle *vehicle = nullptr;
-        ParkingSlot *slot = nullptr;
-        for (auto floor : floors)
-        {
-            slot = floor->findSlotByNumber(slotNum);
-            if (slot)
-            {
-                vehicle = slot->removeVehicle();
-                break;
-            }
-        }
-
-        if (!vehicle)
-        {
-            cout << "✗ Error: Vehicle not found in slot!" << endl;
-            return false;
-        }
-
-        bool isPassHolder = false;
-        if (monthlyPasses.find(vehicleNum) != monthlyPasses.end())
-        {
-            if (monthlyPasses[vehicleNum]->checkValidity())
-            {
-                isPassHolder = true;
-            }
-        }
-
-        if (!isPassHolder)
-        {
-            time_t exitTime = time(0);
-            double seconds = difftime(exitTime, ticket->getEntryTime());
-            double hours = seconds / 3600.0;
-
-            if (hours < 1.0)
-                hours = 1.0;
-
-            double amount = hours * ticket->getHourlyRate();
-            totalRevenue += amount;
-
-            Payment payment(amount, paymentMethod);
-            payment.displayReceipt(vehicleNum, hours, ticket->getHourlyRate());
-        }
-        else
-        {
-            cout << "\n✓ Monthly pass holder - No charges!" << endl;
-            monthlyPasses[vehicleNum]->displayPass();
-        }
-
-        delete vehicle;
-        delete ticket;
-        activeTickets.erase(vehicleNum);
-        saveTicketsToFile();
-        saveRevenueToFile();
-
-        cout << "\n✓ Vehicle exited successfully!" << endl;
-        return true;
-    }
-
-    void purchaseMonthlyPass(string vehicleNum)
-    {
-        if (monthlyPasses.find(vehicleNum) != monthlyPasses.end())
-        {
-            if (monthlyPasses[vehicleNum]->checkValidity())
-            {
-                cout << "✗ Active monthly pass already exists!" << endl;
-                monthlyPasses[vehicleNum]->displayPass();
-                return;
-            }
-        }
-
-        MonthlyPass *pass = new MonthlyPass(vehicleNum);
-        monthlyPasses[vehicleNum] = pass;
-
-        cout << "\n✓ Monthly pass purchased successfully!" << endl;
-        cout << "Amount Paid: ₹500" << endl;
-        pass->displayPass();
-        savePassesToFile();
-    }
-
-    void viewMonthlyPass(string vehicleNum)
-    {
-        if (monthlyPasses.find(vehicleNum) != monthlyPasses.end())
-        {
-            monthlyPasses[vehicleNum]->displayPass();
-        }
-        else
-        {
-            cout << "\n✗ No monthly pass found for this vehicle!" << endl;
-        }
-    }
-
-    void displayRevenue() const
-    {
-        cout << "\n╔════════════════════════════════════╗" << endl;
-        cout << "║      REVENUE STATISTICS            ║" << endl;
-        cout << "╚════════════════════════════════════╝" << endl;
-        cout << "Total Revenue: ₹" << fixed << setprecision(2) << totalRevenue << endl;
-        cout << "Active Vehicles: " << activeTickets.size() << endl;
-        cout << "Monthly Pass Holders: " << monthlyPasses.size() << endl;
-        cout << "════════════════════════════════════" << endl;
-    }
-};
-
-// ==================== Main Application ====================
-int main()
-{
-    SmartParkingSystem parking(3);
-    int choice;
-
-    cout << "\n╔═══════════════════════════════════════╗" << endl;
-    cout << "║         PARKING MANAGEMENT SYSTEM     ║" << endl;
-    cout << "╚═══════════════════════════════════════╝" << endl;
-
-    while (true)
-    {
-        cout << "\n========== MAIN MENU ==========" << endl;
-        cout << "1. View Parking Status" << endl;
-        cout << "2. Park Vehicle (Entry)" << endl;
-        cout << "3. Exit Vehicle (With Payment)" << endl;
-        cout << "4. Purchase Monthly Pass" << endl;
-        cout << "5. View Monthly Pass Details" << endl;
-        cout << "6. View Revenue Statistics" << endl;
-        cout << "0. Exit System" << endl;
-        cout << "===============================" << endl;
-        cout << "Enter your choice: ";
-        cin >> choice;
-        cin.ignore();
-
-        string vehicleNum, vehicleType, paymentMethod;
-
-        switch (choice)
-        {
-        case 1:
-            parking.displayParkingStatus();
-            break;
-
-        case 2:
-            cout << "\n--- VEHICLE ENTRY ---" << endl;
-            cout << "Enter vehicle number: ";
-            getline(cin, vehicleNum);
-            cout << "Enter vehicle type (Bike/Car/Truck): ";
-            getline(cin, vehicleType);
-            parking.parkVehicle(vehicleNum, vehicleType);
-            break;
-
-        case 3:
-            cout << "\n--- VEHICLE EXIT ---" << endl;
-            cout << "Enter vehicle number: ";
-            getline(cin, vehicleNum);
-            cout << "Payment method (Cash/Card/UPI): ";
-            getline(cin, paymentMethod);
-            parking.exitVehicle(vehicleNum, paymentMethod);
-            break;
-
-        case 4:
-            cout << "\n--- PURCHASE MONTHLY PASS ---" << endl;
-            cout << "Enter vehicle number: ";
-            getline(cin, vehicleNum);
-            parking.purchaseMonthlyPass(vehicleNum);
-            break;
-
-        case 5:
-            cout << "\n--- VIEW MONTHLY PASS ---" << endl;
-            cout << "Enter vehicle number: ";
-            getline(cin, vehicleNum);
-            parking.viewMonthlyPass(vehicleNum);
-            break;
-
-        case 6:
-            parking.displayRevenue();
-            break;
-
-        case 0:
-            cout << "\n╔════════════════════════════════════╗" << endl;
-            cout << "║  Thank you for using our system!   ║" << endl;
-            cout << "║       Data saved successfully      ║" << endl;
-            cout << "╚════════════════════════════════════╝" << endl;
-            return 0;
-
-        default:
-            cout << "\n✗ Invalid choice! Please try again." << endl;
-        }
-    }
-
-    return 0;
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <iomanip>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <charconv>
+#include <new>
+#include <filesystem>
+#include <memory>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <functional>
+#include <unordered_set>
+#include <unordered_map>
+#include <queue>
+#include <deque>
+#include <future>
+#include <condition_variable>
+#include <cmath>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+using namespace std;
+
+// ==================== Vehicle Kinds ====================
+// The one list of vehicle types: class name, hourly rate (₹), default
+// slots per floor, the floor map label, and for the simulator the type's
+// share of arrivals and slots per floor. The VehicleKind enum, the rate,
+// name and slot tables, floor slot pools and snapshot kind codes are all
+// generated from it, so adding a type is a one-line change here. Kind codes
+// are stored in snapshots and journals, so new types go at the end.
+#define VEHICLE_KINDS(X)                        \
+    X(BIKE, Bike, 10.0, 5, "Bikes", 0.3, 40)    \
+    X(CAR, Car, 20.0, 5, "Cars", 0.6, 50)       \
+    X(TRUCK, Truck, 40.0, 2, "Trucks", 0.1, 9)
+
+enum VehicleKind
+{
+#define KIND_ENUM(id, name, rate, slots, plural, mix, simSlots) KIND_##id,
+    VEHICLE_KINDS(KIND_ENUM)
+#undef KIND_ENUM
+    KIND_COUNT
+};
+
+#define KIND_NAME(id, name, rate, slots, plural, mix, simSlots) #name,
+#define KIND_RATE(id, name, rate, slots, plural, mix, simSlots) rate,
+#define KIND_SLOTS(id, name, rate, slots, plural, mix, simSlots) slots,
+#define KIND_PLURAL(id, name, rate, slots, plural, mix, simSlots) plural,
+#define KIND_MIX(id, name, rate, slots, plural, mix, simSlots) mix,
+#define KIND_SIM_SLOTS(id, name, rate, slots, plural, mix, simSlots) simSlots,
+constexpr const char *VEHICLE_KIND_NAMES[KIND_COUNT] = {VEHICLE_KINDS(KIND_NAME)};
+constexpr double VEHICLE_KIND_RATES[KIND_COUNT] = {VEHICLE_KINDS(KIND_RATE)};
+constexpr array<int, KIND_COUNT> DEFAULT_SLOTS_PER_FLOOR = {VEHICLE_KINDS(KIND_SLOTS)};
+constexpr const char *VEHICLE_KIND_PLURALS[KIND_COUNT] = {VEHICLE_KINDS(KIND_PLURAL)};
+constexpr array<double, KIND_COUNT> SIMULATED_VEHICLE_MIX = {VEHICLE_KINDS(KIND_MIX)};
+constexpr array<int, KIND_COUNT> SIMULATED_SLOTS_PER_FLOOR = {VEHICLE_KINDS(KIND_SIM_SLOTS)};
+#undef KIND_NAME
+#undef KIND_RATE
+#undef KIND_SLOTS
+#undef KIND_PLURAL
+#undef KIND_MIX
+#undef KIND_SIM_SLOTS
+
+// Type names are only parsed where input arrives (menu, gate events, old
+// files); everything past that works on the kind. Returns -1 if unknown.
+int vehicleKindFromName(string_view type)
+{
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        if (type == VEHICLE_KIND_NAMES[k])
+            return k;
+    }
+    return -1;
+}
+
+// Recovers a type from the rate it charges, for a ticket whose slot has gone;
+// returns -1 if no type charges that rate
+int vehicleKindFromRate(double rate)
+{
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        if (rate == VEHICLE_KIND_RATES[k])
+            return k;
+    }
+    return -1;
+}
+
+// Slots of every type together, from per-type counts
+int totalSlots(const array<int, KIND_COUNT> &slots)
+{
+    int total = 0;
+    for (int count : slots)
+        total += count;
+    return total;
+}
+
+// "Bike/Car/Truck", for prompts and error messages
+string vehicleKindList()
+{
+    string list;
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        list += (k ? "/" : "");
+        list += VEHICLE_KIND_NAMES[k];
+    }
+    return list;
+}
+
+inline int lowestSetBit(uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+inline int countSetBits(uint64_t word)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt64(word);
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// ==================== Free Slot Index ====================
+// Hierarchical bitmap over slot positions: a set bit means the slot is free.
+// Every level keeps one bit per non-empty word of the level below it, so
+// findFirst() reads one word per level (3 levels cover 262144 slots).
+class FreeSlotIndex
+{
+private:
+    vector<vector<uint64_t>> levels;
+    int capacity;
+    int freeCount;
+
+public:
+    FreeSlotIndex(int size = 0) { resize(size); }
+
+    void resize(int size)
+    {
+        capacity = size;
+        freeCount = 0;
+        levels.clear();
+        int bits = size;
+        do
+        {
+            int words = (bits + 63) / 64;
+            levels.push_back(vector<uint64_t>(words > 0 ? words : 1, 0));
+            bits = words;
+        } while (bits > 1);
+    }
+
+    int size() const { return capacity; }
+    int count() const { return freeCount; }
+    bool any() const { return levels.back()[0] != 0; }
+
+    bool test(int pos) const
+    {
+        return (levels[0][pos >> 6] >> (pos & 63)) & 1;
+    }
+
+    // Recounts from the leaf words; count() is the incrementally kept value
+    int recount() const
+    {
+        int total = 0;
+        for (uint64_t word : levels[0])
+        {
+            total += countSetBits(word);
+        }
+        return total;
+    }
+
+    size_t memoryFootprint() const
+    {
+        size_t bytes = sizeof(*this);
+        for (auto &level : levels)
+        {
+            bytes += level.capacity() * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+
+    void set(int pos)
+    {
+        if (test(pos))
+            return;
+        freeCount++;
+        for (auto &level : levels)
+        {
+            uint64_t &word = level[pos >> 6];
+            bool wasEmpty = (word == 0);
+            word |= uint64_t(1) << (pos & 63);
+            if (!wasEmpty)
+                break;
+            pos >>= 6;
+        }
+    }
+
+    void clear(int pos)
+    {
+        if (!test(pos))
+            return;
+        freeCount--;
+        for (auto &level : levels)
+        {
+            uint64_t &word = level[pos >> 6];
+            word &= ~(uint64_t(1) << (pos & 63));
+            if (word != 0)
+                break;
+            pos >>= 6;
+        }
+    }
+
+    // Lowest free position, or -1 when nothing is free
+    int findFirst() const
+    {
+        if (!any())
+            return -1;
+        int pos = 0;
+        for (int l = (int)levels.size() - 1; l >= 0; l--)
+        {
+            pos = (pos << 6) + lowestSetBit(levels[l][pos]);
+        }
+        return pos;
+    }
+};
+
+// ==================== Clock ====================
+// Source of "now" for entry times, fees and pass validity. The system clock
+// is the default; tests and the simulator substitute a manual one.
+class Clock
+{
+public:
+    virtual ~Clock() {}
+    virtual time_t now() const = 0;
+};
+
+class SystemClock : public Clock
+{
+public:
+    time_t now() const override { return time(0); }
+};
+
+// Stands still until set or advanced
+class ManualClock : public Clock
+{
+private:
+    atomic<long long> current;
+
+public:
+    ManualClock(time_t start = 0) : current(start) {}
+
+    time_t now() const override { return (time_t)current.load(memory_order_relaxed); }
+    void set(time_t t) { current.store(t, memory_order_relaxed); }
+    void advance(long long seconds) { current.fetch_add(seconds, memory_order_relaxed); }
+};
+
+const Clock &systemClock()
+{
+    static SystemClock clock;
+    return clock;
+}
+
+// ==================== Metrics ====================
+// Counters and histograms cheap enough to leave on at full gate load. Each
+// metric is split into cache-line sized stripes picked per thread, so lanes
+// recording at the same time do not bounce one cache line between cores.
+const int METRIC_STRIPES = 8;
+
+inline int metricStripe()
+{
+    static atomic<int> nextStripe(0);
+    static thread_local int stripe = nextStripe.fetch_add(1) % METRIC_STRIPES;
+    return stripe;
+}
+
+inline uint64_t nanosSince(chrono::steady_clock::time_point start)
+{
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+class MetricCounter
+{
+private:
+    struct alignas(64) Stripe
+    {
+        atomic<uint64_t> value{0};
+    };
+    Stripe stripes[METRIC_STRIPES];
+
+public:
+    void add(uint64_t amount = 1) { stripes[metricStripe()].value.fetch_add(amount, memory_order_relaxed); }
+
+    uint64_t value() const
+    {
+        uint64_t total = 0;
+        for (auto &stripe : stripes)
+        {
+            total += stripe.value.load(memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+// Power-of-two buckets: bucket i counts values up to 2^(firstShift + i),
+// the last one everything larger
+class LogHistogram
+{
+public:
+    static const int MAX_BUCKETS = 32;
+
+private:
+    struct alignas(64) Stripe
+    {
+        atomic<uint64_t> buckets[MAX_BUCKETS];
+        atomic<uint64_t> sum;
+    };
+    int firstShift;
+    int bucketCount;
+    Stripe stripes[METRIC_STRIPES];
+
+public:
+    LogHistogram(int shift, int buckets) : firstShift(shift), bucketCount(min(buckets, MAX_BUCKETS))
+    {
+        for (auto &stripe : stripes)
+        {
+            for (auto &bucket : stripe.buckets)
+            {
+                bucket = 0;
+            }
+            stripe.sum = 0;
+        }
+    }
+
+    void record(uint64_t value)
+    {
+        int bits = value <= 1 ? 0 : 64 - countLeadingZeros(value - 1);
+        int index = min(max(bits - firstShift, 0), bucketCount - 1);
+        Stripe &stripe = stripes[metricStripe()];
+        stripe.buckets[index].fetch_add(1, memory_order_relaxed);
+        stripe.sum.fetch_add(value, memory_order_relaxed);
+    }
+
+    static int countLeadingZeros(uint64_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return 63 - (int)index;
+#else
+        return __builtin_clzll(value);
+#endif
+    }
+
+    int getBucketCount() const { return bucketCount; }
+    // Upper bound of bucket i; the last bucket is unbounded
+    uint64_t bucketBound(int i) const { return uint64_t(1) << (firstShift + i); }
+
+    uint64_t bucketValue(int i) const
+    {
+        uint64_t total = 0;
+        for (auto &stripe : stripes)
+        {
+            total += stripe.buckets[i].load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint64_t sum() const
+    {
+        uint64_t total = 0;
+        for (auto &stripe : stripes)
+        {
+            total += stripe.sum.load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    uint64_t count() const
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < bucketCount; i++)
+            total += bucketValue(i);
+        return total;
+    }
+
+    // Prometheus histogram lines; scale converts recorded units to exported ones
+    void writePrometheus(ostream &out, const string &name, const string &help, double scale) const
+    {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (int i = 0; i < bucketCount; i++)
+        {
+            cumulative += bucketValue(i);
+            out << name << "_bucket{le=\"";
+            if (i == bucketCount - 1)
+                out << "+Inf";
+            else
+                out << bucketBound(i) * scale;
+            out << "\"} " << cumulative << "\n";
+        }
+        out << name << "_sum " << sum() * scale << "\n" << name << "_count " << cumulative << "\n";
+    }
+};
+
+// Latencies are recorded in nanoseconds in buckets from 128 ns to about 1 s
+const int LATENCY_SHIFT = 7;
+const int LATENCY_BUCKETS = 25;
+
+// Records the time from construction to destruction
+class LatencyTimer
+{
+private:
+    LogHistogram &histogram;
+    chrono::steady_clock::time_point start;
+
+public:
+    LatencyTimer(LogHistogram &target) : histogram(target), start(chrono::steady_clock::now()) {}
+    ~LatencyTimer() { histogram.record(nanosSince(start)); }
+};
+
+// ==================== Object Pools ====================
+// Fixed-size block allocator for the objects created on every entry and exit.
+// Blocks are carved out of slabs that are kept for the life of the process,
+// so once the garage has seen its peak load parking and leaving reuse freed
+// blocks instead of calling the heap allocator.
+class SlabPool
+{
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    size_t blockSize;
+    size_t blocksPerSlab;
+    mutex lock;
+    FreeBlock *freeList;
+    vector<char *> slabs;
+    size_t liveBlocks;
+
+    // Puts a slab's blocks on the free list so they are handed out in
+    // address order; the caller holds lock
+    void linkSlabLocked(char *slab)
+    {
+        for (size_t i = blocksPerSlab; i-- > 0;)
+        {
+            FreeBlock *block = (FreeBlock *)(slab + i * blockSize);
+            block->next = freeList;
+            freeList = block;
+        }
+    }
+
+    void addSlabLocked()
+    {
+        char *slab = (char *)::operator new(blockSize * blocksPerSlab);
+        slabs.push_back(slab);
+        linkSlabLocked(slab);
+    }
+
+public:
+    SlabPool(size_t size, size_t perSlab = 256)
+        : blockSize((max(size, sizeof(FreeBlock)) + alignof(max_align_t) - 1) / alignof(max_align_t) *
+                    alignof(max_align_t)),
+          blocksPerSlab(perSlab), freeList(nullptr), liveBlocks(0) {}
+
+    ~SlabPool()
+    {
+        for (char *slab : slabs)
+        {
+            ::operator delete(slab);
+        }
+    }
+
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    // Requests larger than a block (a subclass the pool was not sized for)
+    // go to the heap
+    void *allocate(size_t size)
+    {
+        if (size > blockSize)
+            return ::operator new(size);
+        lock_guard<mutex> guard(lock);
+        if (!freeList)
+            addSlabLocked();
+        FreeBlock *block = freeList;
+        freeList = block->next;
+        liveBlocks++;
+        return block;
+    }
+
+    void release(void *pointer, size_t size)
+    {
+        if (!pointer)
+            return;
+        if (size > blockSize)
+        {
+            ::operator delete(pointer);
+            return;
+        }
+        lock_guard<mutex> guard(lock);
+        FreeBlock *block = (FreeBlock *)pointer;
+        block->next = freeList;
+        freeList = block;
+        liveBlocks--;
+    }
+
+    // Carves slabs up front until count more blocks can be handed out
+    // without the heap, e.g. before a snapshot is restored. An idle pool
+    // first relinks its blocks in address order, so a bulk load after a
+    // restart walks memory instead of following the last run's frees.
+    void reserve(size_t count)
+    {
+        lock_guard<mutex> guard(lock);
+        if (liveBlocks == 0)
+        {
+            freeList = nullptr;
+            for (size_t s = slabs.size(); s-- > 0;)
+                linkSlabLocked(slabs[s]);
+        }
+        for (size_t spare = slabs.size() * blocksPerSlab - liveBlocks; spare < count; spare += blocksPerSlab)
+            addSlabLocked();
+    }
+
+    size_t getSlabCount()
+    {
+        lock_guard<mutex> guard(lock);
+        return slabs.size();
+    }
+
+    size_t getLiveCount()
+    {
+        lock_guard<mutex> guard(lock);
+        return liveBlocks;
+    }
+};
+
+// ==================== Vehicle Class ====================
+class Vehicle
+{
+private:
+    string vehicleNumber;
+    int kind;
+    time_t entryTime;
+
+public:
+    // The kind must be valid; names are resolved by vehicleKindFromName.
+    // Times come from the system's Clock, never from here.
+    Vehicle(string num, int vehicleKind, time_t entry) : vehicleNumber(num), kind(vehicleKind), entryTime(entry) {}
+
+    // Every type shares one size, so they all come from one slab pool
+    static void *operator new(size_t size);
+    static void operator delete(void *block, size_t size);
+
+    string getVehicleNumber() const { return vehicleNumber; }
+    string getVehicleType() const { return VEHICLE_KIND_NAMES[kind]; }
+    int getKind() const { return kind; }
+    time_t getEntryTime() const { return entryTime; }
+
+    // A table lookup rather than a virtual call; the rate is per kind
+    double getHourlyRate() const { return VEHICLE_KIND_RATES[kind]; }
+
+    void displayInfo() const
+    {
+        cout << "Vehicle: " << vehicleNumber << " | Type: " << getVehicleType();
+    }
+};
+
+// Returns nullptr for an unknown kind
+Vehicle *createVehicle(int kind, string num, time_t entry)
+{
+    if (kind < 0 || kind >= KIND_COUNT)
+        return nullptr;
+    return new Vehicle(num, kind, entry);
+}
+
+SlabPool &vehiclePool()
+{
+    static SlabPool pool(sizeof(Vehicle));
+    return pool;
+}
+
+void *Vehicle::operator new(size_t size) { return vehiclePool().allocate(size); }
+void Vehicle::operator delete(void *block, size_t size) { vehiclePool().release(block, size); }
+
+// ==================== Parking Slot Class ====================
+// Read-only view of one row of a floor's slot table
+class ParkingSlot
+{
+private:
+    int slotNumber;
+    int kind;
+    Vehicle *parkedVehicle;
+
+public:
+    ParkingSlot(int num, int slotKind, Vehicle *vehicle)
+        : slotNumber(num), kind(slotKind), parkedVehicle(vehicle) {}
+
+    int getSlotNumber() const { return slotNumber; }
+    int getSlotKind() const { return kind; }
+    bool getOccupiedStatus() const { return parkedVehicle != nullptr; }
+    Vehicle *getParkedVehicle() const { return parkedVehicle; }
+
+    void displaySlot() const
+    {
+        if (parkedVehicle)
+        {
+            cout << "[X]";
+        }
+        else
+        {
+            cout << "[ ]";
+        }
+    }
+};
+
+// ==================== Slot Addressing ====================
+// Slot numbers are floorNumber * stride + position + 1, where the stride is
+// the smallest power of ten above the slots per floor (100 for small floors,
+// matching the original numbering). A handle names the slot directly by floor
+// index and position, so it never has to be searched for.
+struct SlotHandle
+{
+    int floorIndex = -1;
+    int position = -1;
+
+    bool valid() const { return floorIndex >= 0 && position >= 0; }
+};
+
+int slotNumberStride(int slotsPerFloor)
+{
+    int stride = 100;
+    while (stride <= slotsPerFloor)
+        stride *= 10;
+    return stride;
+}
+
+// ==================== Ticket Class ====================
+class CompiledTariff;
+
+class Ticket
+{
+private:
+    string vehicleNumber;
+    int slotNumber;
+    SlotHandle slotHandle;
+    time_t entryTime;
+    double hourlyRate;
+    // Settled at entry so most exits need no pass lookup and no tariff
+    // setup: when the pass found then runs out (0 = none), and the tariff
+    // and minute of its week to price the stay from (null = work it out)
+    time_t passValidUntil;
+    const CompiledTariff *tariff;
+    int tariffStartMinute;
+
+public:
+    Ticket(string vNum, int slot, double rate, time_t entry, SlotHandle handle = SlotHandle())
+        : vehicleNumber(vNum), slotNumber(slot), slotHandle(handle), entryTime(entry), hourlyRate(rate),
+          passValidUntil(0), tariff(nullptr), tariffStartMinute(0)
+    {
+    }
+
+    static void *operator new(size_t size);
+    static void operator delete(void *block, size_t size);
+
+    // Built on demand so issuing a ticket does not format a string
+    string getTicketId() const { return "TKT" + to_string(entryTime) + to_string(slotNumber); }
+    string getVehicleNumber() const { return vehicleNumber; }
+    int getSlotNumber() const { return slotNumber; }
+    SlotHandle getSlotHandle() const { return slotHandle; }
+    time_t getEntryTime() const { return entryTime; }
+    double getHourlyRate() const { return hourlyRate; }
+    time_t getPassValidUntil() const { return passValidUntil; }
+    const CompiledTariff *getTariff() const { return tariff; }
+    int getTariffStartMinute() const { return tariffStartMinute; }
+
+    void setExitTerms(time_t passExpiry, const CompiledTariff *entryTariff, int startMinute)
+    {
+        passValidUntil = passExpiry;
+        tariff = entryTariff;
+        tariffStartMinute = startMinute;
+    }
+
+    void displayTicket() const
+    {
+        cout << "\n╔════════════════════════════════════╗" << endl;
+        cout << "║         PARKING TICKET             ║" << endl;
+        cout << "╚════════════════════════════════════╝" << endl;
+        cout << "Ticket ID: " << getTicketId() << endl;
+        cout << "Vehicle: " << vehicleNumber << endl;
+        cout << "Slot: " << slotNumber << endl;
+        cout << "Entry Time: " << ctime(&entryTime);
+        cout << "Rate: ₹" << hourlyRate << "/hour" << endl;
+        cout << "════════════════════════════════════" << endl;
+    }
+};
+
+SlabPool &ticketPool()
+{
+    static SlabPool pool(sizeof(Ticket));
+    return pool;
+}
+
+void *Ticket::operator new(size_t size) { return ticketPool().allocate(size); }
+void Ticket::operator delete(void *block, size_t size) { ticketPool().release(block, size); }
+
+// ==================== Payment Class ====================
+class Payment
+{
+private:
+    double amount;
+    time_t paymentTime;
+    string paymentMethod;
+
+public:
+    Payment(double amt, string method, time_t when) : amount(amt), paymentTime(when), paymentMethod(method) {}
+
+    void displayReceipt(string vehicleNum, double hours, double rate) const
+    {
+        cout << "\n╔════════════════════════════════════╗" << endl;
+        cout << "║         PAYMENT RECEIPT            ║" << endl;
+        cout << "╚════════════════════════════════════╝" << endl;
+        cout << "Vehicle: " << vehicleNum << endl;
+        cout << "Duration: " << fixed << setprecision(2) << hours << " hours" << endl;
+        cout << "Rate: ₹" << rate << "/hour" << endl;
+        cout << "Amount: ₹" << amount << endl;
+        cout << "Method: " << paymentMethod << endl;
+        cout << "Time: " << ctime(&paymentTime);
+        cout << "════════════════════════════════════" << endl;
+        cout << "    Thank you! Visit again!" << endl;
+        cout << "════════════════════════════════════" << endl;
+    }
+};
+
+// ==================== Monthly Pass Class ====================
+class MonthlyPass
+{
+private:
+    string vehicleNumber;
+    time_t startDate;
+    time_t expiryDate;
+    bool isActive;
+
+public:
+    MonthlyPass(string vNum, time_t start) : vehicleNumber(vNum), startDate(start)
+    {
+        expiryDate = startDate + (30 * 24 * 60 * 60);
+        isActive = true;
+    }
+
+    static void *operator new(size_t size);
+    static void operator delete(void *block, size_t size);
+
+    string getVehicleNumber() const { return vehicleNumber; }
+    string getPassId() const { return "PASS" + to_string(startDate); }
+    time_t getStartDate() const { return startDate; }
+    time_t getExpiryDate() const { return expiryDate; }
+
+    bool checkValidity(time_t now) const
+    {
+        return isActive && (now < expiryDate);
+    }
+
+    void displayPass(time_t now) const
+    {
+        cout << "\n╔════════════════════════════════════╗" << endl;
+        cout << "║         MONTHLY PASS               ║" << endl;
+        cout << "╚════════════════════════════════════╝" << endl;
+        cout << "Pass ID: " << getPassId() << endl;
+        cout << "Vehicle: " << vehicleNumber << endl;
+        cout << "Start Date: " << ctime(&startDate);
+        cout << "Valid till: " << ctime(&expiryDate);
+        cout << "Status: " << (checkValidity(now) ? "✓ Active" : "✗ Expired") << endl;
+        cout << "════════════════════════════════════" << endl;
+    }
+};
+
+SlabPool &passPool()
+{
+    static SlabPool pool(sizeof(MonthlyPass), 4096);
+    return pool;
+}
+
+void *MonthlyPass::operator new(size_t size) { return passPool().allocate(size); }
+void MonthlyPass::operator delete(void *block, size_t size) { passPool().release(block, size); }
+
+// ==================== Parking Floor Class ====================
+// Slots are stored as a table of parallel arrays rather than one object per
+// slot: a kind code, an occupancy bit (the kind's free-slot bitmap) and an
+// index into the kind's vehicle table. Positions are 0-based slot indexes.
+class ParkingFloor
+{
+private:
+    static constexpr uint32_t NO_VEHICLE = 0xFFFFFFFFu;
+
+    int floorNumber;
+    int numberStride;
+    vector<uint8_t> slotKinds;
+    vector<uint32_t> vehicleIndex;
+    // Slots of one kind are numbered contiguously, so each kind indexes its own range
+    int kindOffset[KIND_COUNT + 1];
+    FreeSlotIndex freeSlots[KIND_COUNT];
+    vector<Vehicle *> vehicleTable[KIND_COUNT];
+    vector<uint32_t> freeVehicleEntries[KIND_COUNT];
+    // Free slots per kind, changed under the kind lock and read without it
+    atomic<int> freeCounts[KIND_COUNT];
+    // One lock per kind pool, so lanes parking different kinds never contend
+    mutable mutex kindLocks[KIND_COUNT];
+
+    void attachVehicle(int position, Vehicle *vehicle)
+    {
+        int kind = slotKinds[position];
+        uint32_t entry;
+        if (freeVehicleEntries[kind].empty())
+        {
+            entry = (uint32_t)vehicleTable[kind].size();
+            vehicleTable[kind].push_back(vehicle);
+        }
+        else
+        {
+            entry = freeVehicleEntries[kind].back();
+            freeVehicleEntries[kind].pop_back();
+            vehicleTable[kind][entry] = vehicle;
+        }
+        vehicleIndex[position] = entry;
+        freeSlots[kind].clear(position - kindOffset[kind]);
+        freeCounts[kind].fetch_sub(1, memory_order_relaxed);
+    }
+
+public:
+    // A stride of 0 picks one from this floor's own size
+    ParkingFloor(int num, const array<int, KIND_COUNT> &counts, int stride = 0)
+        : floorNumber(num)
+    {
+        int total = totalSlots(counts);
+        numberStride = stride > 0 ? stride : slotNumberStride(total);
+        slotKinds.reserve(total);
+        vehicleIndex.assign(total, NO_VEHICLE);
+
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            kindOffset[k] = (int)slotKinds.size();
+            slotKinds.insert(slotKinds.end(), counts[k], (uint8_t)k);
+            freeSlots[k].resize(counts[k]);
+            for (int i = 0; i < counts[k]; i++)
+            {
+                freeSlots[k].set(i);
+            }
+            freeCounts[k] = counts[k];
+        }
+        kindOffset[KIND_COUNT] = total;
+    }
+
+    int getFloorNumber() const { return floorNumber; }
+    int getSlotCount() const { return (int)slotKinds.size(); }
+    int slotKind(int position) const { return slotKinds[position]; }
+    int slotNumberAt(int position) const { return floorNumber * numberStride + position + 1; }
+
+    mutex &kindLock(int kind) const { return kindLocks[kind]; }
+
+    // Everything from here to findAvailableSlot expects the caller to hold
+    // kindLock() for the kind involved
+    bool hasAvailable(int kind) const { return freeSlots[kind].any(); }
+
+    bool isOccupied(int position) const
+    {
+        int kind = slotKinds[position];
+        return !freeSlots[kind].test(position - kindOffset[kind]);
+    }
+
+    Vehicle *vehicleAt(int position) const
+    {
+        uint32_t entry = vehicleIndex[position];
+        return entry == NO_VEHICLE ? nullptr : vehicleTable[slotKinds[position]][entry];
+    }
+
+    ParkingSlot slotAt(int position) const
+    {
+        return ParkingSlot(slotNumberAt(position), slotKinds[position], vehicleAt(position));
+    }
+
+    // Parks into the lowest numbered free slot of the vehicle's kind;
+    // returns the position, or -1 when the pool is full
+    int occupyFirstAvailable(Vehicle *vehicle)
+    {
+        int kind = vehicle->getKind();
+        int pos = freeSlots[kind].findFirst();
+        if (pos < 0)
+            return -1;
+        attachVehicle(kindOffset[kind] + pos, vehicle);
+        return kindOffset[kind] + pos;
+    }
+
+    bool occupySlot(int position, Vehicle *vehicle)
+    {
+        if (slotKinds[position] != vehicle->getKind() || isOccupied(position))
+            return false;
+        attachVehicle(position, vehicle);
+        return true;
+    }
+
+    Vehicle *vacateSlot(int position)
+    {
+        uint32_t entry = vehicleIndex[position];
+        if (entry == NO_VEHICLE)
+            return nullptr;
+        int kind = slotKinds[position];
+        Vehicle *vehicle = vehicleTable[kind][entry];
+        vehicleTable[kind][entry] = nullptr;
+        freeVehicleEntries[kind].push_back(entry);
+        vehicleIndex[position] = NO_VEHICLE;
+        freeSlots[kind].set(position - kindOffset[kind]);
+        freeCounts[kind].fetch_add(1, memory_order_relaxed);
+        return vehicle;
+    }
+
+    // Returns a position, or -1; the slot may be taken by another lane as
+    // soon as the lock is dropped
+    int findAvailableSlot(string vehicleType)
+    {
+        int kind = vehicleKindFromName(vehicleType);
+        if (kind < 0)
+            return -1;
+        lock_guard<mutex> lock(kindLocks[kind]);
+        int pos = freeSlots[kind].findFirst();
+        return pos < 0 ? -1 : kindOffset[kind] + pos;
+    }
+
+    // Returns the position of a slot number on this floor, or -1
+    int findSlotByNumber(int slotNum) const
+    {
+        int position = slotNum - floorNumber * numberStride - 1;
+        if (position < 0 || position >= (int)slotKinds.size())
+            return -1;
+        return position;
+    }
+
+    void displayFloorStatus() const
+    {
+        cout << "\n--- Floor " << floorNumber << " ---" << endl;
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            lock_guard<mutex> lock(kindLocks[k]);
+            cout << (k ? "\n" : "") << left << setw(8) << string(VEHICLE_KIND_PLURALS[k]) + ":" << right;
+            for (int i = 0; i < freeSlots[k].size(); i++)
+            {
+                cout << (freeSlots[k].test(i) ? "[ ] " : "[X] ");
+            }
+        }
+        cout << endl;
+    }
+
+    // Lock-free read of the free counter; may trail a park in progress
+    int availableOf(int kind) const { return freeCounts[kind].load(memory_order_relaxed); }
+    int slotsOf(int kind) const { return kindOffset[kind + 1] - kindOffset[kind]; }
+
+    int getAvailableCount(string type) const
+    {
+        int kind = vehicleKindFromName(type);
+        return kind < 0 ? 0 : availableOf(kind);
+    }
+
+    // Same answer as getAvailableCount, found by scanning the occupancy bits
+    int recountAvailable(int kind) const
+    {
+        lock_guard<mutex> lock(kindLocks[kind]);
+        return freeSlots[kind].recount();
+    }
+
+    size_t memoryFootprint() const
+    {
+        size_t bytes = sizeof(*this) + slotKinds.capacity() + vehicleIndex.capacity() * sizeof(uint32_t);
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            bytes += freeSlots[k].memoryFootprint() - sizeof(FreeSlotIndex) +
+                     vehicleTable[k].capacity() * sizeof(Vehicle *) +
+                     freeVehicleEntries[k].capacity() * sizeof(uint32_t);
+        }
+        return bytes;
+    }
+};
+
+// ==================== Slot Allocator ====================
+// How entry picks a slot. Lowest fills floor 1 first; nearest takes the free
+// slot with the smallest distance rank; spread takes the floor with the most
+// free slots of the kind, grouped the fullest floor that still has one, so
+// empty floors can stay dark.
+enum AllocationPolicy
+{
+    ALLOCATE_LOWEST,
+    ALLOCATE_NEAREST,
+    ALLOCATE_SPREAD,
+    ALLOCATE_GROUPED,
+    ALLOCATION_POLICY_COUNT
+};
+
+const char *const ALLOCATION_POLICY_NAMES[ALLOCATION_POLICY_COUNT] = {"lowest", "nearest", "spread", "grouped"};
+
+int allocationPolicyFromName(const string &name)
+{
+    for (int p = 0; p < ALLOCATION_POLICY_COUNT; p++)
+    {
+        if (name == ALLOCATION_POLICY_NAMES[p])
+            return p;
+    }
+    return -1;
+}
+
+// Distance from the entrance of the slot at a floor index and position;
+// only the order matters
+using SlotDistance = function<double(int floorIndex, int position)>;
+
+// Tournament tree over the free counts of the floors: the root names both
+// the floor with the most free slots and the fullest floor that still has
+// one, and a count change is one leaf-to-root pass
+class FloorLoadTree
+{
+private:
+    int leaves;
+    vector<int> freeCount;
+    vector<int> most;  // per node, floor index or -1
+    vector<int> least; // per node, fullest floor with a free slot or -1
+
+    int pickMost(int a, int b) const
+    {
+        if (a < 0 || b < 0)
+            return a < 0 ? b : a;
+        return freeCount[b] > freeCount[a] ? b : a;
+    }
+
+    int pickLeast(int a, int b) const
+    {
+        if (a < 0 || b < 0)
+            return a < 0 ? b : a;
+        return freeCount[b] < freeCount[a] ? b : a;
+    }
+
+public:
+    explicit FloorLoadTree(int floors = 0)
+    {
+        leaves = 1;
+        while (leaves < floors)
+            leaves *= 2;
+        freeCount.assign(floors, 0);
+        most.assign(2 * leaves, -1);
+        least.assign(2 * leaves, -1);
+        for (int i = 0; i < floors; i++)
+            most[leaves + i] = i;
+        for (int node = leaves - 1; node > 0; node--)
+            most[node] = pickMost(most[2 * node], most[2 * node + 1]);
+    }
+
+    void update(int floor, int count)
+    {
+        freeCount[floor] = count;
+        int node = leaves + floor;
+        least[node] = count > 0 ? floor : -1;
+        for (node /= 2; node > 0; node /= 2)
+        {
+            most[node] = pickMost(most[2 * node], most[2 * node + 1]);
+            least[node] = pickLeast(least[2 * node], least[2 * node + 1]);
+        }
+    }
+
+    // Both return -1 when no floor has a free slot; ties go to the lower floor
+    int emptiest() const { return most[1] >= 0 && freeCount[most[1]] > 0 ? most[1] : -1; }
+    int fullest() const { return least[1]; }
+};
+
+// Garage-wide view of the floors: per kind, a bitmap of floors that may still
+// have a free slot, so entry never walks full floors. Bits only change while
+// the floor's kind lock is held; lanes read them without locking as hints.
+// The other policies keep one structure per kind behind its own lock, taken
+// before any floor lock; frees and replayed parks reach it after the floor
+// lock is dropped, so it may trail the floors but never offers a taken slot
+// without the occupy failing and the search moving on.
+class SlotAllocator
+{
+private:
+    // Free slots of one kind across the garage, in distance rank order
+    struct RankedSlots
+    {
+        mutex lock;
+        FreeSlotIndex free;
+        vector<SlotHandle> byRank;
+    };
+
+    struct FloorLoads
+    {
+        mutex lock;
+        FloorLoadTree tree;
+    };
+
+    vector<ParkingFloor *> floors;
+    AllocationPolicy policy;
+    int hintWords;
+    unique_ptr<atomic<uint64_t>[]> floorsWithSpace[KIND_COUNT];
+    unique_ptr<RankedSlots[]> rankedSlots; // ALLOCATE_NEAREST, per kind
+    vector<vector<uint32_t>> slotRank;     // per floor index and position
+    unique_ptr<FloorLoads[]> floorLoads;   // ALLOCATE_SPREAD and ALLOCATE_GROUPED, per kind
+    atomic<int> freeTotals[KIND_COUNT];    // free slots per kind across the garage
+    // Floors tried per allocation, 1 when the first candidate has room
+    LogHistogram searchLength{0, 12};
+
+    void markFloor(int index, int kind, bool hasSpace)
+    {
+        uint64_t bit = uint64_t(1) << (index & 63);
+        if (hasSpace)
+            floorsWithSpace[kind][index >> 6].fetch_or(bit);
+        else
+            floorsWithSpace[kind][index >> 6].fetch_and(~bit);
+    }
+
+    bool occupyFloorSlot(SlotHandle handle, Vehicle *vehicle)
+    {
+        ParkingFloor *floor = floors[handle.floorIndex];
+        int kind = floor->slotKind(handle.position);
+        lock_guard<mutex> lock(floor->kindLock(kind));
+        if (!floor->occupySlot(handle.position, vehicle))
+            return false;
+        if (!floor->hasAvailable(kind))
+            markFloor(handle.floorIndex, kind, false);
+        freeTotals[kind].fetch_sub(1, memory_order_relaxed);
+        return true;
+    }
+
+    // Brings the policy's structure up to date with a slot that was taken
+    // or freed outside allocate()
+    void trackSlot(SlotHandle handle, int kind, bool free)
+    {
+        if (policy == ALLOCATE_NEAREST)
+        {
+            RankedSlots &ranked = rankedSlots[kind];
+            lock_guard<mutex> lock(ranked.lock);
+            int rank = slotRank[handle.floorIndex][handle.position];
+            if (free)
+                ranked.free.set(rank);
+            else
+                ranked.free.clear(rank);
+        }
+        else if (policy == ALLOCATE_SPREAD || policy == ALLOCATE_GROUPED)
+        {
+            FloorLoads &loads = floorLoads[kind];
+            lock_guard<mutex> lock(loads.lock);
+            loads.tree.update(handle.floorIndex, floors[handle.floorIndex]->availableOf(kind));
+        }
+    }
+
+    SlotHandle allocateNearest(Vehicle *vehicle, int kind, int &probes)
+    {
+        RankedSlots &ranked = rankedSlots[kind];
+        lock_guard<mutex> lock(ranked.lock);
+        while (true)
+        {
+            int rank = ranked.free.findFirst();
+            if (rank < 0)
+                return SlotHandle();
+            ranked.free.clear(rank);
+            probes++;
+            if (occupyFloorSlot(ranked.byRank[rank], vehicle))
+                return ranked.byRank[rank];
+        }
+    }
+
+    SlotHandle allocateByLoad(Vehicle *vehicle, int kind, int &probes)
+    {
+        FloorLoads &loads = floorLoads[kind];
+        lock_guard<mutex> lock(loads.lock);
+        while (true)
+        {
+            int index = policy == ALLOCATE_SPREAD ? loads.tree.emptiest() : loads.tree.fullest();
+            if (index < 0)
+                return SlotHandle();
+            probes++;
+            ParkingFloor *floor = floors[index];
+            SlotHandle handle;
+            {
+                lock_guard<mutex> floorLock(floor->kindLock(kind));
+                int position = floor->occupyFirstAvailable(vehicle);
+                if (!floor->hasAvailable(kind))
+                    markFloor(index, kind, false);
+                loads.tree.update(index, floor->availableOf(kind));
+                if (position < 0)
+                    continue;
+                freeTotals[kind].fetch_sub(1, memory_order_relaxed);
+                handle.floorIndex = index;
+                handle.position = position;
+            }
+            return handle;
+        }
+    }
+
+public:
+    // distance ranks the slots for ALLOCATE_NEAREST; without one they rank
+    // in drive order, floor by floor and by slot number
+    SlotAllocator(const vector<ParkingFloor *> &garageFloors, AllocationPolicy allocation = ALLOCATE_LOWEST,
+                  SlotDistance distance = nullptr)
+        : floors(garageFloors), policy(allocation)
+    {
+        hintWords = ((int)floors.size() + 63) / 64;
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            freeTotals[k] = 0;
+            for (auto floor : floors)
+                freeTotals[k] += floor->availableOf(k);
+            floorsWithSpace[k].reset(new atomic<uint64_t>[hintWords]);
+            for (int w = 0; w < hintWords; w++)
+            {
+                floorsWithSpace[k][w] = 0;
+            }
+            for (int i = 0; i < (int)floors.size(); i++)
+            {
+                lock_guard<mutex> lock(floors[i]->kindLock(k));
+                markFloor(i, k, floors[i]->hasAvailable(k));
+            }
+        }
+
+        if (policy == ALLOCATE_NEAREST)
+        {
+            rankedSlots.reset(new RankedSlots[KIND_COUNT]);
+            slotRank.resize(floors.size());
+            vector<pair<double, SlotHandle>> order[KIND_COUNT];
+            double driveOrder = 0;
+            for (int i = 0; i < (int)floors.size(); i++)
+            {
+                slotRank[i].resize(floors[i]->getSlotCount());
+                for (int pos = 0; pos < floors[i]->getSlotCount(); pos++)
+                {
+                    SlotHandle handle;
+                    handle.floorIndex = i;
+                    handle.position = pos;
+                    order[floors[i]->slotKind(pos)].push_back({distance ? distance(i, pos) : driveOrder++, handle});
+                }
+            }
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                RankedSlots &ranked = rankedSlots[k];
+                stable_sort(order[k].begin(), order[k].end(),
+                            [](const pair<double, SlotHandle> &a, const pair<double, SlotHandle> &b) {
+                                return a.first < b.first;
+                            });
+                ranked.free.resize((int)order[k].size());
+                for (int rank = 0; rank < (int)order[k].size(); rank++)
+                {
+                    SlotHandle handle = order[k][rank].second;
+                    ranked.byRank.push_back(handle);
+                    slotRank[handle.floorIndex][handle.position] = (uint32_t)rank;
+                    lock_guard<mutex> lock(floors[handle.floorIndex]->kindLock(k));
+                    if (!floors[handle.floorIndex]->isOccupied(handle.position))
+                        ranked.free.set(rank);
+                }
+            }
+        }
+        else if (policy == ALLOCATE_SPREAD || policy == ALLOCATE_GROUPED)
+        {
+            floorLoads.reset(new FloorLoads[KIND_COUNT]);
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                floorLoads[k].tree = FloorLoadTree((int)floors.size());
+                for (int i = 0; i < (int)floors.size(); i++)
+                    floorLoads[k].tree.update(i, floors[i]->availableOf(k));
+            }
+        }
+    }
+
+    AllocationPolicy getPolicy() const { return policy; }
+
+    // Free slots of a kind in the whole garage, read without locking
+    int availableOf(int kind) const { return freeTotals[kind].load(memory_order_relaxed); }
+
+    // A free slot chosen by the policy; the handle is invalid when the
+    // garage is full. Lowest takes the lowest free slot on the lowest floor
+    // with space, and its first sweep skips pools another lane is holding,
+    // so concurrent entries spread over floors instead of queueing.
+    SlotHandle allocate(Vehicle *vehicle)
+    {
+        SlotHandle handle;
+        int kind = vehicle->getKind();
+        if (kind < 0)
+            return handle;
+        int probes = 0;
+        if (policy != ALLOCATE_LOWEST)
+        {
+            handle = policy == ALLOCATE_NEAREST ? allocateNearest(vehicle, kind, probes)
+                                                : allocateByLoad(vehicle, kind, probes);
+            searchLength.record(probes);
+            return handle;
+        }
+        for (int sweep = 0; sweep < 2; sweep++)
+        {
+            for (int w = 0; w < hintWords; w++)
+            {
+                uint64_t candidates = floorsWithSpace[kind][w].load();
+                while (candidates != 0)
+                {
+                    int index = w * 64 + lowestSetBit(candidates);
+                    candidates &= candidates - 1;
+                    ParkingFloor *floor = floors[index];
+                    probes++;
+
+                    unique_lock<mutex> lock(floor->kindLock(kind), defer_lock);
+                    if (sweep == 0 && !lock.try_lock())
+                        continue;
+                    if (sweep == 1)
+                        lock.lock();
+                    int position = floor->occupyFirstAvailable(vehicle);
+                    if (!floor->hasAvailable(kind))
+                        markFloor(index, kind, false);
+                    if (position >= 0)
+                    {
+                        freeTotals[kind].fetch_sub(1, memory_order_relaxed);
+                        handle.floorIndex = index;
+                        handle.position = position;
+                        searchLength.record(probes);
+                        return handle;
+                    }
+                }
+            }
+        }
+        searchLength.record(probes);
+        return handle;
+    }
+
+    bool occupy(SlotHandle handle, Vehicle *vehicle)
+    {
+        if (!occupyFloorSlot(handle, vehicle))
+            return false;
+        trackSlot(handle, vehicle->getKind(), false);
+        return true;
+    }
+
+    Vehicle *release(SlotHandle handle)
+    {
+        ParkingFloor *floor = floors[handle.floorIndex];
+        int kind = floor->slotKind(handle.position);
+        Vehicle *vehicle;
+        {
+            lock_guard<mutex> lock(floor->kindLock(kind));
+            vehicle = floor->vacateSlot(handle.position);
+            if (vehicle)
+            {
+                markFloor(handle.floorIndex, kind, true);
+                freeTotals[kind].fetch_add(1, memory_order_relaxed);
+            }
+        }
+        if (vehicle)
+            trackSlot(handle, kind, true);
+        return vehicle;
+    }
+
+    const LogHistogram &getSearchLength() const { return searchLength; }
+
+    // Occupant of a slot, for startup replay only
+    Vehicle *occupant(SlotHandle handle) const
+    {
+        ParkingFloor *floor = floors[handle.floorIndex];
+        lock_guard<mutex> lock(floor->kindLock(floor->slotKind(handle.position)));
+        return floor->vehicleAt(handle.position);
+    }
+};
+
+// ==================== Durable File Helpers ====================
+int openAppendFile(const string &path, bool truncate)
+{
+#ifdef _WIN32
+    int flags = _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (truncate ? _O_TRUNC : 0);
+    return _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0);
+    return open(path.c_str(), flags, 0644);
+#endif
+}
+
+bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+#ifdef _WIN32
+        int written = _write(fd, data, (unsigned)length);
+#else
+        ssize_t written = write(fd, data, length);
+#endif
+        if (written <= 0)
+            return false;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool syncFile(int fd)
+{
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+void closeFile(int fd)
+{
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+// Makes renames within the file's directory survive a power loss
+void syncParentDirectory(const string &path)
+{
+#ifndef _WIN32
+    string dir = filesystem::path(path).parent_path().string();
+    int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    fsync(fd);
+    close(fd);
+#endif
+}
+
+// Writes the parts to path.tmp, syncs it and renames it over path, so a crash
+// leaves either the whole old file or the whole new one
+bool replaceFileDurably(const string &path, initializer_list<string_view> parts)
+{
+    string temp = path + ".tmp";
+    int fd = openAppendFile(temp, true);
+    if (fd < 0)
+        return false;
+    bool ok = true;
+    for (string_view part : parts)
+        ok = ok && writeAll(fd, part.data(), part.size());
+    ok = syncFile(fd) && ok;
+    closeFile(fd);
+    if (!ok)
+        return false;
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    if (rename(temp.c_str(), path.c_str()) != 0)
+        return false;
+    syncParentDirectory(path);
+    return true;
+}
+
+// ==================== Write-Ahead Journal ====================
+struct JournalConfig
+{
+    int fsyncEveryRecords = 1;      // group commit: fsync once this many records are pending
+    int fsyncIntervalMs = 0;        // ...or once the oldest pending record is this old
+    int compactEveryRecords = 1000; // snapshot and truncate the journal after this many records
+    bool asyncWrites = true;        // a writer thread does the writes; gates only queue records
+    int durabilityWindowMs = 20;    // async: fsync records at most this long after they were queued
+    int queueBatches = 1024;        // async: appends beyond this many queued batches wait for the writer
+};
+
+// Records for one journal append, formatted into a reusable buffer. Gate lanes
+// keep one per thread, so a steady stream of events does not allocate.
+class JournalBatch
+{
+private:
+    string text;
+    int count = 0;
+
+public:
+    void clear()
+    {
+        text.clear();
+        count = 0;
+    }
+
+    // Starts the next record; its fields follow with add()
+    JournalBatch &record(const char *type)
+    {
+        if (count > 0)
+            text += '\n';
+        text += type;
+        count++;
+        return *this;
+    }
+
+    JournalBatch &add(string_view field)
+    {
+        text += ',';
+        text.append(field.data(), field.size());
+        return *this;
+    }
+
+    JournalBatch &add(long long value)
+    {
+        char digits[24];
+        char *end = to_chars(digits, digits + sizeof(digits), value).ptr;
+        text += ',';
+        text.append(digits, end - digits);
+        return *this;
+    }
+
+    // Same text as formatAmount
+    JournalBatch &addAmount(double value)
+    {
+        char digits[32];
+        int length = snprintf(digits, sizeof(digits), "%.15g", value);
+        text += ',';
+        text.append(digits, length);
+        return *this;
+    }
+
+    int size() const { return count; }
+    // Records separated by newlines, without LSNs
+    const string &lines() const { return text; }
+};
+
+// Where a checkpoint cut the journal: the last record it covers, the file
+// size up to and including that record, and the records appended by then
+struct JournalCut
+{
+    long long lsn = 0;
+    uint64_t bytes = 0;
+    int records = 0;
+};
+
+// Append-only log of PARK, EXIT, PAY and PASS records. Every line starts with
+// a log sequence number so records already covered by a snapshot are skipped.
+//
+// With asyncWrites, append() only copies the batch into the next free cell
+// of a bounded ring and returns; a writer thread takes the cells in order,
+// numbers and writes them in one go, and fsyncs by the group-commit rules,
+// at the latest durabilityWindowMs after a record was queued. Lanes claim
+// cells with a compare-and-swap and never wait on the disk unless the ring
+// is full. Without asyncWrites the calling lane writes (and fsyncs) itself,
+// serialised by the journal's lock.
+class Journal
+{
+private:
+    // One queued batch; sequence says whose turn the cell is (Vyukov's
+    // bounded queue): pos for the lane claiming it, pos + 1 once filled
+    struct Cell
+    {
+        atomic<size_t> sequence;
+        string text;
+        int records = 0;
+    };
+
+    string path;
+    JournalConfig config;
+    mutex lock; // the file and everything below, up to the ring
+    int fd;
+    long long nextLsn;
+    uint64_t fileBytes;          // only what was written whole
+    atomic<bool> failed;         // a write or fsync has failed; stays set
+    int pendingSync;
+    atomic<int> recordsSinceReset;
+    chrono::steady_clock::time_point oldestPending;
+    string buffer;
+    MetricCounter bytesWritten;
+    LogHistogram syncLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+
+    vector<Cell> cells;
+    size_t cellMask;
+    atomic<size_t> enqueuePos;
+    size_t dequeuePos;           // writer thread only
+    atomic<size_t> writtenPos;   // cells before this are written, maybe not synced
+    atomic<size_t> syncedPos;    // cells before this are on disk
+    atomic<size_t> writeTarget;  // a cut() is waiting for cells before this to be written
+    atomic<size_t> flushTarget;  // a flush() is waiting for cells before this
+    atomic<bool> writerIdle;
+    atomic<bool> stopping;
+    mutex wakeLock;
+    condition_variable wake;     // the idle writer waits here
+    condition_variable synced;   // flush() waits here
+    MetricCounter queueFullWaits;
+    thread writer;
+
+    void syncLocked()
+    {
+        if (fd >= 0 && pendingSync > 0)
+        {
+            LatencyTimer timer(syncLatency);
+            if (!syncFile(fd))
+                failed.store(true, memory_order_release);
+        }
+        pendingSync = 0;
+    }
+
+    // Adds the batch's records to buffer, each behind the next LSN
+    void formatLocked(const string &lines, int count)
+    {
+        size_t start = 0;
+        for (int i = 0; i < count; i++)
+        {
+            size_t end = lines.find('\n', start);
+            if (end == string::npos)
+                end = lines.size();
+            char digits[24];
+            char *digitsEnd = to_chars(digits, digits + sizeof(digits), nextLsn++).ptr;
+            buffer.append(digits, digitsEnd - digits);
+            buffer += ',';
+            buffer.append(lines, start, end - start);
+            buffer += '\n';
+            start = end + 1;
+        }
+        if (pendingSync == 0)
+            oldestPending = chrono::steady_clock::now();
+        pendingSync += count;
+    }
+
+    void writeBufferLocked()
+    {
+        if (fd >= 0 && writeAll(fd, buffer.data(), buffer.size()))
+        {
+            bytesWritten.add(buffer.size());
+            fileBytes += buffer.size();
+        }
+        else
+        {
+            // Cut a partial write off again, so fileBytes stays the file's
+            // length and the next record starts on a line of its own
+            error_code ec;
+            if (fd >= 0)
+                filesystem::resize_file(path, fileBytes, ec);
+            if (!failed.exchange(true, memory_order_acq_rel))
+                cerr << "✗ Warning: could not write to " << path << endl;
+        }
+        buffer.clear();
+    }
+
+    bool syncDueLocked() const
+    {
+        if (pendingSync == 0)
+            return false;
+        auto age = chrono::steady_clock::now() - oldestPending;
+        return (config.fsyncEveryRecords > 0 && pendingSync >= config.fsyncEveryRecords) ||
+               (config.fsyncIntervalMs > 0 && age >= chrono::milliseconds(config.fsyncIntervalMs)) ||
+               (config.asyncWrites && config.durabilityWindowMs > 0 &&
+                age >= chrono::milliseconds(config.durabilityWindowMs));
+    }
+
+    bool cellReady() const
+    {
+        return cells[dequeuePos & cellMask].sequence.load(memory_order_acquire) == dequeuePos + 1;
+    }
+
+    void wakeWriter()
+    {
+        {
+            lock_guard<mutex> guard(wakeLock);
+        }
+        wake.notify_one();
+    }
+
+    // Writes every filled cell at the head of the ring with one write, then
+    // fsyncs if a rule or a waiting flush() asks for it. Returns true while
+    // written records still wait for an fsync.
+    bool drain()
+    {
+        size_t writtenBefore, syncedBefore;
+        bool unsynced;
+        {
+            lock_guard<mutex> guard(lock);
+            writtenBefore = writtenPos.load(memory_order_relaxed);
+            while (cellReady())
+            {
+                Cell &cell = cells[dequeuePos & cellMask];
+                formatLocked(cell.text, cell.records);
+                cell.sequence.store(dequeuePos + cellMask + 1, memory_order_release);
+                dequeuePos++;
+            }
+            if (!buffer.empty())
+                writeBufferLocked();
+            writtenPos.store(dequeuePos, memory_order_release);
+            if (syncDueLocked() || flushTarget.load(memory_order_acquire) > syncedPos.load(memory_order_relaxed))
+                syncLocked();
+            syncedBefore = syncedPos.load(memory_order_relaxed);
+            unsynced = pendingSync > 0;
+            if (!unsynced)
+                syncedPos.store(dequeuePos, memory_order_release);
+        }
+        // Wake a cut() or flush() whose records just got where it wanted them
+        bool written = dequeuePos > writtenBefore && writeTarget.load(memory_order_acquire) > writtenBefore;
+        bool flushed = !unsynced && dequeuePos > syncedBefore && flushTarget.load(memory_order_acquire) > syncedBefore;
+        if (written || flushed)
+        {
+            {
+                lock_guard<mutex> guard(wakeLock);
+            }
+            synced.notify_all();
+        }
+        return unsynced;
+    }
+
+    // Asks the writer to take every cell queued so far at least as far as
+    // reached (written or synced), and waits until it has
+    void waitForWriter(atomic<size_t> &target, const atomic<size_t> &reached)
+    {
+        size_t wanted = enqueuePos.load(memory_order_acquire);
+        size_t current = target.load(memory_order_relaxed);
+        while (current < wanted && !target.compare_exchange_weak(current, wanted))
+        {
+        }
+        wakeWriter();
+        unique_lock<mutex> guard(wakeLock);
+        synced.wait(guard, [&]() { return reached.load(memory_order_acquire) >= wanted; });
+    }
+
+    void writerLoop()
+    {
+        while (true)
+        {
+            size_t before = dequeuePos;
+            bool unsynced = drain();
+            bool stop = stopping.load(memory_order_acquire);
+            if (stop && dequeuePos == enqueuePos.load(memory_order_acquire))
+                break;
+
+            unique_lock<mutex> guard(wakeLock);
+            auto nothingAsked = [&]() {
+                return !stopping.load() && flushTarget.load(memory_order_acquire) <= syncedPos.load(memory_order_acquire) &&
+                       writeTarget.load(memory_order_acquire) <= writtenPos.load(memory_order_acquire);
+            };
+            if (dequeuePos != before)
+            {
+                // Under traffic, let the next records gather for a moment
+                // rather than have every lane wake the writer
+                if (nothingAsked())
+                    wake.wait_for(guard, chrono::milliseconds(1));
+                continue;
+            }
+            writerIdle.store(true);
+            atomic_thread_fence(memory_order_seq_cst);
+            // Wakes by itself in time to honour the durability window
+            chrono::milliseconds timeout(stop ? 1 : 100);
+            int windowMs = config.durabilityWindowMs > 0 ? config.durabilityWindowMs : config.fsyncIntervalMs;
+            if (unsynced && windowMs > 0)
+                timeout = chrono::milliseconds(max(1, windowMs / 2));
+            if (!cellReady() && nothingAsked())
+                wake.wait_for(guard, timeout);
+            writerIdle.store(false);
+        }
+        lock_guard<mutex> guard(lock);
+        syncLocked();
+        writtenPos.store(dequeuePos, memory_order_release);
+        syncedPos.store(dequeuePos, memory_order_release);
+    }
+
+public:
+    Journal(string file, JournalConfig cfg, long long firstLsn)
+        : path(file), config(cfg), nextLsn(firstLsn), fileBytes(0), failed(false), pendingSync(0), recordsSinceReset(0),
+          cellMask(0), enqueuePos(0), dequeuePos(0), writtenPos(0), syncedPos(0), writeTarget(0), flushTarget(0),
+          writerIdle(false), stopping(false)
+    {
+        fd = openAppendFile(path, false);
+        error_code ec;
+        fileBytes = filesystem::file_size(path, ec);
+        if (ec)
+            fileBytes = 0;
+        if (!config.asyncWrites)
+            return;
+        size_t capacity = 2;
+        while (capacity < (size_t)max(2, config.queueBatches))
+            capacity *= 2;
+        cells = vector<Cell>(capacity);
+        cellMask = capacity - 1;
+        for (size_t i = 0; i < capacity; i++)
+        {
+            cells[i].sequence.store(i, memory_order_relaxed);
+            // Room for a few records up front, so steady traffic never allocates
+            cells[i].text.reserve(256);
+        }
+        writer = thread(&Journal::writerLoop, this);
+    }
+
+    // Writes and fsyncs everything appended before returning
+    ~Journal()
+    {
+        if (writer.joinable())
+        {
+            stopping.store(true, memory_order_release);
+            wakeWriter();
+            writer.join();
+        }
+        if (fd >= 0)
+        {
+            flush();
+            closeFile(fd);
+        }
+    }
+
+    // Records still queued for the writer are not counted; flush() first
+    long long lastLsn()
+    {
+        lock_guard<mutex> guard(lock);
+        return nextLsn - 1;
+    }
+
+    int getRecordsSinceReset() const { return recordsSinceReset; }
+    uint64_t getBytesWritten() const { return bytesWritten.value(); }
+    uint64_t getQueueFullWaits() const { return queueFullWaits.value(); }
+    const LogHistogram &getSyncLatency() const { return syncLatency; }
+
+    // Logs every record of the batch, in one write. Records from different
+    // calls reach the file in the order the calls were made.
+    void append(const JournalBatch &batch)
+    {
+        if (batch.size() == 0)
+            return;
+        recordsSinceReset += batch.size();
+        if (!config.asyncWrites)
+        {
+            lock_guard<mutex> guard(lock);
+            formatLocked(batch.lines(), batch.size());
+            writeBufferLocked();
+            if (syncDueLocked())
+                syncLocked();
+            return;
+        }
+
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &cells[pos & cellMask];
+            intptr_t turn = (intptr_t)(cell->sequence.load(memory_order_acquire) - pos);
+            if (turn == 0 && enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+            if (turn < 0)
+            {
+                // Full: the disk has fallen a whole ring behind
+                queueFullWaits.add();
+                wakeWriter();
+                this_thread::yield();
+            }
+            if (turn != 0)
+                pos = enqueuePos.load(memory_order_relaxed);
+        }
+        cell->text.assign(batch.lines());
+        cell->records = batch.size();
+        cell->sequence.store(pos + 1, memory_order_release);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (writerIdle.load(memory_order_relaxed))
+            wakeWriter();
+    }
+
+    // Returns once every record appended before the call is on disk; false
+    // if any write or fsync has ever failed, as some records never got there
+    bool flush()
+    {
+        if (!config.asyncWrites || !writer.joinable())
+        {
+            lock_guard<mutex> guard(lock);
+            syncLocked();
+        }
+        else
+            waitForWriter(flushTarget, syncedPos);
+        return !failed.load(memory_order_acquire);
+    }
+
+    // Numbers and writes every record appended so far, without waiting for
+    // an fsync, and fills in where they end. With appends held off, the cut
+    // is exactly the state the caller sees. Returns false, like flush(),
+    // once a write has failed.
+    bool cut(JournalCut &position)
+    {
+        if (config.asyncWrites && writer.joinable())
+            waitForWriter(writeTarget, writtenPos);
+        lock_guard<mutex> guard(lock);
+        position.lsn = nextLsn - 1;
+        position.bytes = fileBytes;
+        position.records = recordsSinceReset;
+        return !failed.load(memory_order_acquire);
+    }
+
+    // Called once a snapshot covering every record up to the cut is on
+    // disk: starts the file over with just the records written since.
+    // Appends keep queueing meanwhile; only the file swap takes the lock.
+    bool dropThrough(const JournalCut &position)
+    {
+        lock_guard<mutex> guard(lock);
+        string tail;
+        if (fileBytes > position.bytes)
+        {
+            ifstream file(path, ios::binary);
+            file.seekg(position.bytes);
+            tail.resize(fileBytes - position.bytes);
+            if (!file.read(&tail[0], tail.size()))
+                return false;
+        }
+        if (!replaceFileDurably(path, {tail}))
+            return false;
+        if (fd >= 0)
+            closeFile(fd);
+        fd = openAppendFile(path, false);
+        fileBytes = tail.size();
+        recordsSinceReset -= position.records;
+        return true;
+    }
+
+    // Called once a snapshot covering every record has been written
+    void reset()
+    {
+        lock_guard<mutex> guard(lock);
+        if (fd >= 0)
+            closeFile(fd);
+        fd = openAppendFile(path, true);
+        fileBytes = 0;
+        pendingSync = 0;
+        recordsSinceReset = 0;
+    }
+};
+
+string formatAmount(double value)
+{
+    ostringstream out;
+    out << setprecision(15) << value;
+    return out.str();
+}
+
+// ==================== Record Parsing ====================
+// Journals and legacy text files are read through one fixed buffer and split
+// in place: fields are string_views into it and numbers go through
+// from_chars, so a line costs no allocation. Malformed lines are reported
+// and skipped rather than aborting startup.
+
+// Reads a file line by line through a buffer; a line stays valid until the
+// next call. Lines longer than the buffer grow it.
+class LineReader
+{
+private:
+    FILE *file;
+    vector<char> buffer;
+    size_t begin, end; // unread bytes in buffer
+    bool atEof;
+    size_t lineNumber;
+    uint64_t offset; // file position after the last line returned
+
+public:
+    explicit LineReader(const string &path, size_t bufferSize = 1 << 20)
+        : file(fopen(path.c_str(), "rb")), buffer(bufferSize), begin(0), end(0), atEof(false), lineNumber(0),
+          offset(0)
+    {
+    }
+
+    LineReader(const LineReader &) = delete;
+    LineReader &operator=(const LineReader &) = delete;
+
+    ~LineReader()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    size_t getLineNumber() const { return lineNumber; }
+    uint64_t getOffset() const { return offset; }
+
+    // Returns false at the end of the file. complete, if given, is false for
+    // a last line without its newline, as a torn write leaves behind.
+    bool next(string_view &line, bool *complete = nullptr)
+    {
+        if (!file)
+            return false;
+        while (true)
+        {
+            const char *start = buffer.data() + begin;
+            const char *newline = (const char *)memchr(start, '\n', end - begin);
+            if (newline || (atEof && begin < end))
+            {
+                size_t length = newline ? newline - start : end - begin;
+                begin += length + (newline ? 1 : 0);
+                offset += length + (newline ? 1 : 0);
+                if (length > 0 && start[length - 1] == '\r')
+                    length--;
+                line = string_view(start, length);
+                if (complete)
+                    *complete = newline != nullptr;
+                lineNumber++;
+                return true;
+            }
+            if (atEof)
+                return false;
+            // Keep the partial line, then refill behind it
+            memmove(buffer.data(), start, end - begin);
+            end -= begin;
+            begin = 0;
+            if (end == buffer.size())
+                buffer.resize(buffer.size() * 2);
+            size_t got = fread(buffer.data() + end, 1, buffer.size() - end, file);
+            end += got;
+            atEof = got == 0;
+        }
+    }
+};
+
+// Splits line at commas into up to maxFields views and returns how many
+// fields the line has, which may be more than maxFields
+size_t splitFields(string_view line, string_view *fields, size_t maxFields)
+{
+    size_t count = 0;
+    while (true)
+    {
+        size_t comma = line.find(',');
+        if (count < maxFields)
+            fields[count] = line.substr(0, comma);
+        count++;
+        if (comma == string_view::npos)
+            return count;
+        line.remove_prefix(comma + 1);
+    }
+}
+
+// The whole field must be the number
+template <class T>
+bool parseField(string_view text, T &value)
+{
+    auto parsed = from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && parsed.ec == errc() && parsed.ptr == text.data() + text.size();
+}
+
+// Counts the malformed lines of one file, printing the first few
+class ParseErrors
+{
+private:
+    string source;
+    size_t reportLimit;
+    size_t count;
+
+public:
+    explicit ParseErrors(string file, size_t limit = 5) : source(file), reportLimit(limit), count(0) {}
+
+    void add(size_t lineNumber, const char *reason)
+    {
+        if (count++ < reportLimit)
+            cerr << "✗ Warning: " << source << " line " << lineNumber << ": " << reason << ", skipped" << endl;
+    }
+
+    size_t getCount() const { return count; }
+
+    // Prints the total once the file is done, if some went unreported
+    void summarize() const
+    {
+        if (count > reportLimit && reportLimit > 0)
+            cerr << "✗ Warning: " << source << ": " << count << " malformed lines skipped" << endl;
+    }
+};
+
+// ==================== Snapshot Files ====================
+struct TicketRecord
+{
+    string vehicleNumber;
+    int slotNumber;
+    int kind; // -1 when the record does not say; the slot decides
+    double hourlyRate;
+    time_t entryTime;
+};
+
+struct PassRecord
+{
+    string vehicleNumber;
+    time_t startDate;
+    time_t expiryDate;
+};
+
+// Legacy text format: one "vehicle,slot,rate,entry" line per ticket.
+// Malformed lines are counted in errors (or reported, if none is given).
+bool readTextTickets(const string &path, vector<TicketRecord> &out, ParseErrors *errors = nullptr)
+{
+    LineReader reader(path);
+    if (!reader.isOpen())
+        return false;
+    ParseErrors ownErrors(path);
+    ParseErrors &skipped = errors ? *errors : ownErrors;
+
+    string_view line, f[4];
+    TicketRecord record;
+    while (reader.next(line))
+    {
+        if (line.empty())
+            continue;
+        if (splitFields(line, f, 4) != 4 || f[0].empty())
+            skipped.add(reader.getLineNumber(), "expected vehicle,slot,rate,entry");
+        else if (!parseField(f[1], record.slotNumber) || record.slotNumber <= 0)
+            skipped.add(reader.getLineNumber(), "bad slot number");
+        else if (!parseField(f[2], record.hourlyRate) || !(record.hourlyRate >= 0))
+            skipped.add(reader.getLineNumber(), "bad rate");
+        else if (!parseField(f[3], record.entryTime) || record.entryTime <= 0)
+            skipped.add(reader.getLineNumber(), "bad entry time");
+        else
+        {
+            record.vehicleNumber.assign(f[0]);
+            // Not from the rate: a type's rate may have changed since
+            record.kind = -1;
+            out.push_back(record);
+        }
+    }
+    skipped.summarize();
+    return true;
+}
+
+// Legacy text format: one "vehicle,passId,start,expiry" line per pass
+bool readTextPasses(const string &path, vector<PassRecord> &out, ParseErrors *errors = nullptr)
+{
+    LineReader reader(path);
+    if (!reader.isOpen())
+        return false;
+    ParseErrors ownErrors(path);
+    ParseErrors &skipped = errors ? *errors : ownErrors;
+
+    string_view line, f[4];
+    PassRecord record;
+    while (reader.next(line))
+    {
+        if (line.empty())
+            continue;
+        if (splitFields(line, f, 4) != 4 || f[0].empty())
+            skipped.add(reader.getLineNumber(), "expected vehicle,passId,start,expiry");
+        else if (!parseField(f[2], record.startDate) || !parseField(f[3], record.expiryDate) ||
+                 record.startDate <= 0 || record.expiryDate <= record.startDate)
+            skipped.add(reader.getLineNumber(), "bad start or expiry date");
+        else
+        {
+            record.vehicleNumber.assign(f[0]);
+            out.push_back(record);
+        }
+    }
+    skipped.summarize();
+    return true;
+}
+
+bool readTextRevenue(const string &path, double &revenue, long long &lsn)
+{
+    ifstream file(path);
+    if (!file.is_open())
+        return false;
+    file >> revenue;
+    if (!(file >> lsn))
+        lsn = 0;
+    return true;
+}
+
+// FNV-1a; pass the previous result as hash to continue over more bytes
+uint64_t checksum64(const char *data, size_t length, uint64_t hash = 1469598103934665603ULL)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Binary snapshot layout (native little-endian, every section 8-byte aligned):
+//   SnapshotHeader | SnapshotTicket[ticketCount] | SnapshotPass[passCount] | plate bytes
+// Records reference plates by offset into the trailing string area, so a
+// mapped file is used in place without any parsing. The checksum covers the
+// header fields before it and the body; version 1 files only covered the body.
+const char SNAPSHOT_MAGIC[8] = {'P', 'K', 'S', 'N', 'A', 'P', '0', '1'};
+const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    int64_t lastLsn;
+    double totalRevenue;
+    uint64_t ticketCount;
+    uint64_t passCount;
+    uint64_t stringBytes;
+    uint64_t checksum;
+};
+
+uint64_t snapshotChecksum(const SnapshotHeader &header, const char *body, size_t bodySize)
+{
+    uint64_t hash = checksum64(body, bodySize);
+    if (header.version == 1)
+        return hash;
+    return checksum64((const char *)&header, offsetof(SnapshotHeader, checksum), hash);
+}
+
+struct SnapshotTicket
+{
+    uint32_t plateOffset;
+    uint32_t plateLength;
+    int32_t slotNumber;
+    int32_t kind;
+    double hourlyRate;
+    int64_t entryTime;
+};
+
+struct SnapshotPass
+{
+    uint32_t plateOffset;
+    uint32_t plateLength;
+    int64_t startDate;
+    int64_t expiryDate;
+};
+
+// Read-only view of a whole file: mmap where available, a plain read otherwise
+class MappedFile
+{
+private:
+    const char *data;
+    size_t length;
+#ifdef _WIN32
+    vector<char> buffer;
+#endif
+
+public:
+    MappedFile() : data(nullptr), length(0) {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data && length > 0)
+            munmap((void *)data, length);
+#endif
+    }
+
+    bool open(const string &path)
+    {
+#ifdef _WIN32
+        ifstream file(path, ios::binary);
+        if (!file.is_open())
+            return false;
+        buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = buffer.data();
+        length = buffer.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            closeFile(fd);
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0)
+        {
+            void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = (mapped == MAP_FAILED) ? nullptr : (const char *)mapped;
+        }
+        closeFile(fd);
+        return length == 0 || data != nullptr;
+#endif
+    }
+
+    const char *begin() const { return data; }
+    size_t size() const { return length; }
+};
+
+class SnapshotWriter
+{
+private:
+    vector<SnapshotTicket> tickets;
+    vector<SnapshotPass> passes;
+    string plates;
+
+    void addPlate(const string &plate, uint32_t &offset, uint32_t &length)
+    {
+        offset = (uint32_t)plates.size();
+        length = (uint32_t)plate.size();
+        plates += plate;
+    }
+
+public:
+    void addTicket(const string &plate, int slotNumber, int kind, double rate, time_t entry)
+    {
+        SnapshotTicket t;
+        addPlate(plate, t.plateOffset, t.plateLength);
+        t.slotNumber = slotNumber;
+        t.kind = kind;
+        t.hourlyRate = rate;
+        t.entryTime = entry;
+        tickets.push_back(t);
+    }
+
+    void addPass(const string &plate, time_t start, time_t expiry)
+    {
+        SnapshotPass p;
+        addPlate(plate, p.plateOffset, p.plateLength);
+        p.startDate = start;
+        p.expiryDate = expiry;
+        passes.push_back(p);
+    }
+
+    // Writes to a temporary file, syncs it and renames it over the old snapshot
+    bool write(const string &path, double revenue, long long lsn)
+    {
+        while (plates.size() % 8 != 0)
+            plates += '\0';
+
+        string body;
+        body.append((const char *)tickets.data(), tickets.size() * sizeof(SnapshotTicket));
+        body.append((const char *)passes.data(), passes.size() * sizeof(SnapshotPass));
+        body.append(plates);
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.headerSize = sizeof(SnapshotHeader);
+        header.lastLsn = lsn;
+        header.totalRevenue = revenue;
+        header.ticketCount = tickets.size();
+        header.passCount = passes.size();
+        header.stringBytes = plates.size();
+        header.checksum = snapshotChecksum(header, body.data(), body.size());
+        return replaceFileDurably(path, {string_view((const char *)&header, sizeof(header)), body});
+    }
+};
+
+class SnapshotReader
+{
+private:
+    MappedFile file;
+    const SnapshotHeader *header;
+    const SnapshotTicket *tickets;
+    const SnapshotPass *passes;
+    const char *plates;
+
+public:
+    SnapshotReader() : header(nullptr), tickets(nullptr), passes(nullptr), plates(nullptr) {}
+
+    // Maps the file and validates magic, version, sizes and checksum
+    bool open(const string &path, string &error)
+    {
+        if (!file.open(path))
+        {
+            error = "cannot open " + path;
+            return false;
+        }
+        if (file.size() < sizeof(SnapshotHeader))
+        {
+            error = "file is truncated";
+            return false;
+        }
+        header = (const SnapshotHeader *)file.begin();
+        if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+        {
+            error = "not a parking snapshot";
+            return false;
+        }
+        if ((header->version != 1 && header->version != SNAPSHOT_VERSION) ||
+            header->headerSize != sizeof(SnapshotHeader))
+        {
+            error = "unsupported snapshot version " + to_string(header->version);
+            return false;
+        }
+        // Each count is bounded by the file before it is multiplied, so a
+        // damaged count cannot wrap around to a plausible size
+        uint64_t bodySize = file.size() - sizeof(SnapshotHeader);
+        if (header->ticketCount > bodySize / sizeof(SnapshotTicket) ||
+            header->passCount > (bodySize - header->ticketCount * sizeof(SnapshotTicket)) / sizeof(SnapshotPass) ||
+            bodySize - header->ticketCount * sizeof(SnapshotTicket) - header->passCount * sizeof(SnapshotPass) !=
+                header->stringBytes)
+        {
+            error = "file size does not match its header";
+            return false;
+        }
+        const char *body = file.begin() + sizeof(SnapshotHeader);
+        if (snapshotChecksum(*header, body, bodySize) != header->checksum)
+        {
+            error = "checksum mismatch";
+            return false;
+        }
+        tickets = (const SnapshotTicket *)body;
+        passes = (const SnapshotPass *)(body + header->ticketCount * sizeof(SnapshotTicket));
+        plates = (const char *)(passes + header->passCount);
+        for (size_t i = 0; i < header->ticketCount; i++)
+        {
+            if ((uint64_t)tickets[i].plateOffset + tickets[i].plateLength > header->stringBytes)
+            {
+                error = "ticket plate out of range";
+                return false;
+            }
+        }
+        for (size_t i = 0; i < header->passCount; i++)
+        {
+            if ((uint64_t)passes[i].plateOffset + passes[i].plateLength > header->stringBytes)
+            {
+                error = "pass plate out of range";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    long long lastLsn() const { return header->lastLsn; }
+    double totalRevenue() const { return header->totalRevenue; }
+    size_t ticketCount() const { return header->ticketCount; }
+    size_t passCount() const { return header->passCount; }
+    const SnapshotTicket &ticket(size_t i) const { return tickets[i]; }
+    const SnapshotPass &pass(size_t i) const { return passes[i]; }
+
+    string_view plate(uint32_t offset, uint32_t length) const
+    {
+        return string_view(plates + offset, length);
+    }
+};
+
+// Builds parking_snapshot.bin from the legacy parking_tickets.txt,
+// monthly_passes.txt and revenue.txt found in dir
+bool convertTextSnapshot(const string &dir, string &report)
+{
+    string prefix = dir.empty() ? "" : dir + "/";
+    vector<TicketRecord> tickets;
+    vector<PassRecord> passes;
+    double revenue = 0.0;
+    long long lsn = 0;
+    bool found = readTextTickets(prefix + "parking_tickets.txt", tickets);
+    found = readTextPasses(prefix + "monthly_passes.txt", passes) || found;
+    found = readTextRevenue(prefix + "revenue.txt", revenue, lsn) || found;
+    if (!found)
+    {
+        report = "no text data files found";
+        return false;
+    }
+
+    SnapshotWriter writer;
+    for (auto &t : tickets)
+        writer.addTicket(t.vehicleNumber, t.slotNumber, t.kind, t.hourlyRate, t.entryTime);
+    for (auto &p : passes)
+        writer.addPass(p.vehicleNumber, p.startDate, p.expiryDate);
+    if (!writer.write(prefix + "parking_snapshot.bin", revenue, lsn))
+    {
+        report = "could not write " + prefix + "parking_snapshot.bin";
+        return false;
+    }
+    report = to_string(tickets.size()) + " tickets, " + to_string(passes.size()) +
+             " passes, revenue " + formatAmount(revenue);
+    return true;
+}
+
+// ==================== Tariffs ====================
+// Minutes count from Sunday 00:00 local time, like tm_wday
+const int DAY_MINUTES = 24 * 60;
+const int WEEK_MINUTES = 7 * DAY_MINUTES;
+
+// A price band: stays pay the base rate times multiplier while inside it
+struct TariffPeriod
+{
+    uint8_t days = 0x7f;     // bit 0 = Sunday ... bit 6 = Saturday
+    int fromMinute = 0;      // minute of the day, inclusive
+    int toMinute = DAY_MINUTES; // exclusive; at or before fromMinute runs past midnight
+    double multiplier = 1.0;
+    int kind = -1;           // -1 = every vehicle type
+};
+
+// What an operator writes down. Stays are billed per started minute, each
+// minute at the rate in force then; the cap limits each 24 hours counted
+// from entry.
+struct TariffRules
+{
+    string name = "standard";
+    double hourlyRate[KIND_COUNT];
+    vector<TariffPeriod> periods;          // later periods override earlier ones
+    double dailyCap[KIND_COUNT] = {};      // 0 = no cap
+    int graceMinutes[KIND_COUNT] = {};     // stays up to this long are free
+    int minimumMinutes[KIND_COUNT];        // shorter stays are billed as this long
+    int utcOffsetMinutes = 0;              // the site's local time
+
+    TariffRules()
+    {
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            hourlyRate[k] = VEHICLE_KIND_RATES[k];
+            minimumMinutes[k] = 60;
+        }
+    }
+};
+
+// Parses "Mon-Fri", "Sat,Sun" or "all" into a TariffPeriod day mask
+bool parseTariffDays(const string &text, uint8_t &mask)
+{
+    static const char *names[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    auto dayIndex = [&](const string &day) {
+        for (int d = 0; d < 7; d++)
+        {
+            if (day == names[d])
+                return d;
+        }
+        return -1;
+    };
+    if (text == "all")
+    {
+        mask = 0x7f;
+        return true;
+    }
+    mask = 0;
+    stringstream ss(text);
+    string part;
+    while (getline(ss, part, ','))
+    {
+        size_t dash = part.find('-');
+        int from = dayIndex(part.substr(0, dash));
+        int to = dash == string::npos ? from : dayIndex(part.substr(dash + 1));
+        if (from < 0 || to < 0)
+            return false;
+        for (int d = from;; d = (d + 1) % 7)
+        {
+            mask |= (uint8_t)(1 << d);
+            if (d == to)
+                break;
+        }
+    }
+    return mask != 0;
+}
+
+// Reads a tariff file, one rule per line ('#' starts a comment):
+//   name weekday-peak
+//   rate [Type] 25             base ₹/hour
+//   period Mon-Fri 08:00-18:00 1.5 [Type]
+//   cap [Type] 200             most charged per 24 hours
+//   grace [Type] 10            free minutes
+//   minimum [Type] 60          shortest billed stay, in minutes
+//   utc-offset 330             local time, minutes east of UTC
+// A rule without a type applies to every type. Returns false with the line
+// in error on the first bad rule.
+bool readTariffRules(istream &in, TariffRules &rules, string &error)
+{
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        stringstream ss(line);
+        vector<string> words;
+        string word;
+        while (ss >> word)
+            words.push_back(word);
+        if (words.empty())
+            continue;
+
+        // The optional type before a per-type value
+        int kind = -1;
+        bool ok = true;
+        auto typed = [&]() -> string {
+            if (words.size() == 3)
+            {
+                kind = vehicleKindFromName(words[1]);
+                ok = kind >= 0;
+                return words[2];
+            }
+            ok = words.size() == 2;
+            return ok ? words[1] : "0";
+        };
+        auto forKinds = [&](auto apply) {
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                if (kind < 0 || kind == k)
+                    apply(k);
+            }
+        };
+        try
+        {
+            const string &key = words[0];
+            if (key == "name" && words.size() == 2)
+                rules.name = words[1];
+            else if (key == "rate" || key == "cap")
+            {
+                double value = stod(typed());
+                ok = ok && value >= 0;
+                if (ok)
+                    forKinds([&](int k) { (key == "rate" ? rules.hourlyRate : rules.dailyCap)[k] = value; });
+            }
+            else if (key == "grace" || key == "minimum")
+            {
+                int value = stoi(typed());
+                ok = ok && value >= 0;
+                if (ok)
+                    forKinds([&](int k) { (key == "grace" ? rules.graceMinutes : rules.minimumMinutes)[k] = value; });
+            }
+            else if (key == "utc-offset" && words.size() == 2)
+                rules.utcOffsetMinutes = stoi(words[1]);
+            else if (key == "period" && (words.size() == 4 || words.size() == 5))
+            {
+                TariffPeriod period;
+                int fromH, fromM, toH, toM;
+                char sep;
+                stringstream window(words[2]);
+                ok = parseTariffDays(words[1], period.days) &&
+                     (window >> fromH >> sep >> fromM >> sep >> toH >> sep >> toM) && fromH >= 0 && fromH <= 24 &&
+                     toH >= 0 && toH <= 24 && fromM >= 0 && fromM < 60 && toM >= 0 && toM < 60;
+                period.fromMinute = fromH * 60 + fromM;
+                period.toMinute = toH * 60 + toM;
+                period.multiplier = stod(words[3]);
+                period.kind = words.size() == 5 ? vehicleKindFromName(words[4]) : -1;
+                ok = ok && period.fromMinute <= DAY_MINUTES && period.toMinute <= DAY_MINUTES &&
+                     period.multiplier >= 0 && (words.size() == 4 || period.kind >= 0);
+                if (ok)
+                    rules.periods.push_back(period);
+            }
+            else
+                ok = false;
+        }
+        catch (const exception &)
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            error = "line " + to_string(lineNumber) + ": " + line;
+            return false;
+        }
+    }
+    return true;
+}
+
+// TariffRules compiled into per-type tables, so a fee costs a few lookups
+// however many periods the rules have. cumulative[k][m] is what the minutes
+// of the week before m cost; capped[k] chains the capped fee of each 24 hours
+// starting at a minute through the week, so whole days sum in one step too.
+class CompiledTariff
+{
+private:
+    TariffRules rules;
+    vector<double> cumulative[KIND_COUNT]; // WEEK_MINUTES + 1 entries
+    // capped[m] = min(cap, day starting at minute m % week) + capped[m - day];
+    // twice the week long so any seven days in a row are one subtraction
+    vector<double> capped[KIND_COUNT];
+
+    // Fee for count minutes from minute-of-week start, uncapped
+    double span(int kind, int start, long long count) const
+    {
+        const vector<double> &c = cumulative[kind];
+        long long weeks = count / WEEK_MINUTES;
+        int end = start + (int)(count % WEEK_MINUTES);
+        double fee = weeks * c[WEEK_MINUTES];
+        return end <= WEEK_MINUTES ? fee + c[end] - c[start]
+                                   : fee + c[WEEK_MINUTES] - c[start] + c[end - WEEK_MINUTES];
+    }
+
+    // Capped fee of days whole days from minute-of-week start, days < 7
+    double cappedDays(int kind, int start, int days) const
+    {
+        if (days == 0)
+            return 0.0;
+        const vector<double> &c = capped[kind];
+        return c[start + (days - 1) * DAY_MINUTES] - (start >= DAY_MINUTES ? c[start - DAY_MINUTES] : 0.0);
+    }
+
+public:
+    explicit CompiledTariff(const TariffRules &tariffRules) : rules(tariffRules)
+    {
+        vector<double> perMinute(WEEK_MINUTES);
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            double base = rules.hourlyRate[k] / 60.0;
+            fill(perMinute.begin(), perMinute.end(), base);
+            for (const TariffPeriod &period : rules.periods)
+            {
+                if (period.kind >= 0 && period.kind != k)
+                    continue;
+                int length = (period.toMinute - period.fromMinute + DAY_MINUTES - 1) % DAY_MINUTES + 1;
+                for (int d = 0; d < 7; d++)
+                {
+                    if (!(period.days & (1 << d)))
+                        continue;
+                    for (int i = 0; i < length; i++)
+                        perMinute[(d * DAY_MINUTES + period.fromMinute + i) % WEEK_MINUTES] = base * period.multiplier;
+                }
+            }
+
+            cumulative[k].assign(WEEK_MINUTES + 1, 0.0);
+            for (int m = 0; m < WEEK_MINUTES; m++)
+                cumulative[k][m + 1] = cumulative[k][m] + perMinute[m];
+
+            if (rules.dailyCap[k] <= 0)
+                continue;
+            capped[k].assign(2 * WEEK_MINUTES, 0.0);
+            for (int m = 0; m < 2 * WEEK_MINUTES; m++)
+            {
+                double day = min(rules.dailyCap[k], span(k, m % WEEK_MINUTES, DAY_MINUTES));
+                capped[k][m] = day + (m >= DAY_MINUTES ? capped[k][m - DAY_MINUTES] : 0.0);
+            }
+        }
+    }
+
+    const TariffRules &getRules() const { return rules; }
+    const string &getName() const { return rules.name; }
+    double hourlyRate(int kind) const { return rules.hourlyRate[kind]; }
+
+    // Minute of the site's week a stay entering at entry starts in
+    int weekMinute(time_t entry) const
+    {
+        // 1970-01-01 was a Thursday, four days after a Sunday
+        long long local = (long long)entry + rules.utcOffsetMinutes * 60LL + 4LL * 86400;
+        long long minuteOfEpoch = local >= 0 ? local / 60 : (local - 59) / 60;
+        return (int)(((minuteOfEpoch % WEEK_MINUTES) + WEEK_MINUTES) % WEEK_MINUTES);
+    }
+
+    // Fee in rupees, rounded to the paisa, for a stay of the given kind;
+    // billedHours, if given, gets the duration charged for
+    double fee(int kind, time_t entry, time_t exit, double *billedHours = nullptr) const
+    {
+        return fee(kind, entry, weekMinute(entry), exit, billedHours);
+    }
+
+    // The same, with weekMinute(entry) worked out when the vehicle came in
+    double fee(int kind, time_t entry, int start, time_t exit, double *billedHours) const
+    {
+        long long seconds = max<long long>(0, (long long)exit - entry);
+        if (billedHours)
+            *billedHours = seconds / 3600.0;
+        if (rules.graceMinutes[kind] > 0 && seconds <= rules.graceMinutes[kind] * 60LL)
+            return 0.0;
+        long long minutes = max<long long>((seconds + 59) / 60, rules.minimumMinutes[kind]);
+        if (billedHours)
+            *billedHours = max(*billedHours, minutes / 60.0);
+
+        double amount;
+        if (capped[kind].empty())
+            amount = span(kind, start, minutes);
+        else
+        {
+            long long days = minutes / DAY_MINUTES;
+            int lastDay = (int)((start + days * DAY_MINUTES) % WEEK_MINUTES);
+            amount = (days / 7) * cappedDays(kind, start, 7) + cappedDays(kind, start, (int)(days % 7)) +
+                     min(rules.dailyCap[kind], span(kind, lastDay, minutes % DAY_MINUTES));
+        }
+        return round(amount * 100.0) / 100.0;
+    }
+};
+
+// ==================== Reservations ====================
+// Bookings hold capacity of a vehicle type, not a particular slot: a booked
+// vehicle parks wherever the allocator puts it, and walk-ins are turned
+// away rather than take the last slots a booking due soon will need.
+struct ReservationConfig
+{
+    int bucketMinutes = 15;     // timeline resolution; windows are rounded out to it
+    int horizonDays = 90;       // how far ahead bookings are taken
+    double bookableShare = 0.5; // share of each type's slots that may be booked at any moment
+    int holdAheadMinutes = 30;  // walk-ins leave room for bookings starting this soon
+};
+
+// Bookings of one vehicle type per time bucket from an origin, as a segment
+// tree with range add and range max: booking and "how many are booked at the
+// busiest moment of [start, end)" are both O(log buckets)
+class CapacityTimeline
+{
+private:
+    time_t origin;
+    int bucketSeconds;
+    int buckets;
+    vector<int> peakOf; // per node, busiest bucket below it, including addOf
+    vector<int> addOf;  // per node, bookings covering its whole range
+
+    void add(int node, int lo, int hi, int from, int to, int delta)
+    {
+        if (to <= lo || hi <= from)
+            return;
+        if (from <= lo && hi <= to)
+        {
+            addOf[node] += delta;
+            peakOf[node] += delta;
+            return;
+        }
+        int mid = (lo + hi) / 2;
+        add(2 * node, lo, mid, from, to, delta);
+        add(2 * node + 1, mid, hi, from, to, delta);
+        peakOf[node] = addOf[node] + max(peakOf[2 * node], peakOf[2 * node + 1]);
+    }
+
+    // Counts are never negative, so 0 stands in for an empty range
+    int peak(int node, int lo, int hi, int from, int to) const
+    {
+        if (to <= lo || hi <= from)
+            return 0;
+        if (from <= lo && hi <= to)
+            return peakOf[node];
+        int mid = (lo + hi) / 2;
+        return addOf[node] + max(peak(2 * node, lo, mid, from, to), peak(2 * node + 1, mid, hi, from, to));
+    }
+
+    // Bucket range covering [start, end), clipped to the timeline
+    pair<int, int> bucketsOf(time_t start, time_t end) const
+    {
+        long long from = (start - origin) / bucketSeconds;
+        long long to = (end - origin + bucketSeconds - 1) / bucketSeconds;
+        return {(int)max(0LL, min(from, (long long)buckets)), (int)max(0LL, min(to, (long long)buckets))};
+    }
+
+public:
+    CapacityTimeline(time_t start = 0, int bucketSecs = 900, int bucketCount = 0)
+        : origin(start - start % bucketSecs), bucketSeconds(bucketSecs), buckets(bucketCount),
+          peakOf(4 * max(1, bucketCount), 0), addOf(4 * max(1, bucketCount), 0)
+    {
+    }
+
+    time_t getEnd() const { return origin + (time_t)buckets * bucketSeconds; }
+
+    void add(time_t start, time_t end, int delta)
+    {
+        pair<int, int> range = bucketsOf(start, end);
+        if (range.first < range.second)
+            add(1, 0, buckets, range.first, range.second, delta);
+    }
+
+    int peak(time_t start, time_t end) const
+    {
+        pair<int, int> range = bucketsOf(start, end);
+        return range.first < range.second ? peak(1, 0, buckets, range.first, range.second) : 0;
+    }
+};
+
+struct Reservation
+{
+    long long id;
+    string vehicleNumber;
+    int kind;
+    time_t start;
+    time_t end;
+    bool arrived; // parked under this booking and not yet gone
+};
+
+// Live bookings and their timelines, behind one lock; callers check
+// empty() first so walk-ins skip the lock while nothing is booked. A
+// booking lives until its vehicle leaves, it is cancelled, or its window
+// ends. The timelines cover two horizons from an origin that moves on once
+// a horizon has passed, and are only allocated with the first booking.
+class ReservationBook
+{
+private:
+    ReservationConfig config;
+    array<int, KIND_COUNT> bookable;
+    mutable mutex lock;
+    unordered_map<long long, Reservation> byId;
+    unordered_map<string, long long> byPlate;
+    vector<CapacityTimeline> timelines; // per kind
+    vector<CapacityTimeline> waiting;   // per kind, bookings not yet parked
+    typedef pair<time_t, long long> EndEntry;
+    priority_queue<EndEntry, vector<EndEntry>, greater<EndEntry>> byEnd;
+    long long nextId = 1;
+    atomic<size_t> live{0};
+
+    time_t horizonSeconds() const { return (time_t)config.horizonDays * 24 * 60 * 60; }
+
+    // Starts the timelines over from now's bucket when now has moved a
+    // horizon past their origin (or there are none yet)
+    void rebase(time_t now)
+    {
+        if (!timelines.empty() && now + horizonSeconds() <= timelines[0].getEnd())
+            return;
+        int bucketSeconds = config.bucketMinutes * 60;
+        int buckets = (int)(2 * horizonSeconds() / bucketSeconds);
+        timelines.assign(KIND_COUNT, CapacityTimeline(now, bucketSeconds, buckets));
+        waiting.assign(KIND_COUNT, CapacityTimeline(now, bucketSeconds, buckets));
+        for (auto &entry : byId)
+        {
+            timelines[entry.second.kind].add(entry.second.start, entry.second.end, 1);
+            if (!entry.second.arrived)
+                waiting[entry.second.kind].add(entry.second.start, entry.second.end, 1);
+        }
+    }
+
+    void erase(unordered_map<long long, Reservation>::iterator it)
+    {
+        Reservation &booking = it->second;
+        timelines[booking.kind].add(booking.start, booking.end, -1);
+        if (!booking.arrived)
+            waiting[booking.kind].add(booking.start, booking.end, -1);
+        byPlate.erase(booking.vehicleNumber);
+        byId.erase(it);
+        live.store(byId.size(), memory_order_relaxed);
+    }
+
+    void insert(const Reservation &booking)
+    {
+        byId[booking.id] = booking;
+        byPlate[booking.vehicleNumber] = booking.id;
+        byEnd.push({booking.end, booking.id});
+        timelines[booking.kind].add(booking.start, booking.end, 1);
+        if (!booking.arrived)
+            waiting[booking.kind].add(booking.start, booking.end, 1);
+        nextId = max(nextId, booking.id + 1);
+        live.store(byId.size(), memory_order_relaxed);
+    }
+
+    // Forgets bookings whose window has ended
+    void sweep(time_t now)
+    {
+        while (!byEnd.empty() && byEnd.top().first <= now)
+        {
+            auto it = byId.find(byEnd.top().second);
+            if (it != byId.end() && it->second.end == byEnd.top().first)
+                erase(it);
+            byEnd.pop();
+        }
+    }
+
+public:
+    ReservationBook(const ReservationConfig &cfg, const array<int, KIND_COUNT> &capacity) : config(cfg)
+    {
+        for (int k = 0; k < KIND_COUNT; k++)
+            bookable[k] = (int)(capacity[k] * config.bookableShare);
+    }
+
+    bool empty() const { return live.load(memory_order_relaxed) == 0; }
+    size_t size() const { return live.load(memory_order_relaxed); }
+
+    // Bookings of this type that [start, end) could still take
+    int available(int kind, time_t start, time_t end, time_t now)
+    {
+        lock_guard<mutex> guard(lock);
+        sweep(now);
+        rebase(now);
+        return bookable[kind] - timelines[kind].peak(start, end);
+    }
+
+    // Returns the booking's id, or 0 with error set
+    long long book(const string &vehicleNum, int kind, time_t start, time_t end, time_t now, string &error)
+    {
+        lock_guard<mutex> guard(lock);
+        sweep(now);
+        rebase(now);
+        if (vehicleNum.empty() || start >= end || end <= now)
+            error = "the window must end after it starts, in the future";
+        else if (end > now + horizonSeconds())
+            error = "the window ends more than " + to_string(config.horizonDays) + " days ahead";
+        else if (byPlate.count(vehicleNum))
+            error = "the vehicle already has a booking";
+        else if (timelines[kind].peak(start, end) >= bookable[kind])
+            error = string("no ") + VEHICLE_KIND_NAMES[kind] + " capacity left in that window";
+        else
+        {
+            insert(Reservation{nextId, vehicleNum, kind, start, end, false});
+            return nextId - 1;
+        }
+        return 0;
+    }
+
+    // Re-adds a journaled or saved booking without checking capacity;
+    // returns false if it is already there or its window has ended
+    bool restore(const Reservation &booking, time_t now)
+    {
+        lock_guard<mutex> guard(lock);
+        sweep(now);
+        // Ids stay unique even when an ended booking is left out
+        nextId = max(nextId, booking.id + 1);
+        if (booking.end <= now || byId.count(booking.id) || byPlate.count(booking.vehicleNumber))
+            return false;
+        rebase(now);
+        insert(booking);
+        return true;
+    }
+
+    bool cancel(long long id)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = byId.find(id);
+        if (it == byId.end())
+            return false;
+        erase(it);
+        return true;
+    }
+
+    // Marks the vehicle's booking as used if it is for this type and its
+    // window (opened holdAheadMinutes early) is on at time t
+    bool arrive(const string &vehicleNum, int kind, time_t t)
+    {
+        lock_guard<mutex> guard(lock);
+        auto plate = byPlate.find(vehicleNum);
+        if (plate == byPlate.end())
+            return false;
+        Reservation &booking = byId[plate->second];
+        if (booking.arrived || booking.kind != kind || t < booking.start - config.holdAheadMinutes * 60 ||
+            t >= booking.end)
+            return false;
+        booking.arrived = true;
+        waiting[kind].add(booking.start, booking.end, -1);
+        return true;
+    }
+
+    // A vehicle that parked under its booking has left; the rest of the
+    // window is released
+    void depart(const string &vehicleNum)
+    {
+        lock_guard<mutex> guard(lock);
+        auto plate = byPlate.find(vehicleNum);
+        if (plate == byPlate.end())
+            return;
+        auto it = byId.find(plate->second);
+        if (it->second.arrived)
+            erase(it);
+    }
+
+    // Free slots of this type walk-ins must leave alone now: the busiest
+    // moment over the next holdAheadMinutes of bookings whose vehicle has
+    // not parked yet (those parked already hold a slot of their own)
+    int held(int kind, time_t now)
+    {
+        lock_guard<mutex> guard(lock);
+        sweep(now);
+        rebase(now);
+        return waiting[kind].peak(now, now + config.holdAheadMinutes * 60);
+    }
+
+    void forEach(const function<void(const Reservation &)> &visit) const
+    {
+        lock_guard<mutex> guard(lock);
+        for (auto &entry : byId)
+        {
+            visit(entry.second);
+        }
+    }
+};
+
+// ==================== Parking Configuration ====================
+class PassDirectory;
+
+struct ParkingConfig
+{
+    array<int, KIND_COUNT> slotsPerFloor = DEFAULT_SLOTS_PER_FLOOR; // indexed by VehicleKind
+    string dataDir = ""; // snapshot and journal location, empty = working directory
+    JournalConfig journal;
+    const Clock *clock = nullptr; // must outlive the system; nullptr = system clock
+    string metricsFile = "";      // Prometheus text file rewritten on compaction and exit, empty = off
+    PassDirectory *passDirectory = nullptr; // passes shared with other sites; must outlive the system
+    TariffRules tariff;                     // replaced by parking_tariff.txt in dataDir when present
+    AllocationPolicy allocation = ALLOCATE_LOWEST; // how entry picks a slot
+    SlotDistance slotDistance;                     // ranks slots for ALLOCATE_NEAREST, empty = drive order
+    ReservationConfig reservations;
+    int forecastWindowMinutes = 15;                // time over which arrival and departure rates roll
+
+    int slotsPerFloorTotal() const { return totalSlots(slotsPerFloor); }
+};
+
+// ==================== Plate Interning ====================
+typedef uint32_t PlateId;
+const PlateId NO_PLATE = 0;
+
+// Gives every plate string seen a small, stable id (1, 2, 3, ...) so the
+// ticket and pass tables hash and compare integers. The table is split into
+// independently locked shards; ids and their strings are never retired, which
+// a garage's plate population easily affords.
+class PlateInterner
+{
+private:
+    static const int SHARD_COUNT = 64;
+    static const int CHUNK_BITS = 12;
+    static const int MAX_CHUNKS = 1 << 14;
+
+    // Open addressing; a slot holds an id (NO_PLATE = empty) and the low hash
+    // bits of its plate, so probing compares strings only on a likely match
+    struct Shard
+    {
+        mutable shared_mutex lock;
+        vector<PlateId> ids;
+        vector<uint32_t> hashBits;
+        size_t count = 0;
+    };
+    Shard shards[SHARD_COUNT];
+    atomic<PlateId> nextId;
+    // Plate strings by id, in fixed chunks that never move once published
+    mutex chunkLock;
+    unique_ptr<atomic<string *>[]> chunks;
+
+    static uint64_t hashOf(string_view plate) { return hash<string_view>()(plate); }
+    Shard &shardFor(uint64_t h) { return shards[(h >> 32) % SHARD_COUNT]; }
+    const Shard &shardFor(uint64_t h) const { return shards[(h >> 32) % SHARD_COUNT]; }
+
+    // Position of the plate, or of the empty slot where it belongs
+    size_t probe(const Shard &shard, string_view plate, uint32_t bits) const
+    {
+        size_t mask = shard.ids.size() - 1;
+        for (size_t i = bits & mask;; i = (i + 1) & mask)
+        {
+            PlateId id = shard.ids[i];
+            if (id == NO_PLATE || (shard.hashBits[i] == bits && name(id) == plate))
+                return i;
+        }
+    }
+
+    void grow(Shard &shard, size_t capacity)
+    {
+        vector<PlateId> oldIds;
+        vector<uint32_t> oldBits;
+        oldIds.swap(shard.ids);
+        oldBits.swap(shard.hashBits);
+        shard.ids.assign(capacity, NO_PLATE);
+        shard.hashBits.assign(capacity, 0);
+        for (size_t i = 0; i < oldIds.size(); i++)
+        {
+            if (oldIds[i] == NO_PLATE)
+                continue;
+            size_t j = oldBits[i] & (capacity - 1);
+            while (shard.ids[j] != NO_PLATE)
+                j = (j + 1) & (capacity - 1);
+            shard.ids[j] = oldIds[i];
+            shard.hashBits[j] = oldBits[i];
+        }
+    }
+
+    // Finds or adds the plate; the caller holds the shard's lock exclusively
+    PlateId internLocked(Shard &shard, string_view plate, uint64_t h)
+    {
+        if ((shard.count + 1) * 4 > shard.ids.size() * 3)
+            grow(shard, shard.ids.empty() ? 64 : shard.ids.size() * 2);
+        size_t i = probe(shard, plate, (uint32_t)h);
+        if (shard.ids[i] != NO_PLATE)
+            return shard.ids[i];
+        PlateId id = nextId.fetch_add(1);
+        storageFor(id).assign(plate.data(), plate.size());
+        shard.ids[i] = id;
+        shard.hashBits[i] = (uint32_t)h;
+        shard.count++;
+        return id;
+    }
+
+    string &storageFor(PlateId id)
+    {
+        atomic<string *> &chunk = chunks[id >> CHUNK_BITS];
+        if (!chunk.load(memory_order_acquire))
+        {
+            lock_guard<mutex> guard(chunkLock);
+            if (!chunk.load(memory_order_relaxed))
+                chunk.store(new string[size_t(1) << CHUNK_BITS], memory_order_release);
+        }
+        return chunk.load(memory_order_acquire)[id & ((1 << CHUNK_BITS) - 1)];
+    }
+
+public:
+    PlateInterner() : nextId(1), chunks(new atomic<string *>[MAX_CHUNKS])
+    {
+        for (int c = 0; c < MAX_CHUNKS; c++)
+        {
+            chunks[c] = nullptr;
+        }
+    }
+
+    ~PlateInterner()
+    {
+        for (int c = 0; c < MAX_CHUNKS; c++)
+        {
+            delete[] chunks[c].load();
+        }
+    }
+
+    PlateInterner(const PlateInterner &) = delete;
+    PlateInterner &operator=(const PlateInterner &) = delete;
+
+    // NO_PLATE if the plate has never been interned
+    PlateId find(string_view plate) const
+    {
+        uint64_t h = hashOf(plate);
+        const Shard &shard = shardFor(h);
+        shared_lock<shared_mutex> guard(shard.lock);
+        if (shard.ids.empty())
+            return NO_PLATE;
+        return shard.ids[probe(shard, plate, (uint32_t)h)];
+    }
+
+    PlateId intern(string_view plate)
+    {
+        PlateId existing = find(plate);
+        if (existing != NO_PLATE)
+            return existing;
+
+        uint64_t h = hashOf(plate);
+        Shard &shard = shardFor(h);
+        unique_lock<shared_mutex> guard(shard.lock);
+        return internLocked(shard, plate, h);
+    }
+
+    // Interns a run of plates, e.g. a snapshot's, into ids (in the same
+    // order). Plates are hashed once and taken a shard at a time, one lock
+    // each, so every shard's slots stay in cache while it fills.
+    void internAll(const vector<string_view> &plateNums, vector<PlateId> &ids)
+    {
+        ids.assign(plateNums.size(), NO_PLATE);
+        vector<uint64_t> hashes(plateNums.size());
+        vector<uint32_t> order(plateNums.size());
+        size_t starts[SHARD_COUNT + 1] = {};
+        for (size_t i = 0; i < plateNums.size(); i++)
+        {
+            hashes[i] = hashOf(plateNums[i]);
+            starts[(hashes[i] >> 32) % SHARD_COUNT + 1]++;
+        }
+        for (int s = 0; s < SHARD_COUNT; s++)
+            starts[s + 1] += starts[s];
+        size_t next[SHARD_COUNT];
+        copy(starts, starts + SHARD_COUNT, next);
+        for (size_t i = 0; i < plateNums.size(); i++)
+            order[next[(hashes[i] >> 32) % SHARD_COUNT]++] = (uint32_t)i;
+
+        for (int s = 0; s < SHARD_COUNT; s++)
+        {
+            Shard &shard = shards[s];
+            unique_lock<shared_mutex> guard(shard.lock);
+            for (size_t k = starts[s]; k < starts[s + 1]; k++)
+                ids[order[k]] = internLocked(shard, plateNums[order[k]], hashes[order[k]]);
+        }
+    }
+
+    // Sizes every shard for count more plates, so interning them never
+    // stops to rehash
+    void reserve(size_t count)
+    {
+        for (auto &shard : shards)
+        {
+            unique_lock<shared_mutex> guard(shard.lock);
+            size_t capacity = max<size_t>(shard.ids.size(), 64);
+            // An eighth more than an even share, for shards that draw more
+            while ((shard.count + count / SHARD_COUNT + count / SHARD_COUNT / 8 + 1) * 4 > capacity * 3)
+                capacity *= 2;
+            if (capacity > shard.ids.size())
+                grow(shard, capacity);
+        }
+    }
+
+    // Only valid for an id returned by find or intern
+    const string &name(PlateId id) const
+    {
+        return chunks[id >> CHUNK_BITS].load(memory_order_acquire)[id & ((1 << CHUNK_BITS) - 1)];
+    }
+
+    size_t size() const { return nextId.load() - 1; }
+};
+
+// ==================== Id Table ====================
+// Open-addressing hash table keyed by PlateId, split into independently
+// locked shards so lanes working on different vehicles do not contend.
+// Linear probing with backward-shift deletion leaves no tombstones. Each call
+// probes the table once; callbacks run with the shard locked.
+template <typename V>
+class IdTable
+{
+private:
+    static const int SHARD_COUNT = 64;
+    struct Entry
+    {
+        PlateId id = NO_PLATE;
+        V value = V();
+    };
+    struct Shard
+    {
+        mutable shared_mutex lock;
+        vector<Entry> entries;
+        size_t count = 0;
+    };
+    Shard shards[SHARD_COUNT];
+
+    Shard &shardFor(PlateId id) { return shards[id % SHARD_COUNT]; }
+    const Shard &shardFor(PlateId id) const { return shards[id % SHARD_COUNT]; }
+
+    static size_t home(PlateId id, size_t mask)
+    {
+        return (size_t)(((uint64_t)(id / SHARD_COUNT) * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    }
+
+    // Position of the id, or of the empty entry where it belongs
+    static size_t probe(const Shard &shard, PlateId id)
+    {
+        size_t mask = shard.entries.size() - 1;
+        size_t i = home(id, mask);
+        while (shard.entries[i].id != id && shard.entries[i].id != NO_PLATE)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    static void grow(Shard &shard, size_t capacity)
+    {
+        vector<Entry> old;
+        old.swap(shard.entries);
+        shard.entries.resize(capacity);
+        for (auto &entry : old)
+        {
+            if (entry.id != NO_PLATE)
+                shard.entries[probe(shard, entry.id)] = move(entry);
+        }
+    }
+
+    // Makes room for one more entry; returns the entry for id, new or not
+    static Entry &claim(Shard &shard, PlateId id, bool &inserted)
+    {
+        if ((shard.count + 1) * 4 > shard.entries.size() * 3)
+            grow(shard, shard.entries.empty() ? 16 : shard.entries.size() * 2);
+        Entry &entry = shard.entries[probe(shard, id)];
+        inserted = (entry.id == NO_PLATE);
+        if (inserted)
+        {
+            entry.id = id;
+            entry.value = V();
+            shard.count++;
+        }
+        return entry;
+    }
+
+    // Backward-shift deletion: later entries of the probe run move up
+    static void eraseAt(Shard &shard, size_t i)
+    {
+        size_t mask = shard.entries.size() - 1;
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; shard.entries[j].id != NO_PLATE; j = (j + 1) & mask)
+        {
+            size_t want = home(shard.entries[j].id, mask);
+            // Move j into the hole unless its home lies cyclically in (hole, j]
+            if (((j - want) & mask) >= ((j - hole) & mask))
+            {
+                shard.entries[hole] = move(shard.entries[j]);
+                hole = j;
+            }
+        }
+        shard.entries[hole].id = NO_PLATE;
+        shard.entries[hole].value = V();
+        shard.count--;
+    }
+
+public:
+    // Lookups of NO_PLATE always miss; upsert and insert need a real id
+
+    // fn(V *value) gets nullptr when the id is absent
+    template <typename F>
+    auto update(PlateId id, F fn)
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> guard(shard.lock);
+        if (id == NO_PLATE || shard.entries.empty())
+            return fn((V *)nullptr);
+        Entry &entry = shard.entries[probe(shard, id)];
+        return fn(entry.id == id ? &entry.value : (V *)nullptr);
+    }
+
+    // fn(const V *value) gets nullptr when the id is absent
+    template <typename F>
+    auto read(PlateId id, F fn) const
+    {
+        const Shard &shard = shardFor(id);
+        shared_lock<shared_mutex> guard(shard.lock);
+        if (id == NO_PLATE || shard.entries.empty())
+            return fn((const V *)nullptr);
+        const Entry &entry = shard.entries[probe(shard, id)];
+        return fn(entry.id == id ? &entry.value : (const V *)nullptr);
+    }
+
+    // fn(V &value, bool inserted); a new entry starts value-initialised
+    template <typename F>
+    auto upsert(PlateId id, F fn)
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> guard(shard.lock);
+        bool inserted;
+        Entry &entry = claim(shard, id, inserted);
+        return fn(entry.value, inserted);
+    }
+
+    // Adds the id only if it is absent; returns false if it was present
+    bool insert(PlateId id, const V &value)
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> guard(shard.lock);
+        bool inserted;
+        Entry &entry = claim(shard, id, inserted);
+        if (inserted)
+            entry.value = value;
+        return inserted;
+    }
+
+    // Removes the id, handing back its value; returns false if it was absent
+    bool erase(PlateId id, V *removed = nullptr)
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> guard(shard.lock);
+        if (id == NO_PLATE || shard.entries.empty())
+            return false;
+        size_t i = probe(shard, id);
+        if (shard.entries[i].id != id)
+            return false;
+        if (removed)
+            *removed = move(shard.entries[i].value);
+        eraseAt(shard, i);
+        return true;
+    }
+
+    // Removes the id only if pred(const V &value) holds
+    template <typename F>
+    bool eraseIf(PlateId id, F pred, V *removed = nullptr)
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> guard(shard.lock);
+        if (id == NO_PLATE || shard.entries.empty())
+            return false;
+        size_t i = probe(shard, id);
+        if (shard.entries[i].id != id || !pred(shard.entries[i].value))
+            return false;
+        if (removed)
+            *removed = move(shard.entries[i].value);
+        eraseAt(shard, i);
+        return true;
+    }
+
+    // Sizes every shard for count more ids, so adding them never stops to
+    // rehash
+    void reserve(size_t count)
+    {
+        for (auto &shard : shards)
+        {
+            unique_lock<shared_mutex> guard(shard.lock);
+            size_t capacity = max<size_t>(shard.entries.size(), 16);
+            // An eighth more than an even share, for shards that draw more
+            while ((shard.count + count / SHARD_COUNT + count / SHARD_COUNT / 8 + 1) * 4 > capacity * 3)
+                capacity *= 2;
+            if (capacity > shard.entries.size())
+                grow(shard, capacity);
+        }
+    }
+
+    template <typename F>
+    void forEach(F fn) const
+    {
+        for (auto &shard : shards)
+        {
+            shared_lock<shared_mutex> guard(shard.lock);
+            for (auto &entry : shard.entries)
+            {
+                if (entry.id != NO_PLATE)
+                    fn(entry.id, entry.value);
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (auto &shard : shards)
+        {
+            shared_lock<shared_mutex> guard(shard.lock);
+            total += shard.count;
+        }
+        return total;
+    }
+};
+
+// ==================== Gate Lock ====================
+// A shared mutex that lets a waiting exclusive locker in first. glibc's
+// rwlock prefers readers, so under steady gate traffic a checkpoint could
+// wait indefinitely; here new shared lockers hold back while one waits. A
+// thread must not take the shared side twice.
+class WriterFirstMutex
+{
+private:
+    shared_mutex inner;
+    atomic<int> writersWaiting{0};
+
+public:
+    void lock()
+    {
+        writersWaiting.fetch_add(1, memory_order_acq_rel);
+        inner.lock();
+        writersWaiting.fetch_sub(1, memory_order_release);
+    }
+
+    void unlock() { inner.unlock(); }
+
+    void lock_shared()
+    {
+        while (writersWaiting.load(memory_order_acquire) > 0)
+            this_thread::yield();
+        inner.lock_shared();
+    }
+
+    void unlock_shared() { inner.unlock_shared(); }
+};
+
+// ==================== Pass Directory ====================
+// Monthly passes shared by every site hosted in one process, so a pass bought
+// at one garage is honoured at all of them. Validity checks take no lock and
+// write no shared memory: an entry's plate is published once and only its
+// start date changes afterwards, so sites checking passes at the same time
+// never contend. Purchases lock one shard and are journaled to the
+// directory's own snapshot and journal, apart from every site's data.
+// Compaction runs on its own thread: purchases wait only while it copies the
+// passes, not while it writes them. It moves expired passes to
+// pass_archive.log; their entries stay behind with a zero start date, which
+// reads as absent, until the next restart.
+class PassDirectory
+{
+private:
+    static const int SHARD_COUNT = 64;
+    static const long long PASS_SECONDS = 30 * 24 * 60 * 60;
+
+    // A zero hash marks an empty entry; the hash is stored last, so a reader
+    // that sees it also sees the plate. A zero start marks an archived pass.
+    struct Entry
+    {
+        atomic<uint64_t> hash{0};
+        atomic<const string *> plate{nullptr};
+        atomic<long long> start{0};
+    };
+    // Outgrown tables stay allocated until the directory is destroyed, since
+    // a reader may still be probing one
+    struct Table
+    {
+        size_t mask;
+        Entry *entries;
+        Table *previous;
+    };
+    struct Shard
+    {
+        mutex lock;
+        atomic<Table *> table{nullptr};
+        size_t count = 0;
+        deque<string> plates; // elements never move once added
+    };
+    Shard shards[SHARD_COUNT];
+    atomic<size_t> passCount;
+    string dataDir;
+    JournalConfig config;
+    const Clock *clock;
+    Journal *journal;
+    long long snapshotLsn;
+    // Purchases hold this shared; a checkpoint takes it exclusively while it
+    // copies the passes
+    WriterFirstMutex stateLock;
+    atomic<bool> compacting;
+    MetricCounter archived;
+    LogHistogram checkpointPause{LATENCY_SHIFT, LATENCY_BUCKETS};
+    LogHistogram snapshotLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+    // What a checkpoint writes, copied at one journal position. Plates are
+    // never freed, so the pointers stay valid after the lock is dropped.
+    struct CheckpointPass
+    {
+        const string *plate;
+        uint64_t hash;
+        long long start;
+    };
+    struct Checkpoint
+    {
+        JournalCut journal;
+        bool journalIntact = true;
+        vector<CheckpointPass> live, expired;
+    };
+    mutex checkpointLock;  // one checkpoint at a time
+    Checkpoint checkpoint; // reused under checkpointLock
+    // Woken by the purchase that finds the journal long enough
+    mutex compactorLock;
+    condition_variable compactorWake;
+    bool compactRequested;
+    bool shutDown;
+    thread compactor;
+
+    static uint64_t hashOf(string_view plate)
+    {
+        uint64_t h = hash<string_view>()(plate);
+        return h != 0 ? h : 1;
+    }
+    Shard &shardFor(uint64_t h) { return shards[(h >> 32) % SHARD_COUNT]; }
+    const Shard &shardFor(uint64_t h) const { return shards[(h >> 32) % SHARD_COUNT]; }
+
+    static Entry *find(Table *table, uint64_t h, string_view plate)
+    {
+        if (!table)
+            return nullptr;
+        for (size_t i = h & table->mask;; i = (i + 1) & table->mask)
+        {
+            Entry &entry = table->entries[i];
+            uint64_t entryHash = entry.hash.load(memory_order_acquire);
+            if (entryHash == 0)
+                return nullptr;
+            if (entryHash == h && *entry.plate.load(memory_order_relaxed) == plate)
+                return &entry;
+        }
+    }
+
+    // Kept at most half full so probes stay short without a lock
+    Table *grow(Shard &shard)
+    {
+        Table *old = shard.table.load(memory_order_relaxed);
+        size_t capacity = old ? (old->mask + 1) * 2 : 64;
+        Table *table = new Table{capacity - 1, new Entry[capacity], old};
+        for (size_t i = 0; old && i <= old->mask; i++)
+        {
+            Entry &from = old->entries[i];
+            uint64_t h = from.hash.load(memory_order_relaxed);
+            if (h == 0)
+                continue;
+            size_t j = h & table->mask;
+            while (table->entries[j].hash.load(memory_order_relaxed) != 0)
+                j = (j + 1) & table->mask;
+            table->entries[j].plate.store(from.plate.load(memory_order_relaxed), memory_order_relaxed);
+            table->entries[j].start.store(from.start.load(memory_order_relaxed), memory_order_relaxed);
+            table->entries[j].hash.store(h, memory_order_relaxed);
+        }
+        shard.table.store(table, memory_order_release);
+        return table;
+    }
+
+    // Sets the plate's start date, adding the plate if it is new; the shard
+    // must be locked
+    void storeLocked(Shard &shard, uint64_t h, const string &plate, time_t start)
+    {
+        Table *table = shard.table.load(memory_order_relaxed);
+        Entry *entry = find(table, h, plate);
+        if (entry)
+        {
+            if (entry->start.load(memory_order_relaxed) == 0)
+                passCount++;
+            entry->start.store(start, memory_order_relaxed);
+            return;
+        }
+        if (!table || (shard.count + 1) * 2 > table->mask + 1)
+            table = grow(shard);
+        size_t i = h & table->mask;
+        while (table->entries[i].hash.load(memory_order_relaxed) != 0)
+            i = (i + 1) & table->mask;
+        shard.plates.push_back(plate);
+        table->entries[i].plate.store(&shard.plates.back(), memory_order_relaxed);
+        table->entries[i].start.store(start, memory_order_relaxed);
+        table->entries[i].hash.store(h, memory_order_release);
+        shard.count++;
+        passCount++;
+    }
+
+    // Records a start date unless the plate already has a later one,
+    // journaling the change when logged is set
+    void adopt(const string &plate, time_t start, bool logged)
+    {
+        uint64_t h = hashOf(plate);
+        Shard &shard = shardFor(h);
+        lock_guard<mutex> guard(shard.lock);
+        Entry *entry = find(shard.table.load(memory_order_relaxed), h, plate);
+        if (entry && entry->start.load(memory_order_relaxed) >= start)
+            return;
+        storeLocked(shard, h, plate, start);
+        if (logged)
+        {
+            JournalBatch batch;
+            batch.record("PASS").add(plate).add((long long)start);
+            journal->append(batch);
+        }
+    }
+
+    string dataPath(const string &name) const
+    {
+        return dataDir.empty() ? name : dataDir + "/" + name;
+    }
+
+    void load()
+    {
+        string path = dataPath("pass_directory.bin");
+        SnapshotReader reader;
+        string error;
+        if (reader.open(path, error))
+        {
+            for (size_t i = 0; i < reader.passCount(); i++)
+            {
+                const SnapshotPass &p = reader.pass(i);
+                adopt(string(reader.plate(p.plateOffset, p.plateLength)), p.startDate, false);
+            }
+            snapshotLsn = reader.lastLsn();
+        }
+        else if (filesystem::exists(path))
+        {
+            cerr << "✗ Warning: ignoring " << path << " (" << error << ")" << endl;
+        }
+
+        LineReader replay(dataPath("pass_journal.log"));
+        ParseErrors errors(dataPath("pass_journal.log"));
+        string_view line, f[4];
+        bool complete;
+        // A torn final write leaves a line without its newline
+        while (replay.next(line, &complete) && complete)
+        {
+            long long lsn, start;
+            if (splitFields(line, f, 4) != 4 || f[1] != "PASS" || !parseField(f[0], lsn) || !parseField(f[3], start))
+            {
+                errors.add(replay.getLineNumber(), "not a PASS record");
+                continue;
+            }
+            if (lsn <= snapshotLsn)
+                continue;
+            snapshotLsn = lsn;
+            adopt(string(f[2]), start, false);
+        }
+        errors.summarize();
+    }
+
+    // Called after a purchase has dropped its shared lock; only wakes the
+    // compactor
+    void maybeCompact()
+    {
+        if (config.compactEveryRecords <= 0 || journal->getRecordsSinceReset() < config.compactEveryRecords)
+            return;
+        bool expected = false;
+        if (!compacting.compare_exchange_strong(expected, true))
+            return;
+        {
+            lock_guard<mutex> guard(compactorLock);
+            compactRequested = true;
+        }
+        compactorWake.notify_one();
+    }
+
+    void compactorLoop()
+    {
+        unique_lock<mutex> guard(compactorLock);
+        while (true)
+        {
+            compactorWake.wait(guard, [&]() { return compactRequested || shutDown; });
+            if (shutDown)
+                return;
+            compactRequested = false;
+            guard.unlock();
+            compact();
+            compacting = false;
+            guard.lock();
+        }
+    }
+
+    // Writes a snapshot of the passes still valid and archives the rest
+    bool compact()
+    {
+        lock_guard<mutex> serial(checkpointLock);
+        {
+            unique_lock<WriterFirstMutex> exclusive(stateLock);
+            takeCheckpoint(checkpoint);
+        }
+        return writeCheckpoint(checkpoint);
+    }
+
+    // Sorts every pass into live or expired as of the journal's last record;
+    // the caller holds stateLock exclusively
+    void takeCheckpoint(Checkpoint &cut)
+    {
+        LatencyTimer timer(checkpointPause);
+        cut.journalIntact = journal->cut(cut.journal);
+        time_t now = clock->now();
+        cut.live.clear();
+        cut.expired.clear();
+        for (auto &shard : shards)
+        {
+            lock_guard<mutex> guard(shard.lock);
+            Table *table = shard.table.load(memory_order_relaxed);
+            for (size_t i = 0; table && i <= table->mask; i++)
+            {
+                Entry &entry = table->entries[i];
+                uint64_t h = entry.hash.load(memory_order_relaxed);
+                long long start = entry.start.load(memory_order_relaxed);
+                if (h == 0 || start == 0)
+                    continue;
+                CheckpointPass pass{entry.plate.load(memory_order_relaxed), h, start};
+                (now < start + PASS_SECONDS ? cut.live : cut.expired).push_back(pass);
+            }
+        }
+    }
+
+    // Archived before the snapshot drops them, so an expired pass is never
+    // lost: if the archive cannot be written, the entries, snapshot and
+    // journal all stay as they were. The journal is cut last.
+    bool writeCheckpoint(const Checkpoint &cut)
+    {
+        if (!cut.expired.empty())
+        {
+            string expired;
+            for (auto &pass : cut.expired)
+                expired += *pass.plate + "," + to_string(pass.start) + "," + to_string(pass.start + PASS_SECONDS) + "\n";
+            int fd = openAppendFile(dataPath("pass_archive.log"), false);
+            bool ok = fd >= 0 && writeAll(fd, expired.data(), expired.size());
+            if (fd >= 0)
+            {
+                ok = syncFile(fd) && ok;
+                closeFile(fd);
+            }
+            if (!ok)
+            {
+                cerr << "✗ Warning: could not write " << dataPath("pass_archive.log") << endl;
+                return false;
+            }
+            // A pass bought again since the cut keeps its new start; its
+            // record is after the cut, so the journal keeps it
+            for (auto &pass : cut.expired)
+            {
+                Shard &shard = shardFor(pass.hash);
+                lock_guard<mutex> guard(shard.lock);
+                Entry *entry = find(shard.table.load(memory_order_relaxed), pass.hash, *pass.plate);
+                long long start = pass.start;
+                if (entry && entry->start.compare_exchange_strong(start, 0, memory_order_relaxed))
+                    passCount--;
+            }
+            archived.add(cut.expired.size());
+        }
+        {
+            LatencyTimer timer(snapshotLatency);
+            SnapshotWriter writer;
+            for (auto &pass : cut.live)
+                writer.addPass(*pass.plate, pass.start, pass.start + PASS_SECONDS);
+            if (!writer.write(dataPath("pass_directory.bin"), 0.0, cut.journal.lsn))
+            {
+                cerr << "✗ Warning: could not write " << dataPath("pass_directory.bin") << endl;
+                return false;
+            }
+        }
+        if (!cut.journalIntact || !journal->dropThrough(cut.journal))
+        {
+            cerr << "✗ Warning: could not cut " << dataPath("pass_journal.log") << endl;
+            return false;
+        }
+        return true;
+    }
+
+public:
+    // Loads pass_directory.bin and pass_journal.log from dir (empty = working
+    // directory). The clock must outlive the directory; nullptr = system clock.
+    PassDirectory(string dir = "", JournalConfig cfg = JournalConfig(), const Clock *clk = nullptr)
+        : passCount(0), dataDir(dir), config(cfg), clock(clk ? clk : &systemClock()), journal(nullptr),
+          snapshotLsn(0), compacting(false), compactRequested(false), shutDown(false)
+    {
+        load();
+        journal = new Journal(dataPath("pass_journal.log"), config, snapshotLsn + 1);
+        if (config.compactEveryRecords > 0)
+            compactor = thread(&PassDirectory::compactorLoop, this);
+    }
+
+    // Stops the compactor and writes a final checkpoint; purchases must have
+    // stopped
+    ~PassDirectory()
+    {
+        {
+            lock_guard<mutex> guard(compactorLock);
+            shutDown = true;
+        }
+        compactorWake.notify_one();
+        if (compactor.joinable())
+            compactor.join();
+        compact();
+        delete journal;
+        for (auto &shard : shards)
+        {
+            Table *table = shard.table.load();
+            while (table)
+            {
+                Table *previous = table->previous;
+                delete[] table->entries;
+                delete table;
+                table = previous;
+            }
+        }
+    }
+
+    // Start date of the plate's latest pass; false if it never held one
+    bool lookup(string_view plate, time_t &start) const
+    {
+        uint64_t h = hashOf(plate);
+        Entry *entry = find(shardFor(h).table.load(memory_order_acquire), h, plate);
+        if (!entry)
+            return false;
+        start = entry->start.load(memory_order_relaxed);
+        return start != 0;
+    }
+
+    bool isValid(string_view plate, time_t now) const { return validUntil(plate, now) != 0; }
+
+    // Expiry of the plate's pass if it is valid at now, else 0
+    time_t validUntil(string_view plate, time_t now) const
+    {
+        time_t start;
+        return lookup(plate, start) && now < start + PASS_SECONDS ? start + PASS_SECONDS : 0;
+    }
+
+    // Sells a pass starting now; returns false if the plate already holds a valid one
+    bool issue(const string &plate, time_t now, time_t &startDate)
+    {
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            uint64_t h = hashOf(plate);
+            Shard &shard = shardFor(h);
+            lock_guard<mutex> guard(shard.lock);
+            Entry *entry = find(shard.table.load(memory_order_relaxed), h, plate);
+            if (entry && now < entry->start.load(memory_order_relaxed) + PASS_SECONDS)
+                return false;
+            storeLocked(shard, h, plate, now);
+            startDate = now;
+            // Logged under the shard lock so replay sees purchases in order
+            JournalBatch batch;
+            batch.record("PASS").add(plate).add((long long)now);
+            journal->append(batch);
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // Extends every plate's pass by one period in a single journal write: a
+    // valid pass runs on from its expiry, a lapsed or missing one starts now.
+    // startDates receives the new start of each renewed period.
+    void renew(const vector<string> &plateNums, time_t now, vector<time_t> &startDates)
+    {
+        startDates.assign(plateNums.size(), 0);
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            JournalBatch batch;
+            for (size_t i = 0; i < plateNums.size(); i++)
+            {
+                const string &plate = plateNums[i];
+                uint64_t h = hashOf(plate);
+                Shard &shard = shardFor(h);
+                lock_guard<mutex> guard(shard.lock);
+                Entry *entry = find(shard.table.load(memory_order_relaxed), h, plate);
+                long long start = entry ? entry->start.load(memory_order_relaxed) : 0;
+                startDates[i] = (start != 0 && now < start + PASS_SECONDS) ? start + PASS_SECONDS : now;
+                storeLocked(shard, h, plate, startDates[i]);
+                batch.record("PASS").add(plate).add((long long)startDates[i]);
+            }
+            // Replay keeps the latest start per plate, so the order of this
+            // write against concurrent purchases does not matter
+            if (batch.size() > 0)
+                journal->append(batch);
+        }
+        maybeCompact();
+    }
+
+    // Adopts a pass a site kept before it joined the directory; the later of
+    // the two start dates wins
+    void restore(const string &plate, time_t start)
+    {
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            adopt(plate, start, true);
+        }
+        maybeCompact();
+    }
+
+    // Calls fn(plate, startDate) for every pass on record, one shard locked at a time
+    template <typename Fn>
+    void forEach(Fn fn)
+    {
+        for (auto &shard : shards)
+        {
+            lock_guard<mutex> guard(shard.lock);
+            Table *table = shard.table.load(memory_order_relaxed);
+            for (size_t i = 0; table && i <= table->mask; i++)
+            {
+                Entry &entry = table->entries[i];
+                long long start = entry.start.load(memory_order_relaxed);
+                if (entry.hash.load(memory_order_relaxed) != 0 && start != 0)
+                    fn(*entry.plate.load(memory_order_relaxed), (time_t)start);
+            }
+        }
+    }
+
+    // Returns once every purchase and renewal that has returned is on disk;
+    // false if a journal write has failed
+    bool flush() { return journal->flush(); }
+
+    // Writes a checkpoint on the calling thread; purchases only wait while
+    // it is copied. False if it could not be written whole.
+    bool checkpointNow() { return compact(); }
+
+    size_t size() const { return passCount; }
+    uint64_t getArchivedCount() const { return archived.value(); }
+    const LogHistogram &getCheckpointPause() const { return checkpointPause; }
+    const LogHistogram &getSnapshotLatency() const { return snapshotLatency; }
+};
+
+// ==================== Transaction History ====================
+const char HISTORY_MAGIC[8] = {'P', 'K', 'H', 'I', 'S', 'T', '1', '\0'};
+
+// transaction_history.col is a run of these blocks, one per compaction
+struct HistoryBlockHeader
+{
+    char magic[8];
+    uint32_t rowCount;
+    uint32_t methodBytes; // payment method names, '\n' terminated, padded to 8 bytes
+    int64_t lastLsn;      // last journal record this and earlier blocks cover
+    uint64_t checksum;    // of everything after the header
+};
+
+enum HistoryGroup
+{
+    GROUP_NONE,
+    GROUP_KIND,
+    GROUP_METHOD,
+    GROUP_PASS
+};
+
+// A time-bucketed aggregation over completed exits
+struct HistoryQuery
+{
+    time_t from = 0;                // exit time range [from, to)
+    time_t to = LLONG_MAX;
+    long long bucketSeconds = 3600; // buckets align to the epoch; 0 = one bucket for the whole range
+    HistoryGroup groupBy = GROUP_NONE;
+    int kind = -1; // only this vehicle type, -1 = all
+};
+
+struct HistoryBucket
+{
+    time_t start;
+    string group; // vehicle type, payment method or "pass"/"paid"; empty when ungrouped
+    uint64_t exits;
+    uint64_t passExits;
+    double revenue;
+    double dwellSeconds; // summed; divide by exits for the mean
+};
+
+// Every completed exit, one row each, stored column by column in fixed
+// chunks so a query reads only the columns it needs. Gate lanes append under
+// a short lock that queries never take: a row becomes visible once rowCount
+// moves past it, and each chunk keeps its time range so scans skip chunks
+// outside the query. The column loops are branch-free so the compiler can
+// vectorise them.
+class TransactionHistory
+{
+public:
+    static const int CHUNK_BITS = 16;
+    static const size_t CHUNK_ROWS = size_t(1) << CHUNK_BITS;
+    static const int MAX_CHUNKS = 1 << 14;
+    static const int MAX_METHODS = 255; // later names share the last code
+
+private:
+    struct Chunk
+    {
+        int64_t exitTime[CHUNK_ROWS];
+        double amount[CHUNK_ROWS];
+        int32_t duration[CHUNK_ROWS];
+        int32_t slotNumber[CHUNK_ROWS];
+        uint8_t kind[CHUNK_ROWS];
+        uint8_t method[CHUNK_ROWS];
+        uint8_t passHolder[CHUNK_ROWS];
+        atomic<long long> minTime{LLONG_MAX};
+        atomic<long long> maxTime{LLONG_MIN};
+    };
+    static const size_t SCAN_BLOCK = 1024;
+    static const size_t MAX_CELLS = size_t(1) << 24;
+
+    mutable mutex appendLock;
+    unique_ptr<atomic<Chunk *>[]> chunks;
+    atomic<size_t> rowCount;
+    atomic<int> chunkCount;
+    vector<string> methods; // appendLock; codes never change once given
+    mutex persistLock;      // one persist() at a time; guards persistedRows
+    size_t persistedRows;
+    long long persistedLsn;
+
+    uint8_t methodCode(string_view name)
+    {
+        for (size_t i = 0; i < methods.size(); i++)
+        {
+            if (methods[i] == name)
+                return (uint8_t)i;
+        }
+        if (methods.size() == MAX_METHODS)
+            return MAX_METHODS - 1;
+        methods.push_back(string(name));
+        return (uint8_t)(methods.size() - 1);
+    }
+
+    void appendLocked(long long exitTime, int slotNumber, int kind, long long duration, double amount,
+                      uint8_t method, bool passHolder)
+    {
+        size_t row = rowCount.load(memory_order_relaxed);
+        size_t index = row >> CHUNK_BITS;
+        if (index >= (size_t)MAX_CHUNKS)
+            return;
+        Chunk *chunk = chunks[index].load(memory_order_relaxed);
+        if (!chunk)
+        {
+            chunk = new Chunk;
+            chunks[index].store(chunk, memory_order_release);
+            chunkCount++;
+        }
+        size_t i = row & (CHUNK_ROWS - 1);
+        chunk->exitTime[i] = exitTime;
+        chunk->amount[i] = amount;
+        chunk->duration[i] = (int32_t)min(max(duration, 0LL), (long long)INT32_MAX);
+        chunk->slotNumber[i] = slotNumber;
+        chunk->kind[i] = (uint8_t)kind;
+        chunk->method[i] = method;
+        chunk->passHolder[i] = passHolder;
+        if (exitTime < chunk->minTime.load(memory_order_relaxed))
+            chunk->minTime.store(exitTime, memory_order_relaxed);
+        if (exitTime > chunk->maxTime.load(memory_order_relaxed))
+            chunk->maxTime.store(exitTime, memory_order_relaxed);
+        rowCount.store(row + 1, memory_order_release);
+    }
+
+    // Fills block with one .col block of n rows: the header, the method names,
+    // then addColumn(member, width) appends each column for all n rows
+    template <typename AddColumn>
+    static void encodeBlock(string &block, const vector<string> &methodNames, size_t n, long long lsn,
+                            AddColumn addColumn)
+    {
+        block.assign(sizeof(HistoryBlockHeader), '\0');
+        for (auto &name : methodNames)
+        {
+            block += name;
+            block += '\n';
+        }
+        while (block.size() % 8 != 0)
+            block += '\0';
+        size_t methodBytes = block.size() - sizeof(HistoryBlockHeader);
+        // Columns in chunk order: times, amounts, durations, slots, kinds, methods, pass flags
+        addColumn(&Chunk::exitTime, sizeof(int64_t));
+        addColumn(&Chunk::amount, sizeof(double));
+        addColumn(&Chunk::duration, sizeof(int32_t));
+        addColumn(&Chunk::slotNumber, sizeof(int32_t));
+        addColumn(&Chunk::kind, 1);
+        addColumn(&Chunk::method, 1);
+        addColumn(&Chunk::passHolder, 1);
+        while (block.size() % 8 != 0)
+            block += '\0';
+
+        HistoryBlockHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+        header.rowCount = (uint32_t)n;
+        header.methodBytes = (uint32_t)methodBytes;
+        header.lastLsn = lsn;
+        header.checksum = checksum64(block.data() + sizeof(header), block.size() - sizeof(header));
+        memcpy(&block[0], &header, sizeof(header));
+    }
+
+    // Calls fn(chunk, rows) for every chunk holding any of the first rows rows
+    template <typename Fn>
+    void forChunks(size_t rows, Fn fn) const
+    {
+        for (size_t first = 0; first < rows; first += CHUNK_ROWS)
+        {
+            const Chunk *chunk = chunks[first >> CHUNK_BITS].load(memory_order_acquire);
+            fn(*chunk, min(CHUNK_ROWS, rows - first));
+        }
+    }
+
+    vector<string> groupNames(HistoryGroup group) const
+    {
+        lock_guard<mutex> guard(appendLock);
+        vector<string> names;
+        if (group == GROUP_KIND)
+            names.assign(VEHICLE_KIND_NAMES, VEHICLE_KIND_NAMES + KIND_COUNT);
+        else if (group == GROUP_METHOD)
+            names = methods;
+        else if (group == GROUP_PASS)
+            names = {"paid", "pass"};
+        else
+            names = {""};
+        return names;
+    }
+
+public:
+    TransactionHistory()
+        : chunks(new atomic<Chunk *>[MAX_CHUNKS]), rowCount(0), chunkCount(0), persistedRows(0), persistedLsn(0)
+    {
+        for (int i = 0; i < MAX_CHUNKS; i++)
+        {
+            chunks[i] = nullptr;
+        }
+    }
+
+    TransactionHistory(const TransactionHistory &) = delete;
+    TransactionHistory &operator=(const TransactionHistory &) = delete;
+
+    ~TransactionHistory()
+    {
+        for (int i = 0; i < MAX_CHUNKS; i++)
+        {
+            delete chunks[i].load();
+        }
+    }
+
+    // Records one completed exit; duration is the real time parked in seconds
+    void append(time_t exitTime, int slotNumber, int kind, long long duration, double amount,
+                string_view method, bool passHolder)
+    {
+        lock_guard<mutex> guard(appendLock);
+        appendLocked(exitTime, slotNumber, kind, duration, amount, methodCode(method), passHolder);
+    }
+
+    // Sums exits, revenue and dwell time per bucket and group, in bucket order
+    vector<HistoryBucket> aggregate(const HistoryQuery &query) const
+    {
+        vector<HistoryBucket> result;
+        vector<string> names = groupNames(query.groupBy);
+        size_t rows = rowCount.load(memory_order_acquire);
+        long long first = LLONG_MAX, last = LLONG_MIN;
+        forChunks(rows, [&](const Chunk &chunk, size_t) {
+            first = min(first, chunk.minTime.load(memory_order_relaxed));
+            last = max(last, chunk.maxTime.load(memory_order_relaxed));
+        });
+        long long from = max((long long)query.from, first);
+        long long to = (long long)query.to <= last ? (long long)query.to : last + 1;
+        if (rows == 0 || from >= to)
+            return result;
+
+        long long width = query.bucketSeconds > 0 ? query.bucketSeconds : to - from;
+        long long origin = from;
+        if (query.bucketSeconds > 0)
+            origin = (from >= 0 ? from / width : (from - width + 1) / width) * width;
+        size_t groups = max(names.size(), (size_t)1);
+        if (query.groupBy == GROUP_METHOD)
+            groups = MAX_METHODS;
+        size_t buckets = (size_t)((to - 1 - origin) / width) + 1;
+        if (buckets > MAX_CELLS / groups)
+            return result;
+
+        // Rows the filter rejects land in one spare cell past the end
+        size_t cells = buckets * groups, spare = cells;
+        vector<uint64_t> exits(cells + 1), passExits(cells + 1);
+        vector<double> revenue(cells + 1), dwell(cells + 1);
+        uint32_t cell[SCAN_BLOCK];
+        forChunks(rows, [&](const Chunk &chunk, size_t count) {
+            if (chunk.maxTime.load(memory_order_relaxed) < from || chunk.minTime.load(memory_order_relaxed) >= to)
+                return;
+            const uint8_t *groupColumn = query.groupBy == GROUP_KIND     ? chunk.kind
+                                         : query.groupBy == GROUP_METHOD ? chunk.method
+                                         : query.groupBy == GROUP_PASS   ? chunk.passHolder
+                                                                         : nullptr;
+            for (size_t base = 0; base < count; base += SCAN_BLOCK)
+            {
+                size_t n = min(SCAN_BLOCK, count - base);
+                const int64_t *time = chunk.exitTime + base;
+                const uint8_t *kind = chunk.kind + base;
+                for (size_t i = 0; i < n; i++)
+                {
+                    bool keep = (time[i] >= from) & (time[i] < to) & ((query.kind < 0) | (kind[i] == query.kind));
+                    long long offset = keep ? time[i] - origin : 0;
+                    size_t group = groupColumn ? groupColumn[base + i] : 0;
+                    cell[i] = keep ? (uint32_t)((offset / width) * groups + group) : (uint32_t)spare;
+                }
+                for (size_t i = 0; i < n; i++)
+                {
+                    exits[cell[i]]++;
+                    passExits[cell[i]] += chunk.passHolder[base + i];
+                    revenue[cell[i]] += chunk.amount[base + i];
+                    dwell[cell[i]] += chunk.duration[base + i];
+                }
+            }
+        });
+
+        for (size_t c = 0; c < cells; c++)
+        {
+            if (exits[c] == 0)
+                continue;
+            size_t group = c % groups;
+            HistoryBucket bucket;
+            bucket.start = (time_t)(origin + (long long)(c / groups) * width);
+            bucket.group = group < names.size() ? names[group] : "";
+            bucket.exits = exits[c];
+            bucket.passExits = passExits[c];
+            bucket.revenue = revenue[c];
+            bucket.dwellSeconds = dwell[c];
+            result.push_back(bucket);
+        }
+        return result;
+    }
+
+    // Dwell time in seconds below which a share p (0-1) of the matching exits fall
+    long long dwellPercentile(const HistoryQuery &query, double p) const
+    {
+        vector<int32_t> durations;
+        size_t rows = rowCount.load(memory_order_acquire);
+        forChunks(rows, [&](const Chunk &chunk, size_t count) {
+            if (chunk.maxTime.load(memory_order_relaxed) < query.from ||
+                chunk.minTime.load(memory_order_relaxed) >= query.to)
+                return;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (chunk.exitTime[i] >= query.from && chunk.exitTime[i] < query.to &&
+                    (query.kind < 0 || chunk.kind[i] == query.kind))
+                    durations.push_back(chunk.duration[i]);
+            }
+        });
+        if (durations.empty())
+            return 0;
+        size_t rank = min((size_t)(p * durations.size()), durations.size() - 1);
+        nth_element(durations.begin(), durations.begin() + rank, durations.end());
+        return durations[rank];
+    }
+
+    // Appends the rows added since the last call, up to row upTo, to the file
+    // as one block and syncs it; lsn is the last journal record they cover.
+    // Appends only wait while the row count and method names are read: rows
+    // below the count never change, so they are encoded and written unlocked.
+    bool persist(const string &path, long long lsn, size_t upTo = SIZE_MAX)
+    {
+        lock_guard<mutex> guard(persistLock);
+        size_t rows;
+        vector<string> names;
+        {
+            lock_guard<mutex> append(appendLock);
+            rows = min(rowCount.load(memory_order_acquire), upTo);
+            if (rows <= persistedRows)
+                return true;
+            names = methods;
+        }
+
+        string block;
+        encodeBlock(block, names, rows - persistedRows, lsn, [&](auto member, size_t width) {
+            for (size_t row = persistedRows; row < rows;)
+            {
+                const Chunk *chunk = chunks[row >> CHUNK_BITS].load(memory_order_acquire);
+                size_t first = row & (CHUNK_ROWS - 1);
+                size_t count = min(CHUNK_ROWS - first, rows - row);
+                block.append((const char *)&(chunk->*member)[first], count * width);
+                row += count;
+            }
+        });
+
+        int fd = openAppendFile(path, false);
+        if (fd < 0)
+            return false;
+        bool ok = writeAll(fd, block.data(), block.size());
+        ok = syncFile(fd) && ok;
+        closeFile(fd);
+        if (!ok)
+            return false;
+        persistedRows = rows;
+        persistedLsn = lsn;
+        return true;
+    }
+
+    // Streams the exits in [from, to) as CSV, a row at a time, so memory
+    // stays flat however long the history; returns the rows written
+    size_t exportCsv(ostream &out, time_t from = 0, time_t to = LLONG_MAX) const
+    {
+        size_t rows = rowCount.load(memory_order_acquire);
+        vector<string> names = groupNames(GROUP_METHOD);
+        out << "exit_time,slot,type,seconds_parked,amount,method,pass\n";
+        size_t written = 0;
+        char line[96];
+        char *end = line + sizeof(line);
+        forChunks(rows, [&](const Chunk &chunk, size_t count) {
+            if (chunk.maxTime.load(memory_order_relaxed) < from || chunk.minTime.load(memory_order_relaxed) >= to)
+                return;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (chunk.exitTime[i] < from || chunk.exitTime[i] >= to)
+                    continue;
+                char *p = to_chars(line, end, chunk.exitTime[i]).ptr;
+                *p++ = ',';
+                p = to_chars(p, end, chunk.slotNumber[i]).ptr;
+                *p++ = ',';
+                const char *kind = VEHICLE_KIND_NAMES[chunk.kind[i]];
+                size_t kindLength = strlen(kind);
+                memcpy(p, kind, kindLength);
+                p += kindLength;
+                *p++ = ',';
+                p = to_chars(p, end, chunk.duration[i]).ptr;
+                p += snprintf(p, end - p, ",%.15g,", chunk.amount[i]);
+                out.write(line, p - line);
+                if (chunk.method[i] < names.size())
+                    out << names[chunk.method[i]];
+                out << (chunk.passHolder[i] ? ",1\n" : ",0\n");
+                written++;
+            }
+        });
+        return written;
+    }
+
+    // Writes the exits in [from, to) to path in the transaction_history.col
+    // format, one block per chunk, so memory stays at one chunk however long
+    // the history; load() reads the file back. Returns the rows written, or
+    // -1 if the file could not be written.
+    long long exportColumns(const string &path, time_t from = 0, time_t to = LLONG_MAX) const
+    {
+        size_t rows = rowCount.load(memory_order_acquire);
+        vector<string> names = groupNames(GROUP_METHOD);
+        unique_ptr<Chunk> kept(new Chunk);
+        string block;
+        string temp = path + ".tmp";
+        int fd = openAppendFile(temp, true);
+        if (fd < 0)
+            return -1;
+        bool ok = true;
+        long long written = 0;
+        forChunks(rows, [&](const Chunk &chunk, size_t count) {
+            long long first = chunk.minTime.load(memory_order_relaxed), last = chunk.maxTime.load(memory_order_relaxed);
+            if (!ok || last < from || first >= to)
+                return;
+            // A chunk wholly in range is written as it stands
+            const Chunk *source = &chunk;
+            size_t n = count;
+            if (first < from || last >= to)
+            {
+                n = 0;
+                for (size_t i = 0; i < count; i++)
+                {
+                    if (chunk.exitTime[i] < from || chunk.exitTime[i] >= to)
+                        continue;
+                    kept->exitTime[n] = chunk.exitTime[i];
+                    kept->amount[n] = chunk.amount[i];
+                    kept->duration[n] = chunk.duration[i];
+                    kept->slotNumber[n] = chunk.slotNumber[i];
+                    kept->kind[n] = chunk.kind[i];
+                    kept->method[n] = chunk.method[i];
+                    kept->passHolder[n] = chunk.passHolder[i];
+                    n++;
+                }
+                source = kept.get();
+            }
+            if (n == 0)
+                return;
+            encodeBlock(block, names, n, 0, [&](auto member, size_t width) {
+                block.append((const char *)&(source->*member)[0], n * width);
+            });
+            ok = writeAll(fd, block.data(), block.size());
+            written += n;
+        });
+        closeFile(fd);
+        error_code ec;
+        if (ok)
+            filesystem::rename(temp, path, ec);
+        if (!ok || ec)
+        {
+            filesystem::remove(temp, ec);
+            return -1;
+        }
+        return written;
+    }
+
+    // Reads every complete block; a torn or corrupt tail is cut off so the
+    // next block appends cleanly. Call before any rows are added.
+    void load(const string &path)
+    {
+        size_t offset = 0, fileSize = 0;
+        {
+            MappedFile file;
+            if (!file.open(path))
+                return;
+            fileSize = file.size();
+            offset = loadBlocks(file);
+        }
+        if (offset < fileSize)
+        {
+            cerr << "✗ Warning: dropping a damaged tail of " << path << endl;
+            error_code ec;
+            filesystem::resize_file(path, offset, ec);
+        }
+    }
+
+    size_t size() const { return rowCount.load(memory_order_acquire); }
+    int getChunkCount() const { return chunkCount; }
+    // Last journal record the rows on disk cover; replay adds only newer exits
+    long long getLastLsn() const { return persistedLsn; }
+
+private:
+    // Returns the size of the intact prefix
+    size_t loadBlocks(const MappedFile &file)
+    {
+        size_t offset = 0;
+        lock_guard<mutex> guard(appendLock);
+        while (offset + sizeof(HistoryBlockHeader) <= file.size())
+        {
+            HistoryBlockHeader header;
+            memcpy(&header, file.begin() + offset, sizeof(header));
+            size_t n = header.rowCount;
+            size_t bodySize = header.methodBytes + n * (sizeof(int64_t) + sizeof(double) + 2 * sizeof(int32_t) + 3);
+            bodySize = (bodySize + 7) / 8 * 8;
+            const char *body = file.begin() + offset + sizeof(header);
+            if (memcmp(header.magic, HISTORY_MAGIC, sizeof(header.magic)) != 0 ||
+                offset + sizeof(header) + bodySize > file.size() || checksum64(body, bodySize) != header.checksum)
+                break;
+
+            // Block method codes map onto this history's codes by name
+            uint8_t codes[MAX_METHODS];
+            size_t count = 0;
+            for (size_t start = 0, end; count < MAX_METHODS && start < header.methodBytes && body[start] != '\0';
+                 start = end + 1)
+            {
+                end = start;
+                while (end < header.methodBytes && body[end] != '\n')
+                    end++;
+                codes[count++] = methodCode(string_view(body + start, end - start));
+            }
+            const char *times = body + header.methodBytes;
+            const char *amounts = times + n * sizeof(int64_t);
+            const char *durations = amounts + n * sizeof(double);
+            const char *slots = durations + n * sizeof(int32_t);
+            const uint8_t *kinds = (const uint8_t *)(slots + n * sizeof(int32_t));
+            const uint8_t *methodColumn = kinds + n;
+            const uint8_t *passFlags = methodColumn + n;
+            for (size_t i = 0; i < n; i++)
+            {
+                int64_t exitTime;
+                double amount;
+                int32_t duration, slot;
+                memcpy(&exitTime, times + i * sizeof(exitTime), sizeof(exitTime));
+                memcpy(&amount, amounts + i * sizeof(amount), sizeof(amount));
+                memcpy(&duration, durations + i * sizeof(duration), sizeof(duration));
+                memcpy(&slot, slots + i * sizeof(slot), sizeof(slot));
+                uint8_t method = methodColumn[i] < count ? codes[methodColumn[i]] : (uint8_t)(MAX_METHODS - 1);
+                appendLocked(exitTime, slot, kinds[i], duration, amount, method, passFlags[i] != 0);
+            }
+            persistedLsn = header.lastLsn;
+            offset += sizeof(header) + bodySize;
+        }
+        persistedRows = rowCount;
+        return offset;
+    }
+};
+
+void atomicAdd(atomic<double> &target, double amount)
+{
+    double current = target.load();
+    while (!target.compare_exchange_weak(current, current + amount))
+    {
+    }
+}
+
+// ==================== Availability ====================
+// Free slots per floor and vehicle type, as shown on the lobby signage
+struct FloorAvailability
+{
+    int floorNumber = 0;
+    int available[KIND_COUNT] = {};
+    double minutesToFull[KIND_COUNT] = {}; // at the rolling rates, -1 when not filling
+};
+
+struct AvailabilitySnapshot
+{
+    vector<FloorAvailability> floors;
+    int totals[KIND_COUNT] = {};
+};
+
+// One park (change -1) or exit (change +1); available is the floor's count
+// for that type as the listener is called, so it already includes the change
+struct AvailabilityDelta
+{
+    int floorNumber = 0;
+    int kind = KIND_BIKE;
+    int change = 0;
+    int available = 0;
+};
+
+typedef function<void(const AvailabilityDelta &)> AvailabilityListener;
+
+// ==================== Occupancy Forecast ====================
+// Rolling arrival and departure rates and dwell times per floor and vehicle
+// type, updated in O(1) on every park and exit without keeping any history.
+// Rates are exponentially decaying counts over a window; dwell times go into
+// quarter-octave minute buckets that forget old exits at the same pace.
+// Lanes update a cell under its own lock, signage reads the rates without one.
+
+// Events per second over roughly the last window, corrected for the time
+// before the first event so a new cell does not read low
+class DecayingRate
+{
+private:
+    atomic<double> weight{0};    // decayed event count as of at
+    atomic<long long> at{0};     // 0 until the first event
+    atomic<long long> since{0};  // first event
+
+public:
+    // Callers serialize add; value may be read at any time
+    void add(time_t t, double windowSeconds)
+    {
+        long long last = at.load(memory_order_relaxed);
+        if (last == 0)
+            since.store(t, memory_order_relaxed);
+        double decayed = weight.load(memory_order_relaxed) * (t > last ? exp(-(t - last) / windowSeconds) : 1.0);
+        weight.store(decayed + 1.0, memory_order_relaxed);
+        at.store(max<long long>(last, t), memory_order_relaxed);
+    }
+
+    double value(time_t now, double windowSeconds) const
+    {
+        long long last = at.load(memory_order_relaxed), first = since.load(memory_order_relaxed);
+        if (last == 0)
+            return 0.0;
+        double span = max(1.0, (double)(max<long long>(now, last) - first));
+        double decayed = weight.load(memory_order_relaxed) * (now > last ? exp(-(now - last) / windowSeconds) : 1.0);
+        return decayed / (windowSeconds * (1.0 - exp(-span / windowSeconds)));
+    }
+};
+
+// What signage shows for one floor and type: free slots now, the rolling
+// rates, and when the pool fills if they hold
+struct FillForecast
+{
+    int available = 0;
+    double arrivalsPerHour = 0.0;
+    double departuresPerHour = 0.0;
+    double minutesToFull = -1.0;  // -1 when departures keep up with arrivals
+    int availableAtHorizon = 0;   // expected free slots horizonMinutes from now
+};
+
+class OccupancyStats
+{
+public:
+    static const int DWELL_BUCKETS = 64; // bucket b starts at 2^(b/4) - 1 minutes
+
+private:
+    // Each exit fades earlier dwell samples by this much
+    static constexpr double DWELL_FADE = 1.0 / 512;
+
+    struct Cell
+    {
+        mutex lock;
+        DecayingRate arrivals;
+        DecayingRate departures;
+        double dwell[DWELL_BUCKETS] = {};
+        double dwellWeight = 0.0;
+        double dwellMinutes = 0.0; // weighted sum
+    };
+
+    int floorCount;
+    double windowSeconds;
+    unique_ptr<Cell[]> cells;
+
+    Cell &cell(int floorIndex, int kind) const { return cells[floorIndex * KIND_COUNT + kind]; }
+
+    static double bucketStart(int b) { return exp2(b / 4.0) - 1.0; }
+
+public:
+    OccupancyStats(int floors, int windowMinutes)
+        : floorCount(floors), windowSeconds(max(1, windowMinutes) * 60.0), cells(new Cell[floors * KIND_COUNT])
+    {
+    }
+
+    void recordArrival(int floorIndex, int kind, time_t t)
+    {
+        Cell &target = cell(floorIndex, kind);
+        lock_guard<mutex> guard(target.lock);
+        target.arrivals.add(t, windowSeconds);
+    }
+
+    void recordDeparture(int floorIndex, int kind, time_t t, long long dwellSeconds)
+    {
+        Cell &target = cell(floorIndex, kind);
+        double minutes = max(0LL, dwellSeconds) / 60.0;
+        int bucket = min(DWELL_BUCKETS - 1, (int)(4 * log2(minutes + 1.0)));
+        lock_guard<mutex> guard(target.lock);
+        target.departures.add(t, windowSeconds);
+        for (double &weight : target.dwell)
+            weight *= 1.0 - DWELL_FADE;
+        target.dwell[bucket] += 1.0;
+        target.dwellWeight = target.dwellWeight * (1.0 - DWELL_FADE) + 1.0;
+        target.dwellMinutes = target.dwellMinutes * (1.0 - DWELL_FADE) + minutes;
+    }
+
+    // Lock-free; available is the pool's free slot count now, of capacity
+    FillForecast forecast(int floorIndex, int kind, int available, int capacity, time_t now, int horizonMinutes) const
+    {
+        const Cell &source = cell(floorIndex, kind);
+        FillForecast result;
+        result.available = available;
+        double in = source.arrivals.value(now, windowSeconds), out = source.departures.value(now, windowSeconds);
+        result.arrivalsPerHour = in * 3600;
+        result.departuresPerHour = out * 3600;
+        double netPerMinute = (in - out) * 60;
+        if (netPerMinute > 0)
+            result.minutesToFull = available / netPerMinute;
+        result.availableAtHorizon = min(capacity, max(0, (int)lround(available - netPerMinute * horizonMinutes)));
+        return result;
+    }
+
+    // Dwell time in minutes at quantile q across all floors, -1 before any exit
+    double dwellQuantile(int kind, double q) const
+    {
+        double buckets[DWELL_BUCKETS] = {}, total = 0;
+        for (int f = 0; f < floorCount; f++)
+        {
+            Cell &source = cell(f, kind);
+            lock_guard<mutex> guard(source.lock);
+            for (int b = 0; b < DWELL_BUCKETS; b++)
+                buckets[b] += source.dwell[b];
+            total += source.dwellWeight;
+        }
+        if (total <= 0)
+            return -1.0;
+        double target = q * total, seen = 0;
+        for (int b = 0; b < DWELL_BUCKETS; b++)
+        {
+            if (seen + buckets[b] >= target && buckets[b] > 0)
+                return bucketStart(b) + (bucketStart(b + 1) - bucketStart(b)) * (target - seen) / buckets[b];
+            seen += buckets[b];
+        }
+        return bucketStart(DWELL_BUCKETS);
+    }
+
+    double meanDwellMinutes(int kind) const
+    {
+        double weight = 0, minutes = 0;
+        for (int f = 0; f < floorCount; f++)
+        {
+            Cell &source = cell(f, kind);
+            lock_guard<mutex> guard(source.lock);
+            weight += source.dwellWeight;
+            minutes += source.dwellMinutes;
+        }
+        return weight > 0 ? minutes / weight : -1.0;
+    }
+
+    size_t memoryFootprint() const { return sizeof(*this) + floorCount * KIND_COUNT * sizeof(Cell); }
+};
+
+// ==================== Gate Results ====================
+enum ParkStatus
+{
+    PARK_OK,
+    PARK_INVALID_TYPE,
+    PARK_ALREADY_PARKED,
+    PARK_FULL
+};
+
+struct ParkResult
+{
+    ParkStatus status = PARK_INVALID_TYPE;
+    bool passHolder = false;
+    int floorNumber = 0;
+    int slotNumber = 0;
+    double hourlyRate = 0.0;
+    time_t entryTime = 0;
+};
+
+enum ExitStatus
+{
+    EXIT_OK,
+    EXIT_NO_TICKET,
+    EXIT_SLOT_EMPTY,
+    EXIT_PAYMENT_DUE // only from expressExit: no valid pass, so the vehicle must pay at a staffed lane
+};
+
+struct ExitResult
+{
+    ExitStatus status = EXIT_NO_TICKET;
+    bool passHolder = false;
+    int slotNumber = 0;
+    double hours = 0.0;
+    double hourlyRate = 0.0;
+    double amount = 0.0;
+};
+
+const char *parkStatusName(ParkStatus status)
+{
+    const char *names[] = {"ok", "invalid_type", "already_parked", "full"};
+    return names[status];
+}
+
+const char *exitStatusName(ExitStatus status)
+{
+    const char *names[] = {"ok", "no_ticket", "slot_empty", "payment_due"};
+    return names[status];
+}
+
+// ==================== Gate Events ====================
+// One camera or lane event for SmartParkingSystem::processEvents. detail is
+// the vehicle type of a PARK and the payment method of an EXIT; time is the
+// moment the camera saw the vehicle, 0 for now.
+enum GateEventType
+{
+    GATE_PARK,
+    GATE_EXIT,
+    GATE_PASS
+};
+
+struct GateEvent
+{
+    GateEventType type = GATE_PARK;
+    string vehicleNumber;
+    string detail;
+    time_t time = 0;
+};
+
+// Only the part matching the event's type is filled in
+struct GateOutcome
+{
+    ParkResult park;
+    ExitResult exit;
+    bool passIssued = false;
+    time_t passStart = 0;
+};
+
+// ==================== Bulk Import ====================
+struct PassImportReport
+{
+    size_t started = 0;    // new passes, or lapsed ones starting again today
+    size_t extended = 0;   // valid passes now running on from their expiry (extend only)
+    size_t unchanged = 0;  // valid passes left as they were
+    size_t duplicates = 0; // plates listed again; only the first counts
+    size_t rejected = 0;   // malformed lines, skipped
+};
+
+// Plates on an import list: letters, digits and dashes, at most 20
+bool isImportablePlate(string_view plate)
+{
+    if (plate.empty() || plate.size() > 20)
+        return false;
+    for (char c : plate)
+    {
+        if (!isalnum((unsigned char)c) && c != '-')
+            return false;
+    }
+    return true;
+}
+
+// ==================== Smart Parking System ====================
+// Gate operations (admitVehicle, releaseVehicle, issueMonthlyPass) are safe to
+// call from many lanes at once. The interactive wrappers around them print
+// tickets and receipts for a single operator.
+class SmartParkingSystem
+{
+private:
+    // A null ticket with busy set marks a plate whose entry is still in
+    // progress; busy on a real ticket marks an exit in progress
+    struct TicketEntry
+    {
+        Ticket *ticket;
+        bool busy;
+    };
+
+    vector<ParkingFloor *> floors;
+    int slotStride;
+    SlotAllocator *allocator;
+    PlateInterner plates;
+    IdTable<TicketEntry> activeTickets;
+    IdTable<MonthlyPass *> monthlyPasses;
+    atomic<double> totalRevenue;
+    TransactionHistory history;
+    ParkingConfig config;
+    ReservationBook reservations;
+    OccupancyStats occupancy;
+    Journal *journal;
+    long long snapshotLsn;
+    // Gate operations hold this shared; compaction takes it exclusively so the
+    // snapshot and its journal position describe the same instant
+    WriterFirstMutex stateLock;
+    atomic<bool> compacting;
+    // Signage listeners; lanes skip the lock entirely while there are none
+    shared_mutex listenersLock;
+    vector<pair<int, AvailabilityListener>> listeners;
+    int nextListenerId;
+    atomic<int> listenerCount;
+
+    // Exported by metricsText()
+    LogHistogram parkLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+    LogHistogram exitLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+    LogHistogram passLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+    LogHistogram batchLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+    LogHistogram snapshotLatency{LATENCY_SHIFT, LATENCY_BUCKETS};
+    LogHistogram checkpointPause{LATENCY_SHIFT, LATENCY_BUCKETS};
+    MetricCounter parkOutcomes[4];
+    MetricCounter exitOutcomes[4];
+    MetricCounter passHits[2]; // at entry, at exit
+    MetricCounter passesIssued;
+    MetricCounter batchEvents;
+    MetricCounter snapshotBytes;
+    double loadSeconds;
+    double replaySeconds;
+    long long replayedRecords;
+
+    // Site-local passes by expiry date. A renewal leaves its old entry
+    // behind; the sweep skips entries whose pass has since moved on.
+    typedef pair<time_t, PlateId> ExpiryEntry;
+    static const int SWEEP_STEP = 16;
+    mutex expiryLock;
+    priority_queue<ExpiryEntry, vector<ExpiryEntry>, greater<ExpiryEntry>> expiryQueue;
+    atomic<long long> nextExpiry; // earliest queued expiry, LLONG_MAX when none
+    // Archive lines for passes swept since the last compaction; their EXPIRE
+    // journal records cover them until compaction writes pass_archive.log
+    mutex archiveLock;
+    string pendingArchive;
+    MetricCounter passesRenewed;
+    MetricCounter passesArchived;
+    // The tariff in force, read by lanes without a lock. Replaced tariffs
+    // stay allocated until the system goes, as a lane may still be pricing
+    // an exit with one; swaps are rare and each is well under a megabyte.
+    atomic<const CompiledTariff *> tariff;
+    mutex tariffLock;
+    vector<unique_ptr<CompiledTariff>> tariffVersions;
+    MetricCounter tariffSwaps;
+    // What a checkpoint writes, copied as flat records at one journal
+    // position while gate traffic is held off; plates are resolved and the
+    // files written once traffic has resumed
+    struct CheckpointTicket
+    {
+        PlateId plate;
+        int slotNumber;
+        int kind;
+        double hourlyRate;
+        time_t entryTime;
+    };
+    struct CheckpointPass
+    {
+        PlateId plate;
+        time_t startDate;
+        time_t expiryDate;
+    };
+    struct Checkpoint
+    {
+        JournalCut journal;
+        bool journalIntact = true;
+        double revenue = 0;
+        size_t historyRows = 0;
+        string archive;
+        vector<Reservation> bookings;
+        vector<CheckpointTicket> tickets;
+        vector<CheckpointPass> passes;
+    };
+    mutex checkpointLock; // one checkpoint at a time
+    Checkpoint checkpoint; // reused under checkpointLock
+    // Compaction runs on its own thread, woken by the lane that finds the
+    // journal long enough
+    mutex compactorLock;
+    condition_variable compactorWake;
+    bool compactRequested;
+    bool shutDown;
+    thread compactor;
+
+    void countPark(const ParkResult &result)
+    {
+        parkOutcomes[result.status].add();
+        if (result.status == PARK_OK && result.passHolder)
+            passHits[0].add();
+    }
+
+    void countExit(const ExitResult &result)
+    {
+        exitOutcomes[result.status].add();
+        if (result.status == EXIT_OK && result.passHolder)
+            passHits[1].add();
+    }
+
+    // Gate steps shared by single events and batches, run under a shared
+    // stateLock. begin* does the work and adds the journal records to batch;
+    // the plate stays reserved or claimed until the caller has appended the
+    // batch and called finish*, so no lane can log a conflicting record
+    // first. Both begin* return nullptr when nothing is left to finish.
+    Ticket *beginAdmit(PlateId plate, const string &vehicleNum, int kind, time_t entry, JournalBatch &batch,
+                       ParkResult &result)
+    {
+        time_t passUntil = passExpiry(plate, vehicleNum);
+        result.passHolder = passUntil != 0;
+        // Reserving the plate first stops two lanes admitting the same vehicle
+        if (!activeTickets.insert(plate, TicketEntry{nullptr, true}))
+        {
+            result.status = PARK_ALREADY_PARKED;
+            return nullptr;
+        }
+
+        if (entry == 0)
+            entry = clock().now();
+        Vehicle *vehicle = createVehicle(kind, vehicleNum, entry);
+        SlotHandle handle = allocator->allocate(vehicle);
+        // A walk-in may not take the slots held for bookings due soon; the
+        // count already includes this vehicle, so racing lanes never overbook
+        if (handle.valid() && !reservations.empty() && !reservations.arrive(vehicleNum, kind, entry) &&
+            allocator->availableOf(kind) < reservations.held(kind, entry))
+        {
+            allocator->release(handle);
+            handle = SlotHandle();
+        }
+        if (!handle.valid())
+        {
+            delete vehicle;
+            activeTickets.erase(plate);
+            result.status = PARK_FULL;
+            return nullptr;
+        }
+
+        ParkingFloor *floor = floors[handle.floorIndex];
+        const CompiledTariff *current = tariff.load(memory_order_acquire);
+        Ticket *ticket = new Ticket(vehicleNum, floor->slotNumberAt(handle.position), current->hourlyRate(kind),
+                                    entry, handle);
+        ticket->setExitTerms(passUntil, current, current->weekMinute(entry));
+        occupancy.recordArrival(handle.floorIndex, kind, entry);
+        batch.record("PARK").add(vehicleNum).add((long long)ticket->getSlotNumber());
+        batch.addAmount(ticket->getHourlyRate()).add((long long)ticket->getEntryTime());
+
+        result.status = PARK_OK;
+        result.floorNumber = floor->getFloorNumber();
+        result.slotNumber = ticket->getSlotNumber();
+        result.hourlyRate = ticket->getHourlyRate();
+        result.entryTime = ticket->getEntryTime();
+        return ticket;
+    }
+
+    void finishAdmit(PlateId plate, Ticket *ticket)
+    {
+        activeTickets.update(plate, [&](TicketEntry *entry) {
+            *entry = TicketEntry{ticket, false};
+        });
+    }
+
+    // With passHoldersOnly the exit stops at EXIT_PAYMENT_DUE, the vehicle
+    // still parked, unless it holds a valid pass
+    Ticket *beginRelease(PlateId plate, const string &vehicleNum, const string &paymentMethod, time_t exitTime,
+                         JournalBatch &batch, ExitResult &result, bool passHoldersOnly = false)
+    {
+        // Claiming the ticket stops two lanes processing the same exit
+        Ticket *ticket = activeTickets.update(plate, [&](TicketEntry *entry) -> Ticket * {
+            if (!entry || entry->busy)
+                return nullptr;
+            entry->busy = true;
+            return entry->ticket;
+        });
+        if (!ticket)
+            return nullptr;
+        auto unclaim = [&](ExitStatus status) {
+            activeTickets.update(plate, [&](TicketEntry *entry) {
+                entry->busy = false;
+            });
+            result.status = status;
+        };
+
+        if (exitTime == 0)
+            exitTime = clock().now();
+        // The pass seen at entry settles most exits; a pass bought or
+        // renewed during the stay is still found by the lookup
+        result.passHolder = exitTime < ticket->getPassValidUntil() || hasValidPass(plate, vehicleNum);
+        result.slotNumber = ticket->getSlotNumber();
+        result.hourlyRate = ticket->getHourlyRate();
+        if (passHoldersOnly && !result.passHolder)
+        {
+            unclaim(EXIT_PAYMENT_DUE);
+            return nullptr;
+        }
+        SlotHandle handle = ticket->getSlotHandle();
+        Vehicle *vehicle = handle.valid() ? allocator->release(handle) : nullptr;
+        if (!vehicle)
+        {
+            unclaim(EXIT_SLOT_EMPTY);
+            return nullptr;
+        }
+        delete vehicle;
+
+        batch.record("EXIT").add(vehicleNum).add((long long)exitTime);
+        int kind = floors[handle.floorIndex]->slotKind(handle.position);
+        if (!result.passHolder)
+        {
+            // Priced by the tariff in force at exit, from the entry's terms
+            // unless it has changed since
+            const CompiledTariff *current = tariff.load(memory_order_acquire);
+            result.amount = current == ticket->getTariff()
+                                ? current->fee(kind, ticket->getEntryTime(), ticket->getTariffStartMinute(), exitTime,
+                                               &result.hours)
+                                : current->fee(kind, ticket->getEntryTime(), exitTime, &result.hours);
+            atomicAdd(totalRevenue, result.amount);
+            batch.record("PAY").addAmount(result.amount).add(paymentMethod);
+        }
+        history.append(exitTime, ticket->getSlotNumber(), kind, exitTime - ticket->getEntryTime(), result.amount,
+                       result.passHolder ? string_view("Pass") : string_view(paymentMethod), result.passHolder);
+        if (!reservations.empty())
+            reservations.depart(vehicleNum);
+        occupancy.recordDeparture(handle.floorIndex, kind, exitTime, exitTime - ticket->getEntryTime());
+        result.status = EXIT_OK;
+        return ticket;
+    }
+
+    void finishRelease(PlateId plate, Ticket *ticket)
+    {
+        activeTickets.erase(plate);
+        delete ticket;
+    }
+
+    bool issuePassLocked(const string &vehicleNum, time_t &startDate)
+    {
+        if (config.passDirectory)
+        {
+            if (!config.passDirectory->issue(vehicleNum, clock().now(), startDate))
+                return false;
+            passesIssued.add();
+            return true;
+        }
+        PlateId plate = plates.intern(vehicleNum);
+        return monthlyPasses.upsert(plate, [&](MonthlyPass *&pass, bool) {
+            if (pass && pass->checkValidity(clock().now()))
+                return false;
+            delete pass;
+            pass = new MonthlyPass(vehicleNum, clock().now());
+            startDate = pass->getStartDate();
+            indexExpiry(plate, pass->getExpiryDate());
+            passesIssued.add();
+            // Logged under the shard lock so replay sees purchases in order
+            JournalBatch &batch = laneBatch();
+            batch.record("PASS").add(vehicleNum).add((long long)startDate);
+            journal->append(batch);
+            return true;
+        });
+    }
+
+    ParkResult admitOne(const string &vehicleNum, int kind)
+    {
+        ParkResult result;
+        if (kind < 0 || kind >= KIND_COUNT)
+            return result;
+        PlateId plate = plates.intern(vehicleNum);
+
+        SlotHandle handle;
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            JournalBatch &batch = laneBatch();
+            Ticket *ticket = beginAdmit(plate, vehicleNum, kind, 0, batch, result);
+            if (!ticket)
+                return result;
+            journal->append(batch);
+            handle = ticket->getSlotHandle();
+            finishAdmit(plate, ticket);
+        }
+        notifyAvailability(handle, -1);
+        maybeSweepPasses();
+        maybeCompact();
+        return result;
+    }
+
+    ExitResult releaseOne(const string &vehicleNum, const string &paymentMethod, bool passHoldersOnly = false)
+    {
+        ExitResult result;
+        SlotHandle handle;
+        // A plate never interned has never parked
+        PlateId plate = plates.find(vehicleNum);
+        if (plate == NO_PLATE)
+            return result;
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            JournalBatch &batch = laneBatch();
+            Ticket *ticket = beginRelease(plate, vehicleNum, paymentMethod, 0, batch, result, passHoldersOnly);
+            if (!ticket)
+                return result;
+            journal->append(batch);
+            handle = ticket->getSlotHandle();
+            finishRelease(plate, ticket);
+        }
+        notifyAvailability(handle, +1);
+        maybeSweepPasses();
+        maybeCompact();
+        return result;
+    }
+
+    // Scratch record buffer for the calling lane, emptied on each use
+    static JournalBatch &laneBatch()
+    {
+        static thread_local JournalBatch batch;
+        batch.clear();
+        return batch;
+    }
+
+    // Called once a gate operation has let go of every lock, so a listener
+    // may safely call back into the system
+    void notifyAvailability(SlotHandle handle, int change)
+    {
+        if (listenerCount.load(memory_order_relaxed) == 0 || !handle.valid())
+            return;
+        ParkingFloor *floor = floors[handle.floorIndex];
+        AvailabilityDelta delta;
+        delta.floorNumber = floor->getFloorNumber();
+        delta.kind = floor->slotKind(handle.position);
+        delta.change = change;
+        delta.available = floor->availableOf(delta.kind);
+        shared_lock<shared_mutex> lock(listenersLock);
+        for (auto &listener : listeners)
+        {
+            listener.second(delta);
+        }
+    }
+
+    // Decodes a printed slot number; the handle is invalid if no such slot exists
+    SlotHandle resolveSlot(int slotNum) const
+    {
+        SlotHandle handle;
+        int floorIndex = slotNum / slotStride - 1;
+        int position = slotNum % slotStride - 1;
+        if (floorIndex < 0 || floorIndex >= (int)floors.size() || position < 0 ||
+            position >= floors[floorIndex]->getSlotCount())
+            return handle;
+        handle.floorIndex = floorIndex;
+        handle.position = position;
+        return handle;
+    }
+
+    // Returns the kind of the slot with this number, or -1 if there is none
+    int kindAtSlot(int slotNum) const
+    {
+        SlotHandle handle = resolveSlot(slotNum);
+        return handle.valid() ? floors[handle.floorIndex]->slotKind(handle.position) : -1;
+    }
+
+    // A ticket's kind is that of its slot; the rate is only a fallback for
+    // tickets whose slot has gone
+    int ticketKind(const Ticket *ticket) const
+    {
+        SlotHandle handle = ticket->getSlotHandle();
+        return handle.valid() ? floors[handle.floorIndex]->slotKind(handle.position)
+                              : vehicleKindFromRate(ticket->getHourlyRate());
+    }
+
+    // Re-parks a vehicle from a snapshot or journal record. Lanes log a park
+    // and an exit on the same slot in whichever order they finish, so a record
+    // for an occupied slot evicts the occupant; its own EXIT record then finds
+    // nothing to do. Replaying a record already applied changes nothing.
+    // A kind of -1 takes the slot's; a ticket whose slot is gone or now
+    // holds another type is dropped with a warning.
+    void restoreTicket(string vNum, int slotNum, int kind, double rate, time_t entry)
+    {
+        SlotHandle handle = resolveSlot(slotNum);
+        int slotKind = handle.valid() ? floors[handle.floorIndex]->slotKind(handle.position) : -1;
+        if (kind < 0)
+            kind = slotKind;
+        if (slotKind < 0 || kind != slotKind)
+        {
+            cerr << "✗ Warning: dropping the ticket for " << vNum << ": slot " << slotNum
+                 << (slotKind < 0 ? " does not exist" : " now holds another vehicle type") << endl;
+            return;
+        }
+
+        Vehicle *occupant = allocator->occupant(handle);
+        if (occupant)
+        {
+            if (occupant->getVehicleNumber() == vNum)
+                return;
+            dropTicket(occupant->getVehicleNumber());
+        }
+        dropTicket(vNum);
+
+        Vehicle *vehicle = createVehicle(kind, vNum, entry);
+        allocator->occupy(handle, vehicle);
+        activeTickets.insert(plates.intern(vNum), TicketEntry{new Ticket(vNum, slotNum, rate, entry, handle), false});
+        if (!reservations.empty())
+            reservations.arrive(vNum, kind, entry);
+    }
+
+    // Frees the slot and forgets the ticket, describing it in dropped if
+    // given; returns false if there was none
+    bool dropTicket(string vNum, TicketRecord *dropped = nullptr)
+    {
+        TicketEntry removed = {nullptr, false};
+        activeTickets.erase(plates.find(vNum), &removed);
+        Ticket *ticket = removed.ticket;
+        if (!ticket)
+            return false;
+
+        SlotHandle handle = ticket->getSlotHandle();
+        if (dropped)
+            *dropped = TicketRecord{vNum, ticket->getSlotNumber(), ticketKind(ticket), ticket->getHourlyRate(),
+                                    ticket->getEntryTime()};
+        Vehicle *vehicle = handle.valid() ? allocator->release(handle) : nullptr;
+        delete vehicle;
+        if (!reservations.empty())
+            reservations.depart(vNum);
+        delete ticket;
+        return true;
+    }
+
+    void restorePass(string vNum, time_t start)
+    {
+        if (config.passDirectory)
+        {
+            config.passDirectory->restore(vNum, start);
+            return;
+        }
+        restoreInterned(plates.intern(vNum), vNum, start);
+    }
+
+    // Restores a pass kept in this site's own table under its interned id.
+    // With expiries given, the new pass's expiry is collected there for
+    // indexExpiries instead of being queued now.
+    void restoreInterned(PlateId plate, string_view vNum, time_t start, vector<ExpiryEntry> *expiries = nullptr)
+    {
+        // Start dates only move forward, so the later record wins whatever
+        // order the journal holds them in
+        monthlyPasses.upsert(plate, [&](MonthlyPass *&pass, bool) {
+            if (pass && pass->getStartDate() >= start)
+                return;
+            delete pass;
+            pass = new MonthlyPass(string(vNum), start);
+            if (expiries)
+                expiries->push_back(ExpiryEntry(pass->getExpiryDate(), plate));
+            else
+                indexExpiry(plate, pass->getExpiryDate());
+        });
+    }
+
+    // Replays a swept pass; a pass renewed since then stays. Records newer
+    // than the snapshot were never written to the archive file, so they go
+    // back on the pending list.
+    void expirePass(const string &vNum, time_t start)
+    {
+        MonthlyPass *removed = nullptr;
+        monthlyPasses.eraseIf(plates.find(vNum), [&](MonthlyPass *pass) {
+            return pass && pass->getStartDate() == start;
+        }, &removed);
+        if (!removed)
+            return;
+        archivePass(*removed);
+        delete removed;
+    }
+
+    void archivePass(const MonthlyPass &pass)
+    {
+        lock_guard<mutex> guard(archiveLock);
+        pendingArchive += pass.getVehicleNumber() + "," + to_string(pass.getStartDate()) + "," +
+                          to_string(pass.getExpiryDate()) + "\n";
+    }
+
+    void indexExpiry(PlateId plate, time_t expiry)
+    {
+        lock_guard<mutex> guard(expiryLock);
+        expiryQueue.push(ExpiryEntry(expiry, plate));
+        nextExpiry = expiryQueue.top().first;
+    }
+
+    // Queues many expiries at once, rebuilding the heap in one pass rather
+    // than sifting each one in; entries is consumed
+    void indexExpiries(vector<ExpiryEntry> &entries)
+    {
+        lock_guard<mutex> guard(expiryLock);
+        for (; !expiryQueue.empty(); expiryQueue.pop())
+            entries.push_back(expiryQueue.top());
+        expiryQueue = decltype(expiryQueue)(greater<ExpiryEntry>(), move(entries));
+        nextExpiry = expiryQueue.empty() ? LLONG_MAX : (long long)expiryQueue.top().first;
+    }
+
+    // Moves up to limit passes that expired by now out of the pass table,
+    // journaling an EXPIRE record for each; the caller holds stateLock
+    // shared. Nothing is written to the archive file here, so sweeping costs
+    // a gate operation no extra fsync.
+    size_t sweepPasses(time_t now, size_t limit)
+    {
+        vector<ExpiryEntry> due;
+        {
+            lock_guard<mutex> guard(expiryLock);
+            while (!expiryQueue.empty() && expiryQueue.top().first <= now && due.size() < limit)
+            {
+                due.push_back(expiryQueue.top());
+                expiryQueue.pop();
+            }
+            nextExpiry = expiryQueue.empty() ? LLONG_MAX : (long long)expiryQueue.top().first;
+        }
+
+        JournalBatch &batch = laneBatch();
+        for (auto &entry : due)
+        {
+            MonthlyPass *removed = nullptr;
+            // Renewed passes have a later expiry and their own queue entry
+            monthlyPasses.eraseIf(entry.second, [&](MonthlyPass *pass) {
+                return pass && pass->getExpiryDate() == entry.first;
+            }, &removed);
+            if (!removed)
+                continue;
+            batch.record("EXPIRE").add(removed->getVehicleNumber()).add((long long)removed->getStartDate());
+            archivePass(*removed);
+            delete removed;
+        }
+        if (batch.size() == 0)
+            return 0;
+        journal->append(batch);
+        passesArchived.add(batch.size());
+        return batch.size();
+    }
+
+    // Gate operations archive a few expired passes each once the earliest
+    // expiry has passed, so no single operation pays for a large sweep
+    void maybeSweepPasses()
+    {
+        if (nextExpiry.load(memory_order_relaxed) > clock().now())
+            return;
+        shared_lock<WriterFirstMutex> gate(stateLock);
+        sweepPasses(clock().now(), SWEEP_STEP);
+    }
+
+    // Sites sharing a pass directory check it by plate string; it never
+    // locks, so checks from other sites do not slow this one down
+    bool hasValidPass(PlateId plate, const string &vehicleNum) const { return passExpiry(plate, vehicleNum) != 0; }
+
+    // When the plate's pass runs out, or 0 if it has no valid one now
+    time_t passExpiry(PlateId plate, const string &vehicleNum) const
+    {
+        time_t now = clock().now();
+        if (config.passDirectory)
+            return config.passDirectory->validUntil(vehicleNum, now);
+        return monthlyPasses.read(plate, [&](MonthlyPass *const *pass) {
+            return pass && (*pass)->checkValidity(now) ? (*pass)->getExpiryDate() : (time_t)0;
+        });
+    }
+
+    const Clock &clock() const { return config.clock ? *config.clock : systemClock(); }
+
+    string dataPath(const string &name) const
+    {
+        return config.dataDir.empty() ? name : config.dataDir + "/" + name;
+    }
+
+    // Loads parking_snapshot.bin, or the legacy text files if no binary
+    // snapshot has been written yet
+    void loadSnapshot()
+    {
+        string path = dataPath("parking_snapshot.bin");
+        SnapshotReader reader;
+        string error;
+        if (reader.open(path, error))
+        {
+            // Sized from the header up front, so the tables never rehash,
+            // passes come from slabs carved in one go and the expiry queue
+            // is built once at the end
+            plates.reserve(reader.ticketCount() + reader.passCount());
+            activeTickets.reserve(reader.ticketCount());
+            if (!config.passDirectory)
+            {
+                monthlyPasses.reserve(reader.passCount());
+                passPool().reserve(reader.passCount());
+            }
+            for (size_t i = 0; i < reader.ticketCount(); i++)
+            {
+                const SnapshotTicket &t = reader.ticket(i);
+                restoreTicket(string(reader.plate(t.plateOffset, t.plateLength)),
+                              t.slotNumber, t.kind, t.hourlyRate, t.entryTime);
+            }
+            vector<string_view> passPlates(reader.passCount());
+            for (size_t i = 0; i < reader.passCount(); i++)
+                passPlates[i] = reader.plate(reader.pass(i).plateOffset, reader.pass(i).plateLength);
+            if (config.passDirectory)
+            {
+                for (size_t i = 0; i < reader.passCount(); i++)
+                    restorePass(string(passPlates[i]), reader.pass(i).startDate);
+            }
+            else
+            {
+                vector<PlateId> ids;
+                vector<ExpiryEntry> expiries;
+                plates.internAll(passPlates, ids);
+                expiries.reserve(reader.passCount());
+                for (size_t i = 0; i < reader.passCount(); i++)
+                    restoreInterned(ids[i], passPlates[i], reader.pass(i).startDate, &expiries);
+                indexExpiries(expiries);
+            }
+            totalRevenue = reader.totalRevenue();
+            snapshotLsn = reader.lastLsn();
+            return;
+        }
+        if (filesystem::exists(path))
+        {
+            cerr << "✗ Warning: ignoring " << path << " (" << error << ")" << endl;
+        }
+        loadTextSnapshot();
+    }
+
+    void loadTextSnapshot()
+    {
+        vector<TicketRecord> tickets;
+        vector<PassRecord> passes;
+        double revenue = 0.0;
+        readTextTickets(dataPath("parking_tickets.txt"), tickets);
+        readTextPasses(dataPath("monthly_passes.txt"), passes);
+        readTextRevenue(dataPath("revenue.txt"), revenue, snapshotLsn);
+        totalRevenue = revenue;
+        for (auto &t : tickets)
+            restoreTicket(t.vehicleNumber, t.slotNumber, t.kind, t.hourlyRate, t.entryTime);
+        for (auto &p : passes)
+            restorePass(p.vehicleNumber, p.startDate);
+    }
+
+    // Revenue and the last journal record the snapshot covers are written
+    // together, so replay never counts a payment twice
+    static array<int, KIND_COUNT> garageSlots(int numFloors, const ParkingConfig &cfg)
+    {
+        array<int, KIND_COUNT> slots = cfg.slotsPerFloor;
+        for (int &count : slots)
+            count *= numFloors;
+        return slots;
+    }
+
+    // Reads "id,vehicle,type,start,end" from five fields
+    static bool parseReservation(const string_view *f, Reservation &booking)
+    {
+        booking.kind = vehicleKindFromName(string(f[2]));
+        booking.vehicleNumber.assign(f[1]);
+        booking.arrived = false;
+        return parseField(f[0], booking.id) && booking.id > 0 && !f[1].empty() && booking.kind >= 0 &&
+               parseField(f[3], booking.start) && parseField(f[4], booking.end) && booking.start < booking.end;
+    }
+
+    // Live bookings as of the last compaction; whether a booked vehicle has
+    // arrived follows from the tickets restored after it
+    void loadReservations()
+    {
+        LineReader reader(dataPath("reservations.txt"));
+        if (!reader.isOpen())
+            return;
+        ParseErrors errors(dataPath("reservations.txt"));
+        string_view line, f[5];
+        Reservation booking;
+        time_t now = clock().now();
+        while (reader.next(line))
+        {
+            if (line.empty())
+                continue;
+            if (splitFields(line, f, 5) != 5 || !parseReservation(f, booking))
+                errors.add(reader.getLineNumber(), "expected id,vehicle,type,start,end");
+            else
+                reservations.restore(booking, now);
+        }
+        errors.summarize();
+    }
+
+    // Rewrites reservations.txt, synced before the snapshot that lets the
+    // journal's RESERVE and CANCEL records go
+    bool writeReservations(const vector<Reservation> &bookings)
+    {
+        string text;
+        for (auto &booking : bookings)
+        {
+            text += to_string(booking.id) + "," + booking.vehicleNumber + "," + VEHICLE_KIND_NAMES[booking.kind] +
+                    "," + to_string(booking.start) + "," + to_string(booking.end) + "\n";
+        }
+        string path = dataPath("reservations.txt");
+        if (text.empty())
+        {
+            error_code ec;
+            filesystem::remove(path, ec);
+            return !ec;
+        }
+        if (replaceFileDurably(path, {text}))
+            return true;
+        cerr << "✗ Warning: could not write " << path << endl;
+        return false;
+    }
+
+    bool saveSnapshot(const Checkpoint &cut)
+    {
+        LatencyTimer timer(snapshotLatency);
+        SnapshotWriter writer;
+        for (auto &t : cut.tickets)
+            writer.addTicket(plates.name(t.plate), t.slotNumber, t.kind, t.hourlyRate, t.entryTime);
+        for (auto &p : cut.passes)
+            writer.addPass(plates.name(p.plate), p.startDate, p.expiryDate);
+        if (!writer.write(dataPath("parking_snapshot.bin"), cut.revenue, cut.journal.lsn))
+        {
+            cerr << "✗ Warning: could not write " << dataPath("parking_snapshot.bin") << endl;
+            return false;
+        }
+        error_code ec;
+        snapshotBytes.add(filesystem::file_size(dataPath("parking_snapshot.bin"), ec));
+        return true;
+    }
+
+    // Applies journal records newer than the snapshot
+    void replayJournal()
+    {
+        LineReader reader(dataPath("parking_journal.log"));
+        if (!reader.isOpen())
+            return;
+        ParseErrors errors(dataPath("parking_journal.log"));
+
+        // An exit's PAY record directly follows its EXIT record; the history
+        // row is added once the next record shows whether it was paid
+        bool exitPending = false;
+        TicketRecord exited;
+        time_t exitTime = 0;
+        double exitAmount = 0;
+        string exitMethod;
+        auto recordExit = [&]() {
+            if (exitPending)
+                history.append(exitTime, exited.slotNumber, exited.kind, exitTime - exited.entryTime, exitAmount,
+                               exitMethod.empty() ? "Pass" : exitMethod, exitMethod.empty());
+            exitPending = false;
+        };
+
+        string_view line, f[7];
+        bool complete;
+        Reservation booking;
+        uint64_t intactBytes = 0;
+        // A torn final write leaves a line without its newline
+        while (reader.next(line, &complete) && complete)
+        {
+            intactBytes = reader.getOffset();
+            size_t count = min<size_t>(splitFields(line, f, 7), 7);
+            string_view type = count >= 2 ? f[1] : string_view();
+            long long lsn, time = 0;
+            int slotNum = 0;
+            double amount = 0;
+            // Every field a record's replay reads must parse, or the whole
+            // record is skipped
+            bool ok = count >= 2 && parseField(f[0], lsn);
+            if (type == "PARK")
+                ok = ok && count >= 6 && parseField(f[3], slotNum) && parseField(f[4], amount) &&
+                     parseField(f[5], time);
+            else if (type == "EXIT")
+                ok = ok && count >= 3 && (count < 4 || parseField(f[3], time));
+            else if (type == "PAY")
+                ok = ok && count >= 3 && parseField(f[2], amount);
+            else if (type == "PASS" || type == "EXPIRE")
+                ok = ok && count >= 4 && parseField(f[3], time);
+            else if (type == "RESERVE")
+                ok = ok && count >= 7 && parseReservation(f + 2, booking);
+            else if (type == "CANCEL")
+                ok = ok && count >= 3 && parseField(f[2], booking.id);
+            else
+                ok = false;
+            if (!ok)
+            {
+                errors.add(reader.getLineNumber(), "malformed record");
+                continue;
+            }
+            if (lsn <= snapshotLsn)
+                continue;
+            snapshotLsn = lsn;
+            replayedRecords++;
+            if (type != "PAY")
+                recordExit();
+
+            if (type == "PARK")
+                restoreTicket(string(f[2]), slotNum, kindAtSlot(slotNum), amount, time);
+            else if (type == "EXIT")
+            {
+                // Exits the history file already holds are not added twice
+                exitPending = dropTicket(string(f[2]), &exited) && count >= 4 && lsn > history.getLastLsn();
+                exitTime = exitPending ? time : 0;
+                exitAmount = 0;
+                exitMethod.clear();
+            }
+            else if (type == "PAY")
+            {
+                atomicAdd(totalRevenue, amount);
+                if (exitPending && count >= 4)
+                {
+                    exitAmount = amount;
+                    exitMethod.assign(f[3]);
+                }
+            }
+            else if (type == "PASS")
+                restorePass(string(f[2]), time);
+            else if (type == "EXPIRE")
+                expirePass(string(f[2]), time);
+            else if (type == "RESERVE")
+                reservations.restore(booking, clock().now());
+            else
+                reservations.cancel(booking.id);
+        }
+        recordExit();
+        errors.summarize();
+        // Cut the torn record off, or the next append would run on from it
+        error_code ec;
+        uint64_t fileBytes = filesystem::file_size(dataPath("parking_journal.log"), ec);
+        if (!ec && fileBytes > intactBytes)
+        {
+            cerr << "✗ Warning: dropping a torn record at the end of " << dataPath("parking_journal.log") << endl;
+            filesystem::resize_file(dataPath("parking_journal.log"), intactBytes, ec);
+        }
+    }
+
+    // Called after a gate operation has dropped its shared state lock; the
+    // lane only wakes the compactor, it never writes the snapshot itself
+    void maybeCompact()
+    {
+        if (config.journal.compactEveryRecords <= 0 ||
+            journal->getRecordsSinceReset() < config.journal.compactEveryRecords)
+            return;
+        bool expected = false;
+        if (!compacting.compare_exchange_strong(expected, true))
+            return;
+        {
+            lock_guard<mutex> guard(compactorLock);
+            compactRequested = true;
+        }
+        compactorWake.notify_one();
+    }
+
+    void compactorLoop()
+    {
+        unique_lock<mutex> guard(compactorLock);
+        while (true)
+        {
+            compactorWake.wait(guard, [&]() { return compactRequested || shutDown; });
+            if (shutDown)
+                return;
+            compactRequested = false;
+            guard.unlock();
+            compact();
+            compacting = false;
+            guard.lock();
+        }
+    }
+
+    // Folds the journal into a fresh snapshot and drops the records it
+    // covers; expired passes are archived first so the snapshot only carries
+    // live ones. Gate traffic waits while the checkpoint is copied, not
+    // while it is written.
+    bool compact()
+    {
+        lock_guard<mutex> serial(checkpointLock);
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            sweepPasses(clock().now(), SIZE_MAX);
+        }
+        {
+            unique_lock<WriterFirstMutex> exclusive(stateLock);
+            takeCheckpoint(checkpoint);
+        }
+        return writeCheckpoint(checkpoint);
+    }
+
+    // Copies everything the checkpoint files hold as of the journal's last
+    // record; the caller holds stateLock exclusively, so no lane is midway
+    // through an operation
+    void takeCheckpoint(Checkpoint &cut)
+    {
+        LatencyTimer timer(checkpointPause);
+        cut.journalIntact = journal->cut(cut.journal);
+        cut.revenue = totalRevenue;
+        cut.historyRows = history.size();
+        {
+            lock_guard<mutex> guard(archiveLock);
+            cut.archive.clear();
+            cut.archive.swap(pendingArchive);
+        }
+        cut.bookings.clear();
+        reservations.forEach([&](const Reservation &booking) {
+            cut.bookings.push_back(booking);
+        });
+        cut.tickets.clear();
+        activeTickets.forEach([&](PlateId plate, const TicketEntry &entry) {
+            Ticket *t = entry.ticket;
+            if (t)
+                cut.tickets.push_back(CheckpointTicket{plate, t->getSlotNumber(), ticketKind(t),
+                                                       t->getHourlyRate(), t->getEntryTime()});
+        });
+        cut.passes.clear();
+        monthlyPasses.forEach([&](PlateId plate, MonthlyPass *p) {
+            cut.passes.push_back(CheckpointPass{plate, p->getStartDate(), p->getExpiryDate()});
+        });
+    }
+
+    // Every file but the journal is replaced or appended whole and synced
+    // before the snapshot that lets the journal's records for it go; the
+    // journal is cut last, so a crash at any point restarts from a snapshot
+    // and the records after it. If any of them fails, neither the snapshot
+    // nor the journal moves on, and the journal keeps the only copy.
+    bool writeCheckpoint(const Checkpoint &cut)
+    {
+        bool ok = writeArchive(cut.archive);
+        if (!ok)
+        {
+            // Queued again so the next checkpoint archives them before the
+            // journal records for them go
+            lock_guard<mutex> guard(archiveLock);
+            pendingArchive.insert(0, cut.archive);
+        }
+        // The block's LSN keeps replay from adding its exits again if the
+        // snapshot never lands
+        if (ok && !history.persist(dataPath("transaction_history.col"), cut.journal.lsn, cut.historyRows))
+        {
+            cerr << "✗ Warning: could not write " << dataPath("transaction_history.col") << endl;
+            ok = false;
+        }
+        ok = ok && writeReservations(cut.bookings) && saveSnapshot(cut);
+        // After a failed journal write the snapshot still saves the records
+        // that never reached it, but the journal itself is left alone
+        if (ok && (!cut.journalIntact || !journal->dropThrough(cut.journal)))
+        {
+            cerr << "✗ Warning: could not cut " << dataPath("parking_journal.log") << endl;
+            ok = false;
+        }
+        writeMetricsFile();
+        return ok;
+    }
+
+    // Appends the passes swept before a checkpoint to pass_archive.log;
+    // synced before the snapshot that forgets them
+    bool writeArchive(const string &lines)
+    {
+        if (lines.empty())
+            return true;
+        int fd = openAppendFile(dataPath("pass_archive.log"), false);
+        bool ok = fd >= 0 && writeAll(fd, lines.data(), lines.size());
+        if (fd >= 0)
+        {
+            ok = syncFile(fd) && ok;
+            closeFile(fd);
+        }
+        if (!ok)
+            cerr << "✗ Warning: could not write " << dataPath("pass_archive.log") << endl;
+        return ok;
+    }
+
+    // Replaces the metrics file only once the new one is written whole and
+    // synced, so a failed write leaves the last good one for the scraper
+    void writeMetricsFile()
+    {
+        if (config.metricsFile.empty())
+            return;
+        string path = dataPath(config.metricsFile);
+        if (!replaceFileDurably(path, {metricsText()}))
+            cerr << "✗ Warning: could not write " << path << endl;
+    }
+
+public:
+    SmartParkingSystem(int numFloors, ParkingConfig cfg = ParkingConfig())
+        : totalRevenue(0.0), config(cfg), reservations(cfg.reservations, garageSlots(numFloors, cfg)),
+          occupancy(numFloors, cfg.forecastWindowMinutes), snapshotLsn(0), compacting(false), nextListenerId(1),
+          listenerCount(0), loadSeconds(0), replaySeconds(0), replayedRecords(0), nextExpiry(LLONG_MAX),
+          tariff(nullptr), compactRequested(false), shutDown(false)
+    {
+        setTariff(config.tariff);
+        string tariffError;
+        if (!reloadTariff(tariffError) && !tariffError.empty())
+            cerr << "✗ Warning: kept the " << config.tariff.name << " tariff, " << tariffError << endl;
+        slotStride = slotNumberStride(config.slotsPerFloorTotal());
+        for (int i = 1; i <= numFloors; i++)
+        {
+            floors.push_back(new ParkingFloor(i, config.slotsPerFloor, slotStride));
+        }
+        allocator = new SlotAllocator(floors, config.allocation, config.slotDistance);
+        auto start = chrono::steady_clock::now();
+        history.load(dataPath("transaction_history.col"));
+        loadReservations();
+        loadSnapshot();
+        loadSeconds = nanosSince(start) / 1e9;
+        start = chrono::steady_clock::now();
+        replayJournal();
+        replaySeconds = nanosSince(start) / 1e9;
+        journal = new Journal(dataPath("parking_journal.log"), config.journal, snapshotLsn + 1);
+        if (config.journal.compactEveryRecords > 0)
+            compactor = thread(&SmartParkingSystem::compactorLoop, this);
+    }
+
+    ~SmartParkingSystem()
+    {
+        shutdown();
+        delete journal;
+
+        activeTickets.forEach([](PlateId, const TicketEntry &entry) {
+            delete entry.ticket;
+        });
+        monthlyPasses.forEach([](PlateId, MonthlyPass *pass) {
+            delete pass;
+        });
+        delete allocator;
+        for (auto floor : floors)
+        {
+            delete floor;
+        }
+    }
+
+    // Returns once every gate operation that has returned is on disk; false
+    // if a journal write has failed
+    bool flush() { return journal->flush(); }
+
+    // Writes a checkpoint on the calling thread, e.g. before maintenance;
+    // gate traffic only waits while it is copied. False if it could not be
+    // written whole, in which case the journal was kept.
+    bool checkpointNow() { return compact(); }
+
+    // Stops background compaction and folds the journal into a final
+    // snapshot, so the next start has nothing to replay. Gate operations must
+    // have stopped; the destructor calls it if the owner has not.
+    void shutdown()
+    {
+        {
+            lock_guard<mutex> guard(compactorLock);
+            if (shutDown)
+                return;
+            shutDown = true;
+        }
+        compactorWake.notify_one();
+        if (compactor.joinable())
+            compactor.join();
+        compact();
+    }
+
+    // Compiles the rules off the gate path, then swaps them in with one
+    // store; exits already pricing with the old tariff finish with it
+    void setTariff(const TariffRules &rules)
+    {
+        unique_ptr<CompiledTariff> compiled(new CompiledTariff(rules));
+        lock_guard<mutex> lock(tariffLock);
+        if (!tariffVersions.empty())
+            tariffSwaps.add();
+        tariff.store(compiled.get(), memory_order_release);
+        tariffVersions.push_back(move(compiled));
+    }
+
+    // Re-reads parking_tariff.txt from the data directory. The running
+    // tariff stays if the file is bad, or missing (error left empty).
+    bool reloadTariff(string &error)
+    {
+        error.clear();
+        ifstream file(dataPath("parking_tariff.txt"));
+        if (!file.is_open())
+            return false;
+        TariffRules rules;
+        if (!readTariffRules(file, rules, error))
+        {
+            error = dataPath("parking_tariff.txt") + " " + error;
+            return false;
+        }
+        setTariff(rules);
+        return true;
+    }
+
+    const CompiledTariff &currentTariff() const { return *tariff.load(memory_order_acquire); }
+
+    // Assigns a slot and issues a ticket
+    ParkResult admitVehicle(string vehicleNum, string vehicleType)
+    {
+        LatencyTimer timer(parkLatency);
+        ParkResult result = admitOne(vehicleNum, vehicleKindFromName(vehicleType));
+        countPark(result);
+        return result;
+    }
+
+    // For callers that already know the kind, e.g. a camera's vehicle class
+    ParkResult admitVehicle(const string &vehicleNum, VehicleKind kind)
+    {
+        LatencyTimer timer(parkLatency);
+        ParkResult result = admitOne(vehicleNum, kind);
+        countPark(result);
+        return result;
+    }
+
+    // Frees the slot, charges non pass holders and closes the ticket
+    ExitResult releaseVehicle(string vehicleNum, string paymentMethod)
+    {
+        LatencyTimer timer(exitLatency);
+        ExitResult result = releaseOne(vehicleNum, paymentMethod);
+        countExit(result);
+        return result;
+    }
+
+    // Unattended pass lane: lets a pass holder out with just the EXIT
+    // record, and answers EXIT_PAYMENT_DUE, leaving the vehicle parked, for
+    // anyone who would have to pay
+    ExitResult expressExit(const string &vehicleNum)
+    {
+        LatencyTimer timer(exitLatency);
+        static const string passLane = "Pass";
+        ExitResult result = releaseOne(vehicleNum, passLane, true);
+        countExit(result);
+        return result;
+    }
+
+    // Returns false if the vehicle already holds a valid pass
+    bool issueMonthlyPass(string vehicleNum, time_t &startDate)
+    {
+        LatencyTimer timer(passLatency);
+        bool issued;
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            issued = issuePassLocked(vehicleNum, startDate);
+        }
+        maybeSweepPasses();
+        maybeCompact();
+        return issued;
+    }
+
+    // Extends every vehicle's pass by one period with a single journal
+    // write: a valid pass runs on from its expiry, a lapsed or missing one
+    // starts now. startDates receives the new start of each period.
+    void renewMonthlyPasses(const vector<string> &vehicleNums, vector<time_t> &startDates)
+    {
+        LatencyTimer timer(passLatency);
+        time_t now = clock().now();
+        if (config.passDirectory)
+        {
+            config.passDirectory->renew(vehicleNums, now, startDates);
+            passesRenewed.add(vehicleNums.size());
+            return;
+        }
+        startDates.assign(vehicleNums.size(), 0);
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            JournalBatch batch;
+            for (size_t i = 0; i < vehicleNums.size(); i++)
+            {
+                PlateId plate = plates.intern(vehicleNums[i]);
+                monthlyPasses.upsert(plate, [&](MonthlyPass *&pass, bool) {
+                    startDates[i] = (pass && pass->checkValidity(now)) ? pass->getExpiryDate() : now;
+                    delete pass;
+                    pass = new MonthlyPass(vehicleNums[i], startDates[i]);
+                    indexExpiry(plate, pass->getExpiryDate());
+                });
+                batch.record("PASS").add(vehicleNums[i]).add((long long)startDates[i]);
+            }
+            if (batch.size() > 0)
+                journal->append(batch);
+        }
+        passesRenewed.add(vehicleNums.size());
+        maybeCompact();
+    }
+
+    // Bulk-loads a contract's plates, one "plate[,anything]" line each; a
+    // "plate" header line is skipped. Every line is validated first, then the
+    // passes go in with one journal write that is on disk before this
+    // returns. Plates that already hold a valid pass are left alone, so
+    // loading the same file twice changes nothing; with extend they run on
+    // from their expiry, as renewMonthlyPasses does. False if the file
+    // cannot be read.
+    bool importPasses(const string &path, PassImportReport &report, bool extend = false)
+    {
+        LineReader reader(path);
+        if (!reader.isOpen())
+            return false;
+        ParseErrors errors(path);
+        vector<string> accepted;
+        vector<bool> listed; // by plate id, to spot repeats
+        string_view line, f[1];
+        while (reader.next(line))
+        {
+            splitFields(line, f, 1);
+            string_view plate = f[0];
+            while (!plate.empty() && plate.front() == ' ')
+                plate.remove_prefix(1);
+            while (!plate.empty() && plate.back() == ' ')
+                plate.remove_suffix(1);
+            if (line.empty() || (reader.getLineNumber() == 1 && (plate == "plate" || plate == "Plate")))
+                continue;
+            if (!isImportablePlate(plate))
+            {
+                errors.add(reader.getLineNumber(), "expected a plate of letters, digits and dashes");
+                continue;
+            }
+            PlateId id = plates.intern(plate);
+            if (id >= listed.size())
+                listed.resize(max<size_t>(id + 1, listed.size() * 2));
+            if (listed[id])
+            {
+                report.duplicates++;
+                continue;
+            }
+            listed[id] = true;
+            if (!extend && hasValidPass(id, string(plate)))
+            {
+                report.unchanged++;
+                continue;
+            }
+            accepted.emplace_back(plate);
+        }
+        errors.summarize();
+        report.rejected = errors.getCount();
+
+        time_t now = clock().now();
+        vector<time_t> startDates;
+        renewMonthlyPasses(accepted, startDates);
+        // Renewals go to the directory's journal when the passes are shared
+        flush();
+        if (config.passDirectory)
+            config.passDirectory->flush();
+        for (time_t start : startDates)
+        {
+            if (start > now)
+                report.extended++;
+            else
+                report.started++;
+        }
+        return true;
+    }
+
+    // Streams the parked vehicles as CSV, one table shard locked at a time;
+    // returns the rows written
+    size_t exportTicketsCsv(ostream &out) const
+    {
+        out << "plate,type,floor,slot,rate,entry_time\n";
+        size_t written = 0;
+        activeTickets.forEach([&](PlateId, const TicketEntry &entry) {
+            const Ticket *t = entry.ticket;
+            if (!t)
+                return;
+            SlotHandle handle = t->getSlotHandle();
+            out << t->getVehicleNumber() << "," << VEHICLE_KIND_NAMES[ticketKind(t)] << ","
+                << (handle.valid() ? floors[handle.floorIndex]->getFloorNumber() : 0) << "," << t->getSlotNumber()
+                << "," << formatAmount(t->getHourlyRate()) << "," << t->getEntryTime() << "\n";
+            written++;
+        });
+        return written;
+    }
+
+    // Streams the passes on record (the shared directory's, if the site uses
+    // one) as CSV; returns the rows written
+    size_t exportPassesCsv(ostream &out) const
+    {
+        out << "plate,start,expiry\n";
+        size_t written = 0;
+        auto writeRow = [&](const string &plate, time_t start, time_t expiry) {
+            out << plate << "," << start << "," << expiry << "\n";
+            written++;
+        };
+        if (config.passDirectory)
+            config.passDirectory->forEach([&](const string &plate, time_t start) {
+                writeRow(plate, start, MonthlyPass(plate, start).getExpiryDate());
+            });
+        else
+            monthlyPasses.forEach([&](PlateId, MonthlyPass *p) {
+                writeRow(p->getVehicleNumber(), p->getStartDate(), p->getExpiryDate());
+            });
+        return written;
+    }
+
+    // Archives every pass that has expired by now; returns how many. Gate
+    // operations already do this a few passes at a time.
+    size_t sweepExpiredPasses()
+    {
+        size_t swept;
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            swept = sweepPasses(clock().now(), SIZE_MAX);
+        }
+        maybeCompact();
+        return swept;
+    }
+
+    // Runs a burst of gate events under one hold of the state lock. Records
+    // are journaled with one write (and at most one group commit) per run of
+    // events on distinct plates; a plate seen twice ends the run first.
+    // Listeners hear about every change once the whole batch is done.
+    void processEvents(const vector<GateEvent> &events, vector<GateOutcome> &outcomes)
+    {
+        LatencyTimer timer(batchLatency);
+        batchEvents.add(events.size());
+        outcomes.assign(events.size(), GateOutcome());
+        vector<pair<SlotHandle, int>> deltas;
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            JournalBatch batch;
+            vector<pair<PlateId, Ticket *>> pendingParks, pendingExits;
+            unordered_set<PlateId> pendingPlates;
+            auto flush = [&]() {
+                if (batch.size() > 0)
+                    journal->append(batch);
+                batch.clear();
+                for (auto &park : pendingParks)
+                    finishAdmit(park.first, park.second);
+                for (auto &exit : pendingExits)
+                    finishRelease(exit.first, exit.second);
+                pendingParks.clear();
+                pendingExits.clear();
+                pendingPlates.clear();
+            };
+
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                const GateEvent &event = events[i];
+                GateOutcome &outcome = outcomes[i];
+                PlateId plate = event.type == GATE_EXIT ? plates.find(event.vehicleNumber)
+                                                        : plates.intern(event.vehicleNumber);
+                if (plate != NO_PLATE && pendingPlates.count(plate))
+                    flush();
+
+                if (event.type == GATE_PARK)
+                {
+                    int kind = vehicleKindFromName(event.detail);
+                    if (kind < 0)
+                        continue;
+                    Ticket *ticket = beginAdmit(plate, event.vehicleNumber, kind, event.time, batch, outcome.park);
+                    if (!ticket)
+                        continue;
+                    pendingParks.push_back(make_pair(plate, ticket));
+                    pendingPlates.insert(plate);
+                    deltas.push_back(make_pair(ticket->getSlotHandle(), -1));
+                }
+                else if (event.type == GATE_EXIT)
+                {
+                    if (plate == NO_PLATE)
+                        continue;
+                    Ticket *ticket = beginRelease(plate, event.vehicleNumber, event.detail, event.time, batch,
+                                                  outcome.exit);
+                    if (!ticket)
+                        continue;
+                    pendingExits.push_back(make_pair(plate, ticket));
+                    pendingPlates.insert(plate);
+                    deltas.push_back(make_pair(ticket->getSlotHandle(), +1));
+                }
+                else
+                {
+                    outcome.passIssued = issuePassLocked(event.vehicleNumber, outcome.passStart);
+                }
+            }
+            flush();
+        }
+        for (auto &delta : deltas)
+        {
+            notifyAvailability(delta.first, delta.second);
+        }
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if (events[i].type == GATE_PARK)
+                countPark(outcomes[i].park);
+            else if (events[i].type == GATE_EXIT)
+                countExit(outcomes[i].exit);
+        }
+        maybeSweepPasses();
+        maybeCompact();
+    }
+
+    // Prometheus text exposition of the gate and persistence metrics
+    string metricsText() const
+    {
+        ostringstream out;
+        out << setprecision(15);
+        out << "# HELP parking_parks_total Park attempts by outcome\n# TYPE parking_parks_total counter\n";
+        for (int i = 0; i < 4; i++)
+        {
+            out << "parking_parks_total{status=\"" << parkStatusName((ParkStatus)i) << "\"} "
+                << parkOutcomes[i].value() << "\n";
+        }
+        out << "# HELP parking_exits_total Exit attempts by outcome\n# TYPE parking_exits_total counter\n";
+        for (int i = 0; i < 4; i++)
+        {
+            out << "parking_exits_total{status=\"" << exitStatusName((ExitStatus)i) << "\"} "
+                << exitOutcomes[i].value() << "\n";
+        }
+        out << "# HELP parking_pass_hits_total Parks and exits by valid monthly pass holders\n"
+            << "# TYPE parking_pass_hits_total counter\n"
+            << "parking_pass_hits_total{event=\"park\"} " << passHits[0].value() << "\n"
+            << "parking_pass_hits_total{event=\"exit\"} " << passHits[1].value() << "\n";
+        out << "# HELP parking_passes_issued_total Monthly passes sold\n# TYPE parking_passes_issued_total counter\n"
+            << "parking_passes_issued_total " << passesIssued.value() << "\n";
+        out << "# HELP parking_passes_renewed_total Monthly passes renewed in bulk\n"
+            << "# TYPE parking_passes_renewed_total counter\n"
+            << "parking_passes_renewed_total " << passesRenewed.value() << "\n";
+        out << "# HELP parking_passes_archived_total Expired monthly passes moved to the archive\n"
+            << "# TYPE parking_passes_archived_total counter\n"
+            << "parking_passes_archived_total "
+            << (config.passDirectory ? config.passDirectory->getArchivedCount() : passesArchived.value()) << "\n";
+        out << "# HELP parking_tariff_swaps_total Tariffs replaced while running\n"
+            << "# TYPE parking_tariff_swaps_total counter\n"
+            << "parking_tariff_swaps_total " << tariffSwaps.value() << "\n";
+        out << "# HELP parking_batch_events_total Gate events received through processEvents\n"
+            << "# TYPE parking_batch_events_total counter\n"
+            << "parking_batch_events_total " << batchEvents.value() << "\n";
+        out << "# HELP parking_journal_bytes_written_total Bytes appended to the journal\n"
+            << "# TYPE parking_journal_bytes_written_total counter\n"
+            << "parking_journal_bytes_written_total " << journal->getBytesWritten() << "\n";
+        out << "# HELP parking_journal_queue_full_waits_total Appends that waited for the journal writer\n"
+            << "# TYPE parking_journal_queue_full_waits_total counter\n"
+            << "parking_journal_queue_full_waits_total " << journal->getQueueFullWaits() << "\n";
+        out << "# HELP parking_snapshot_bytes_written_total Bytes of snapshots written\n"
+            << "# TYPE parking_snapshot_bytes_written_total counter\n"
+            << "parking_snapshot_bytes_written_total " << snapshotBytes.value() << "\n";
+        out << "# HELP parking_revenue_total Revenue collected in rupees\n# TYPE parking_revenue_total counter\n"
+            << "parking_revenue_total " << totalRevenue.load() << "\n";
+        out << "# HELP parking_history_rows Completed exits in the transaction history\n"
+            << "# TYPE parking_history_rows gauge\n"
+            << "parking_history_rows " << history.size() << "\n";
+        out << "# HELP parking_active_tickets Vehicles currently parked\n# TYPE parking_active_tickets gauge\n"
+            << "parking_active_tickets " << activeTickets.size() << "\n";
+        out << "# HELP parking_monthly_passes Monthly passes on record\n# TYPE parking_monthly_passes gauge\n"
+            << "parking_monthly_passes " << getPassCount() << "\n";
+        AvailabilitySnapshot snapshot = availabilitySnapshot();
+        out << "# HELP parking_available_slots Free slots by vehicle type\n# TYPE parking_available_slots gauge\n";
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            out << "parking_available_slots{type=\"" << VEHICLE_KIND_NAMES[k] << "\"} " << snapshot.totals[k] << "\n";
+        }
+        out << "# HELP parking_startup_seconds Time spent restoring state at startup\n"
+            << "# TYPE parking_startup_seconds gauge\n"
+            << "parking_startup_seconds{phase=\"snapshot\"} " << loadSeconds << "\n"
+            << "parking_startup_seconds{phase=\"journal\"} " << replaySeconds << "\n";
+        out << "# HELP parking_startup_replayed_records Journal records replayed at startup\n"
+            << "# TYPE parking_startup_replayed_records gauge\n"
+            << "parking_startup_replayed_records " << replayedRecords << "\n";
+
+        parkLatency.writePrometheus(out, "parking_park_seconds", "Time to admit a vehicle", 1e-9);
+        exitLatency.writePrometheus(out, "parking_exit_seconds", "Time to release a vehicle", 1e-9);
+        passLatency.writePrometheus(out, "parking_pass_seconds", "Time to issue a monthly pass", 1e-9);
+        batchLatency.writePrometheus(out, "parking_batch_seconds", "Time to process one event batch", 1e-9);
+        journal->getSyncLatency().writePrometheus(out, "parking_journal_fsync_seconds", "Time per journal fsync",
+                                                  1e-9);
+        snapshotLatency.writePrometheus(out, "parking_snapshot_write_seconds", "Time to write a snapshot", 1e-9);
+        checkpointPause.writePrometheus(out, "parking_checkpoint_pause_seconds",
+                                        "Time gate traffic waited while a checkpoint was copied", 1e-9);
+        allocator->getSearchLength().writePrometheus(out, "parking_slot_search_floors",
+                                                     "Floors tried to find a free slot", 1.0);
+        return out.str();
+    }
+
+    void displayParkingStatus()
+    {
+        cout << "\n╔════════════════════════════════════╗" << endl;
+        cout << "║    PARKING SYSTEM STATUS           ║" << endl;
+        cout << "╚════════════════════════════════════╝" << endl;
+
+        for (auto floor : floors)
+        {
+            floor->displayFloorStatus();
+        }
+
+        cout << "\n--- Available Slots Summary ---" << endl;
+        AvailabilitySnapshot snapshot = availabilitySnapshot();
+        for (int k = 0; k < KIND_COUNT; k++)
+        {
+            cout << (k ? " | " : "") << VEHICLE_KIND_PLURALS[k] << ": " << snapshot.totals[k];
+        }
+        cout << endl;
+
+        // Only pools that fill within the hour at the current rates
+        bool filling = false;
+        for (auto &floor : snapshot.floors)
+        {
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                if (floor.minutesToFull[k] < 0 || floor.minutesToFull[k] > 60)
+                    continue;
+                if (!filling)
+                    cout << "\n--- Filling Within The Hour ---" << endl;
+                filling = true;
+                cout << "Floor " << floor.floorNumber << " " << VEHICLE_KIND_PLURALS[k] << ": full in ~"
+                     << (int)ceil(floor.minutesToFull[k]) << " min" << endl;
+            }
+        }
+        cout << "Legend: [ ] = Available, [X] = Occupied" << endl;
+    }
+
+    bool parkVehicle(string vehicleNum, string vehicleType)
+    {
+        ParkResult result = admitVehicle(vehicleNum, vehicleType);
+        if (result.passHolder)
+        {
+            cout << "\n✓ Monthly pass holder detected!" << endl;
+        }
+
+        switch (result.status)
+        {
+        case PARK_OK:
+            Ticket(vehicleNum, result.slotNumber, result.hourlyRate, result.entryTime).displayTicket();
+            cout << "✓ Vehicle parked successfully on Floor " << result.floorNumber << "!" << endl;
+            return true;
+        case PARK_INVALID_TYPE:
+            cout << "✗ Invalid vehicle type!" << endl;
+            break;
+        case PARK_ALREADY_PARKED:
+            cout << "✗ Vehicle is already parked!" << endl;
+            break;
+        case PARK_FULL:
+            cout << "✗ No available slot for " << vehicleType << "!" << endl;
+            break;
+        }
+        return false;
+    }
+
+    bool exitVehicle(string vehicleNum, string paymentMethod)
+    {
+        ExitResult result = releaseVehicle(vehicleNum, paymentMethod);
+        if (result.status == EXIT_NO_TICKET)
+        {
+            cout << "✗ No active ticket found for this vehicle!" << endl;
+            return false;
+        }
+        if (result.status == EXIT_SLOT_EMPTY)
+        {
+            cout << "✗ Error: Vehicle not found in slot!" << endl;
+            return false;
+        }
+
+        if (!result.passHolder)
+        {
+            Payment payment(result.amount, paymentMethod, clock().now());
+            payment.displayReceipt(vehicleNum, result.hours, result.hourlyRate);
+        }
+        else
+        {
+            cout << "\n✓ Monthly pass holder - No charges!" << endl;
+            viewMonthlyPass(vehicleNum);
+        }
+
+        cout << "\n✓ Vehicle exited successfully!" << endl;
+        return true;
+    }
+
+    void purchaseMonthlyPass(string vehicleNum)
+    {
+        time_t start = 0;
+        if (!issueMonthlyPass(vehicleNum, start))
+        {
+            cout << "✗ Active monthly pass already exists!" << endl;
+            viewMonthlyPass(vehicleNum);
+            return;
+        }
+
+        cout << "\n✓ Monthly pass purchased successfully!" << endl;
+        cout << "Amount Paid: ₹500" << endl;
+        MonthlyPass(vehicleNum, start).displayPass(clock().now());
+    }
+
+    void viewMonthlyPass(string vehicleNum)
+    {
+        time_t now = clock().now();
+        time_t start;
+        bool found;
+        if (config.passDirectory)
+        {
+            found = config.passDirectory->lookup(vehicleNum, start);
+            if (found)
+                MonthlyPass(vehicleNum, start).displayPass(now);
+        }
+        else
+        {
+            found = monthlyPasses.read(plates.find(vehicleNum), [&](MonthlyPass *const *pass) {
+                if (!pass)
+                    return false;
+                (*pass)->displayPass(now);
+                return true;
+            });
+        }
+        if (!found)
+        {
+            cout << "\n✗ No monthly pass found for this vehicle!" << endl;
+        }
+    }
+
+    size_t getActiveTicketCount() const { return activeTickets.size(); }
+    const Clock &getClock() const { return clock(); }
+    size_t getPassCount() const
+    {
+        return config.passDirectory ? config.passDirectory->size() : monthlyPasses.size();
+    }
+    double getTotalRevenue() const { return totalRevenue; }
+    size_t getHistoryRowCount() const { return history.size(); }
+    long long getReplayedRecords() const { return replayedRecords; }
+    const LogHistogram &getCheckpointPause() const { return checkpointPause; }
+    const LogHistogram &getSnapshotLatency() const { return snapshotLatency; }
+
+    // Books capacity of a vehicle type for [start, end); returns the
+    // booking's id, or 0 with error set. The vehicle parks as usual when it
+    // arrives, from holdAheadMinutes before start until end.
+    long long reserveSlot(const string &vehicleNum, VehicleKind kind, time_t start, time_t end, string &error)
+    {
+        long long id;
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            id = reservations.book(vehicleNum, kind, start, end, clock().now(), error);
+            if (id == 0)
+                return 0;
+            JournalBatch &batch = laneBatch();
+            batch.record("RESERVE").add(id).add(vehicleNum).add(VEHICLE_KIND_NAMES[kind]);
+            batch.add((long long)start).add((long long)end);
+            journal->append(batch);
+        }
+        maybeCompact();
+        return id;
+    }
+
+    bool cancelReservation(long long id)
+    {
+        {
+            shared_lock<WriterFirstMutex> gate(stateLock);
+            if (!reservations.cancel(id))
+                return false;
+            JournalBatch &batch = laneBatch();
+            batch.record("CANCEL").add(id);
+            journal->append(batch);
+        }
+        maybeCompact();
+        return true;
+    }
+
+    // How many more bookings of this type [start, end) could take
+    int reservableCapacity(VehicleKind kind, time_t start, time_t end)
+    {
+        return reservations.available(kind, start, end, clock().now());
+    }
+
+    // Free slots of this type walk-ins are kept out of right now
+    int heldForBookings(VehicleKind kind) { return reservations.empty() ? 0 : reservations.held(kind, clock().now()); }
+
+    size_t getReservationCount() const { return reservations.size(); }
+
+    // Short-horizon outlook for one floor's pool from the rolling rates
+    FillForecast forecastFill(int floorIndex, VehicleKind kind, int horizonMinutes = 30) const
+    {
+        return occupancy.forecast(floorIndex, kind, floors[floorIndex]->availableOf(kind),
+                                  floors[floorIndex]->slotsOf(kind), clock().now(), horizonMinutes);
+    }
+
+    // Recent dwell time in minutes at quantile q (0.5 = median), -1 before any exit
+    double dwellMinutes(VehicleKind kind, double q) const { return occupancy.dwellQuantile(kind, q); }
+
+    int getAvailableCount(string type) const
+    {
+        int total = 0;
+        for (auto floor : floors)
+        {
+            total += floor->getAvailableCount(type);
+        }
+        return total;
+    }
+
+    // Free slots per floor and type from the running counters, and when each
+    // pool fills at the rolling rates, without touching any slot or lock;
+    // cheap enough for signage to poll
+    AvailabilitySnapshot availabilitySnapshot() const
+    {
+        AvailabilitySnapshot snapshot;
+        snapshot.floors.resize(floors.size());
+        time_t now = clock().now();
+        for (size_t i = 0; i < floors.size(); i++)
+        {
+            FloorAvailability &entry = snapshot.floors[i];
+            entry.floorNumber = floors[i]->getFloorNumber();
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                entry.available[k] = floors[i]->availableOf(k);
+                entry.minutesToFull[k] =
+                    occupancy.forecast((int)i, k, entry.available[k], floors[i]->slotsOf(k), now, 0).minutesToFull;
+                snapshot.totals[k] += entry.available[k];
+            }
+        }
+        return snapshot;
+    }
+
+    // Calls the listener after every park and exit from any lane, possibly
+    // from several lanes at once; returns an id for unsubscribeAvailability
+    int subscribeAvailability(AvailabilityListener listener)
+    {
+        unique_lock<shared_mutex> lock(listenersLock);
+        int id = nextListenerId++;
+        listeners.push_back(make_pair(id, listener));
+        listenerCount = (int)listeners.size();
+        return id;
+    }
+
+    void unsubscribeAvailability(int id)
+    {
+        unique_lock<shared_mutex> lock(listenersLock);
+        for (auto it = listeners.begin(); it != listeners.end(); ++it)
+        {
+            if (it->first == id)
+            {
+                listeners.erase(it);
+                break;
+            }
+        }
+        listenerCount = (int)listeners.size();
+    }
+
+    vector<TicketRecord> activeTicketRecords() const
+    {
+        vector<TicketRecord> records;
+        activeTickets.forEach([&](PlateId, const TicketEntry &entry) {
+            Ticket *t = entry.ticket;
+            if (t)
+                records.push_back(TicketRecord{t->getVehicleNumber(), t->getSlotNumber(), ticketKind(t),
+                                               t->getHourlyRate(), t->getEntryTime()});
+        });
+        return records;
+    }
+
+    void displayRevenue() const
+    {
+        cout << "\n╔════════════════════════════════════╗" << endl;
+        cout << "║      REVENUE STATISTICS            ║" << endl;
+        cout << "╚════════════════════════════════════╝" << endl;
+        cout << "Total Revenue: ₹" << fixed << setprecision(2) << totalRevenue << endl;
+        cout << "Active Vehicles: " << activeTickets.size() << endl;
+        cout << "Monthly Pass Holders: " << getPassCount() << endl;
+
+        HistoryQuery query;
+        query.bucketSeconds = 0;
+        for (HistoryGroup group : {GROUP_KIND, GROUP_METHOD})
+        {
+            query.groupBy = group;
+            vector<HistoryBucket> rows = history.aggregate(query);
+            if (rows.empty())
+                continue;
+            cout << (group == GROUP_KIND ? "--- By vehicle type ---" : "--- By payment method ---") << endl;
+            for (auto &row : rows)
+            {
+                cout << "  " << left << setw(6) << row.group << right << " " << setw(6) << row.exits
+                     << " exits  ₹" << row.revenue << endl;
+            }
+        }
+        query.groupBy = GROUP_NONE;
+        if (history.size() > 0)
+        {
+            cout << "Median stay: " << setprecision(1) << history.dwellPercentile(query, 0.5) / 3600.0
+                 << " hours" << endl;
+        }
+        cout << "════════════════════════════════════" << endl;
+    }
+
+    // Completed exits for analytics; queries may run alongside gate traffic
+    const TransactionHistory &getHistory() const { return history; }
+};
+
+// ==================== Multi-Site Hosting ====================
+// One garage in a ParkingHost, with its own system, storage directory and
+// worker thread. Batches submitted to a site run on its worker in order, so
+// sites share nothing on the gate path except the pass directory.
+class ParkingSite
+{
+private:
+    struct Job
+    {
+        vector<GateEvent> events;
+        promise<vector<GateOutcome>> done;
+    };
+
+    string name;
+    SmartParkingSystem *system;
+    mutex lock;
+    condition_variable ready;
+    deque<Job> jobs;
+    bool stopping;
+    thread worker; // started last, once everything above is set up
+
+    void run()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<mutex> guard(lock);
+                ready.wait(guard, [&]() { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+            vector<GateOutcome> outcomes;
+            system->processEvents(job.events, outcomes);
+            job.done.set_value(move(outcomes));
+        }
+    }
+
+public:
+    ParkingSite(string siteName, int numFloors, ParkingConfig config)
+        : name(siteName), system(new SmartParkingSystem(numFloors, config)), stopping(false),
+          worker(&ParkingSite::run, this)
+    {
+    }
+
+    // Finishes every queued batch before closing the site
+    ~ParkingSite()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_one();
+        worker.join();
+        delete system;
+    }
+
+    // Queues a batch for the site's worker; the future yields one outcome per event
+    future<vector<GateOutcome>> submit(vector<GateEvent> events)
+    {
+        Job job;
+        job.events = move(events);
+        future<vector<GateOutcome>> outcomes = job.done.get_future();
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push_back(move(job));
+        }
+        ready.notify_one();
+        return outcomes;
+    }
+
+    string getName() const { return name; }
+    // Direct access for queries and single gate calls, which may run
+    // alongside the worker
+    SmartParkingSystem &getSystem() { return *system; }
+};
+
+// Hosts many independent garages in one process. Each site keeps its snapshot
+// and journal in rootDir/<site name>; the shared pass directory keeps its own
+// files in rootDir. Add every site before traffic starts.
+class ParkingHost
+{
+private:
+    string rootDir;
+    PassDirectory *passes;
+    vector<ParkingSite *> sites;
+
+public:
+    // The clock decides when shared passes expire; sites take theirs from
+    // their own ParkingConfig
+    ParkingHost(string root, JournalConfig passJournal = JournalConfig(), const Clock *clock = nullptr)
+        : rootDir(root)
+    {
+        if (!rootDir.empty())
+            filesystem::create_directories(rootDir);
+        passes = new PassDirectory(rootDir, passJournal, clock);
+    }
+
+    ~ParkingHost()
+    {
+        for (auto site : sites)
+        {
+            delete site;
+        }
+        delete passes;
+    }
+
+    // Opens a site, restoring whatever its directory already holds. The host
+    // sets config.dataDir and config.passDirectory; passes the site kept on
+    // its own before are merged into the shared directory.
+    ParkingSite &addSite(const string &name, int numFloors, ParkingConfig config = ParkingConfig())
+    {
+        config.dataDir = rootDir.empty() ? name : rootDir + "/" + name;
+        config.passDirectory = passes;
+        filesystem::create_directories(config.dataDir);
+        sites.push_back(new ParkingSite(name, numFloors, config));
+        return *sites.back();
+    }
+
+    ParkingSite *findSite(const string &name)
+    {
+        for (auto site : sites)
+        {
+            if (site->getName() == name)
+                return site;
+        }
+        return nullptr;
+    }
+
+    size_t getSiteCount() const { return sites.size(); }
+    ParkingSite &site(size_t index) { return *sites[index]; }
+    PassDirectory &passDirectory() { return *passes; }
+};
+
+// ==================== Recovery Check ====================
+// Checks a site's data files after a crash and moves aside what cannot be
+// used, then restores the site from the rest and writes a fresh checkpoint.
+// Returns 0 if every file was intact, 1 if damage or the leftovers of an
+// interrupted write were found.
+int runRecoveryCheck(const string &dir, ParkingConfig config, int numFloors, ostream &out)
+{
+    string prefix = dir.empty() ? "" : dir + "/";
+    bool clean = true;
+    error_code ec;
+
+    // A temp file is the next version of a file whose write never finished;
+    // nothing reads it back
+    vector<filesystem::path> leftovers;
+    for (auto &entry : filesystem::directory_iterator(dir.empty() ? "." : dir, ec))
+    {
+        if (entry.path().extension() == ".tmp")
+            leftovers.push_back(entry.path());
+    }
+    for (auto &path : leftovers)
+    {
+        out << "✗ " << path.filename().string() << ": left by an interrupted write, removed" << endl;
+        filesystem::remove(path, ec);
+        clean = false;
+    }
+
+    string snapshotPath = prefix + "parking_snapshot.bin";
+    long long snapshotLsn = 0;
+    bool damaged = false;
+    {
+        SnapshotReader reader;
+        string error;
+        if (reader.open(snapshotPath, error))
+        {
+            snapshotLsn = reader.lastLsn();
+            out << "✓ parking_snapshot.bin: " << reader.ticketCount() << " tickets, " << reader.passCount()
+                << " passes, revenue " << formatAmount(reader.totalRevenue()) << ", journal records to "
+                << snapshotLsn << endl;
+        }
+        else if (filesystem::exists(snapshotPath))
+        {
+            out << "✗ parking_snapshot.bin: " << error << ", moved to parking_snapshot.bin.damaged" << endl;
+            damaged = true;
+        }
+        else
+            out << "- parking_snapshot.bin: none, starting from the text files if any" << endl;
+    }
+    if (damaged)
+    {
+        filesystem::rename(snapshotPath, snapshotPath + ".damaged", ec);
+        clean = false;
+    }
+
+    LineReader journal(prefix + "parking_journal.log");
+    if (journal.isOpen())
+    {
+        string_view line, f[2];
+        bool complete = true;
+        long long lsn, first = 0, last = 0, newer = 0, malformed = 0;
+        while (journal.next(line, &complete) && complete)
+        {
+            if (line.empty())
+                continue;
+            if (splitFields(line, f, 2) < 2 || !parseField(f[0], lsn))
+            {
+                malformed++;
+                continue;
+            }
+            first = first ? first : lsn;
+            last = lsn;
+            newer += lsn > snapshotLsn;
+        }
+        if (first == 0)
+            out << "✓ parking_journal.log: empty" << endl;
+        else
+            out << "✓ parking_journal.log: records " << first << " to " << last << ", " << newer
+                << " newer than the snapshot" << endl;
+        if (!complete)
+            out << "✗ parking_journal.log: a torn final record, dropped" << endl;
+        if (malformed > 0)
+            out << "✗ parking_journal.log: " << malformed << " malformed records, skipped" << endl;
+        if (first > snapshotLsn + 1)
+            out << "✗ parking_journal.log: records " << snapshotLsn + 1 << " to " << first - 1 << " are lost" << endl;
+        clean = clean && complete && malformed == 0 && first <= snapshotLsn + 1;
+    }
+    else
+        out << "- parking_journal.log: none" << endl;
+
+    config.dataDir = dir;
+    config.journal.compactEveryRecords = 0;
+    auto start = chrono::steady_clock::now();
+    SmartParkingSystem site(numFloors, config);
+    out << "✓ Restored " << site.getActiveTicketCount() << " parked vehicles, " << site.getPassCount()
+        << " passes, " << site.getReservationCount() << " bookings, " << site.getHistoryRowCount()
+        << " past exits and revenue " << formatAmount(site.getTotalRevenue()) << ", replaying "
+        << site.getReplayedRecords() << " journal records, in " << fixed << setprecision(1) << nanosSince(start) / 1e6
+        << " ms" << endl;
+    site.shutdown();
+    out << "✓ Wrote a fresh checkpoint" << endl;
+    return clean ? 0 : 1;
+}
+
+// ==================== Simulation ====================
+// Deterministic discrete-event driver for SmartParkingSystem. Arrivals and
+// their departures come from a seeded generator and are applied in simulated
+// time order against a manual clock, so the same settings always produce the
+// same parks, exits, fees and occupancy; only the measured latencies vary.
+struct SimulationConfig
+{
+    long long arrivals = 1000000;
+    double arrivalsPerHour = 2000;
+    string arrivalModel = "poisson"; // poisson, uniform, or daily (morning and evening peaks)
+    string dwellModel = "exponential"; // exponential, lognormal or fixed
+    double meanDwellMinutes = 120;
+    double passHolderShare = 0.1;    // share of arrivals that are pass holders
+    int passHolders = 20000;         // passes bought at the start, valid 30 days
+    array<double, KIND_COUNT> vehicleMix = SIMULATED_VEHICLE_MIX; // share of arrivals per VehicleKind
+    int floors = 50;
+    ParkingConfig parking;           // an empty dataDir means a fresh temp directory
+    int sampleMinutes = 60;
+    unsigned seed = 42;
+    time_t start = 1767225600;       // 2026-01-01 00:00 UTC
+
+    SimulationConfig()
+    {
+        parking.slotsPerFloor = SIMULATED_SLOTS_PER_FLOOR;
+        parking.journal.fsyncEveryRecords = 0;
+        parking.journal.compactEveryRecords = 100000;
+    }
+};
+
+struct OccupancySample
+{
+    time_t time;
+    int occupied;
+};
+
+struct SimulationReport
+{
+    long long parks = 0;
+    long long exits = 0;
+    long long rejectedFull = 0;
+    long long rejectedDuplicate = 0;
+    long long passHolderVisits = 0;
+    double revenue = 0.0;
+    double wallMs = 0.0;
+    double simulatedHours = 0.0;
+    int capacity = 0;
+    double parkP50 = 0, parkP99 = 0, exitP50 = 0, exitP99 = 0; // nanoseconds
+    vector<OccupancySample> occupancy;
+};
+
+double percentileOf(vector<uint32_t> &samples, double fraction)
+{
+    if (samples.empty())
+        return 0.0;
+    size_t index = min(samples.size() - 1, (size_t)(fraction * samples.size()));
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Relative arrival rate by hour of day for the daily model, at most 2
+double dailyProfile(double hourOfDay)
+{
+    return 0.4 + 1.2 * exp(-(hourOfDay - 9) * (hourOfDay - 9) / 2) +
+           1.0 * exp(-(hourOfDay - 18) * (hourOfDay - 18) / 2);
+}
+
+SimulationReport runSimulation(const SimulationConfig &sim)
+{
+    struct SimEvent
+    {
+        double time;
+        long long vehicle;
+        bool operator>(const SimEvent &other) const
+        {
+            return time != other.time ? time > other.time : vehicle > other.vehicle;
+        }
+    };
+
+    SimulationReport report;
+    ManualClock clock(sim.start);
+    ParkingConfig config = sim.parking;
+    config.clock = &clock;
+    bool tempDir = config.dataDir.empty();
+    if (tempDir)
+    {
+        config.dataDir = (filesystem::temp_directory_path() / ("parking_sim_" + to_string(sim.seed))).string();
+        filesystem::remove_all(config.dataDir);
+        filesystem::create_directories(config.dataDir);
+    }
+    SmartParkingSystem *system = new SmartParkingSystem(sim.floors, config);
+    report.capacity = sim.floors * config.slotsPerFloorTotal();
+    double startRevenue = system->getTotalRevenue();
+
+    mt19937_64 rng(sim.seed);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    time_t passStart;
+    for (int i = 0; i < sim.passHolders; i++)
+    {
+        system->issueMonthlyPass("PH" + to_string(i), passStart);
+    }
+
+    double ratePerSecond = sim.arrivalsPerHour / 3600.0;
+    auto nextGap = [&]() {
+        if (sim.arrivalModel == "uniform")
+            return 1.0 / ratePerSecond;
+        exponential_distribution<double> gap(sim.arrivalModel == "daily" ? 2.0 * ratePerSecond : ratePerSecond);
+        return gap(rng);
+    };
+    double sigma = 0.8;
+    double mu = log(sim.meanDwellMinutes) - sigma * sigma / 2;
+    auto nextDwell = [&]() {
+        double minutes = sim.meanDwellMinutes;
+        if (sim.dwellModel == "exponential")
+            minutes = exponential_distribution<double>(1.0 / sim.meanDwellMinutes)(rng);
+        else if (sim.dwellModel == "lognormal")
+            minutes = lognormal_distribution<double>(mu, sigma)(rng);
+        return max(1.0, minutes) * 60.0;
+    };
+
+    priority_queue<SimEvent, vector<SimEvent>, greater<SimEvent>> departures;
+    vector<string> plateOf;
+    vector<int> kindOf;
+    vector<uint32_t> parkNs, exitNs;
+    parkNs.reserve(sim.arrivals);
+    exitNs.reserve(sim.arrivals);
+    double sampleSeconds = sim.sampleMinutes * 60.0;
+    double nextSample = 0.0;
+    double now = 0.0;
+    double nextArrival = nextGap();
+    long long arrived = 0;
+
+    auto startWall = chrono::steady_clock::now();
+    while (arrived < sim.arrivals || !departures.empty())
+    {
+        bool arrival = arrived < sim.arrivals && (departures.empty() || nextArrival <= departures.top().time);
+        now = arrival ? nextArrival : departures.top().time;
+        while (nextSample <= now)
+        {
+            AvailabilitySnapshot snapshot = system->availabilitySnapshot();
+            int available = 0;
+            for (int total : snapshot.totals)
+                available += total;
+            report.occupancy.push_back(OccupancySample{sim.start + (time_t)nextSample, report.capacity - available});
+            nextSample += sampleSeconds;
+        }
+        clock.set(sim.start + (time_t)now);
+
+        if (arrival)
+        {
+            nextArrival += nextGap();
+            // The daily model thins a doubled Poisson stream down to the profile
+            if (sim.arrivalModel == "daily" && unit(rng) * 2.0 > dailyProfile(fmod(now / 3600.0, 24.0)))
+                continue;
+            long long id = arrived++;
+            double pick = unit(rng);
+            int kind = 0;
+            while (kind < KIND_COUNT - 1 && pick >= sim.vehicleMix[kind])
+                pick -= sim.vehicleMix[kind++];
+            bool holder = sim.passHolders > 0 && unit(rng) < sim.passHolderShare;
+            string plate = holder ? "PH" + to_string(rng() % sim.passHolders) : "SV" + to_string(id);
+            double dwell = nextDwell();
+
+            auto opStart = chrono::steady_clock::now();
+            ParkResult result = system->admitVehicle(plate, (VehicleKind)kind);
+            parkNs.push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - opStart).count());
+
+            if (result.status == PARK_OK)
+            {
+                report.parks++;
+                report.passHolderVisits += result.passHolder;
+                plateOf.push_back(plate);
+                departures.push(SimEvent{now + dwell, (long long)plateOf.size() - 1});
+            }
+            else if (result.status == PARK_FULL)
+                report.rejectedFull++;
+            else
+                report.rejectedDuplicate++;
+        }
+        else
+        {
+            SimEvent event = departures.top();
+            departures.pop();
+            auto opStart = chrono::steady_clock::now();
+            ExitResult result = system->releaseVehicle(plateOf[event.vehicle], "Card");
+            exitNs.push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - opStart).count());
+            if (result.status == EXIT_OK)
+                report.exits++;
+            string().swap(plateOf[event.vehicle]);
+        }
+    }
+    report.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startWall).count();
+    report.simulatedHours = now / 3600.0;
+    report.revenue = system->getTotalRevenue() - startRevenue;
+    report.parkP50 = percentileOf(parkNs, 0.50);
+    report.parkP99 = percentileOf(parkNs, 0.99);
+    report.exitP50 = percentileOf(exitNs, 0.50);
+    report.exitP99 = percentileOf(exitNs, 0.99);
+
+    delete system;
+    if (tempDir)
+        filesystem::remove_all(config.dataDir);
+    return report;
+}
+
+void printSimulationReport(const SimulationReport &report, ostream &out)
+{
+    long long ops = report.parks + report.exits + report.rejectedFull + report.rejectedDuplicate;
+    out << fixed << setprecision(1);
+    out << "Simulated " << report.simulatedHours << " h of traffic in " << report.wallMs << " ms ("
+        << (report.wallMs > 0 ? ops / report.wallMs : 0.0) << "k gate ops/s)" << endl;
+    out << "Parks " << report.parks << " | Exits " << report.exits << " | Turned away full " << report.rejectedFull
+        << " | Already parked " << report.rejectedDuplicate << " | Pass holder visits " << report.passHolderVisits
+        << endl;
+    out << "Latency: park p50 " << report.parkP50 << " ns, p99 " << report.parkP99 << " ns | exit p50 "
+        << report.exitP50 << " ns, p99 " << report.exitP99 << " ns" << endl;
+    out << setprecision(2) << "Revenue: ₹" << report.revenue << endl;
+
+    if (report.occupancy.empty() || report.capacity == 0)
+        return;
+    double sum = 0;
+    int peak = 0;
+    for (auto &sample : report.occupancy)
+    {
+        sum += sample.occupied;
+        peak = max(peak, sample.occupied);
+    }
+    out << setprecision(1) << "Occupancy of " << report.capacity << " slots: mean "
+        << 100.0 * sum / report.occupancy.size() / report.capacity << "%, peak " << 100.0 * peak / report.capacity
+        << "%" << endl;
+    // At most 24 evenly spaced rows
+    size_t step = max((size_t)1, (report.occupancy.size() + 23) / 24);
+    for (size_t i = 0; i < report.occupancy.size(); i += step)
+    {
+        const OccupancySample &sample = report.occupancy[i];
+        double hours = (sample.time - report.occupancy[0].time) / 3600.0;
+        int bar = (int)(40.0 * sample.occupied / report.capacity);
+        out << "  +" << setw(7) << hours << " h " << setw(7) << sample.occupied << " " << string(bar, '#') << endl;
+    }
+}
+
+// key=value settings for --simulate; returns false on an unknown key
+bool applySimulationSetting(SimulationConfig &sim, const string &setting, string &csvPath)
+{
+    size_t eq = setting.find('=');
+    if (eq == string::npos)
+        return false;
+    string key = setting.substr(0, eq), value = setting.substr(eq + 1);
+    if (key == "arrivals")
+        sim.arrivals = stoll(value);
+    else if (key == "rate")
+        sim.arrivalsPerHour = stod(value);
+    else if (key == "arrival")
+        sim.arrivalModel = value;
+    else if (key == "dwell")
+        sim.dwellModel = value;
+    else if (key == "mean-dwell")
+        sim.meanDwellMinutes = stod(value);
+    else if (key == "pass-share")
+        sim.passHolderShare = stod(value);
+    else if (key == "passes")
+        sim.passHolders = stoi(value);
+    else if (key == "floors")
+        sim.floors = stoi(value);
+    else if (key == "seed")
+        sim.seed = (unsigned)stoul(value);
+    else if (key == "sample-minutes")
+        sim.sampleMinutes = max(1, stoi(value));
+    else if (key == "csv")
+        csvPath = value;
+    else if (key == "policy")
+    {
+        int policy = allocationPolicyFromName(value);
+        if (policy < 0)
+            return false;
+        sim.parking.allocation = (AllocationPolicy)policy;
+    }
+    else
+        return false;
+    return true;
+}
+
+// ==================== Gate Event Stream ====================
+// Text commands, one per line, as sent by the plate-recognition cameras:
+//   PARK,<vehicle>,<Bike|Car|Truck>[,<unix time>]
+//   EXIT,<vehicle>,<payment method>[,<unix time>]
+//   PASS,<vehicle>
+// Blank lines and lines starting with # are skipped. Every other line gets
+// one JSON object on the output, in input order.
+
+string jsonString(const string &text)
+{
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            quoted += escaped;
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+bool parseGateEvent(const string &line, GateEvent &event, string &error)
+{
+    string_view fields[5];
+    size_t count = line.empty() ? 0 : splitFields(line, fields, 5);
+    // A trailing comma does not add an empty field
+    if (count > 1 && count <= 5 && fields[count - 1].empty())
+        count--;
+    if (count == 0)
+    {
+        error = "empty command";
+        return false;
+    }
+    string command(fields[0]);
+    transform(command.begin(), command.end(), command.begin(), ::toupper);
+    size_t expected;
+    if (command == "PARK")
+    {
+        event.type = GATE_PARK;
+        expected = 3;
+    }
+    else if (command == "EXIT")
+    {
+        event.type = GATE_EXIT;
+        expected = 3;
+    }
+    else if (command == "PASS")
+    {
+        event.type = GATE_PASS;
+        expected = 2;
+    }
+    else
+    {
+        error = "unknown command";
+        return false;
+    }
+
+    if (count < expected || count > expected + (event.type == GATE_PASS ? 0 : 1))
+    {
+        error = "wrong number of fields";
+        return false;
+    }
+    if (fields[1].empty())
+    {
+        error = "missing vehicle number";
+        return false;
+    }
+    event.vehicleNumber.assign(fields[1]);
+    event.detail.assign(event.type == GATE_PASS ? string_view() : fields[2]);
+    event.time = 0;
+    if (count > expected)
+    {
+        long long value = 0;
+        if (!parseField(fields[expected], value) || value <= 0)
+        {
+            error = "bad time";
+            return false;
+        }
+        event.time = (time_t)value;
+    }
+    return true;
+}
+
+void writeGateOutcome(ostream &out, int lineNumber, const GateEvent &event, const GateOutcome &outcome)
+{
+    out << "{\"line\":" << lineNumber << ",\"vehicle\":" << jsonString(event.vehicleNumber);
+    if (event.type == GATE_PARK)
+    {
+        const ParkResult &park = outcome.park;
+        out << ",\"event\":\"park\",\"status\":\"" << parkStatusName(park.status) << "\"";
+        if (park.status == PARK_OK)
+        {
+            out << ",\"floor\":" << park.floorNumber << ",\"slot\":" << park.slotNumber
+                << ",\"rate\":" << formatAmount(park.hourlyRate) << ",\"entry\":" << park.entryTime;
+        }
+        out << ",\"pass\":" << (park.passHolder ? "true" : "false");
+    }
+    else if (event.type == GATE_EXIT)
+    {
+        const ExitResult &exit = outcome.exit;
+        out << ",\"event\":\"exit\",\"status\":\"" << exitStatusName(exit.status) << "\"";
+        if (exit.status == EXIT_OK)
+        {
+            out << ",\"slot\":" << exit.slotNumber << ",\"hours\":" << formatAmount(exit.hours)
+                << ",\"rate\":" << formatAmount(exit.hourlyRate) << ",\"amount\":" << formatAmount(exit.amount)
+                << ",\"method\":" << jsonString(event.detail) << ",\"pass\":" << (exit.passHolder ? "true" : "false");
+        }
+    }
+    else
+    {
+        out << ",\"event\":\"pass\",\"status\":\"" << (outcome.passIssued ? "ok" : "already_active") << "\"";
+        if (outcome.passIssued)
+            out << ",\"start\":" << outcome.passStart;
+    }
+    out << "}\n";
+}
+
+struct GateStreamReport
+{
+    long long events = 0;  // commands handed to processEvents
+    long long batches = 0; // processEvents calls
+    int malformed = 0;     // lines answered with an error
+};
+
+// Reads commands until end of input, handing them to processEvents in
+// batches of up to maxBatch. A batch also ends when no more input is
+// buffered, so a live feed is answered without waiting for a full batch.
+GateStreamReport runGateStream(SmartParkingSystem &parking, istream &in, ostream &out, size_t maxBatch = 1024)
+{
+    vector<GateEvent> events;
+    vector<GateOutcome> outcomes;
+    vector<int> eventLines;
+    vector<pair<int, string>> errors;
+    long long processed = 0, batches = 0;
+    int malformed = 0, lineNumber = 0;
+    string line;
+    bool more = true;
+    auto start = chrono::steady_clock::now();
+
+    while (more)
+    {
+        events.clear();
+        eventLines.clear();
+        errors.clear();
+        while (events.size() < maxBatch)
+        {
+            if (!getline(in, line))
+            {
+                more = false;
+                break;
+            }
+            lineNumber++;
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            GateEvent event;
+            string error;
+            if (parseGateEvent(line, event, error))
+            {
+                events.push_back(event);
+                eventLines.push_back(lineNumber);
+            }
+            else
+            {
+                errors.push_back(make_pair(lineNumber, error));
+            }
+            if (in.rdbuf()->in_avail() <= 0)
+                break;
+        }
+
+        if (!events.empty())
+        {
+            parking.processEvents(events, outcomes);
+            batches++;
+            processed += events.size();
+        }
+        // Merge results and parse errors back into input order
+        size_t e = 0, r = 0;
+        while (e < events.size() || r < errors.size())
+        {
+            if (r == errors.size() || (e < events.size() && eventLines[e] < errors[r].first))
+            {
+                writeGateOutcome(out, eventLines[e], events[e], outcomes[e]);
+                e++;
+            }
+            else
+            {
+                out << "{\"line\":" << errors[r].first << ",\"status\":\"error\",\"error\":"
+                    << jsonString(errors[r].second) << "}\n";
+                r++;
+            }
+        }
+        malformed += (int)errors.size();
+        out.flush();
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cerr << "Processed " << processed << " events in " << batches << " batches, " << malformed
+         << " malformed lines, " << fixed << setprecision(1) << ms << " ms" << endl;
+    GateStreamReport report;
+    report.events = processed;
+    report.batches = batches;
+    report.malformed = malformed;
+    return report;
+}
+
+// Streams commands from stdin. While cin is synced with stdio it reads a
+// character at a time and never reports anything buffered, so every line
+// would go through as a batch of its own; unsynced it buffers like a file.
+GateStreamReport runStdinGateStream(SmartParkingSystem &parking, ostream &out)
+{
+    ios::sync_with_stdio(false);
+    return runGateStream(parking, cin, out);
+}
+
+// ==================== Benchmarks ====================
+double elapsedMs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void printBenchResult(string name, int ops, double ms)
+{
+    cout << left << setw(28) << name << right << setw(10) << ops << " ops "
+         << fixed << setprecision(2) << setw(10) << ms << " ms "
+         << setw(10) << (ms * 1e6 / ops) << " ns/op" << endl;
+}
+
+// Swallows receipts, stream results and summaries a benchmark has no use for
+class DiscardBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize count) override { return count; }
+};
+
+// Fills a 100k slot garage through the slot allocator, then drains it
+int benchSlotAllocator()
+{
+    const int numFloors = 10;
+    const array<int, KIND_COUNT> slots = {4000, 5000, 1000};
+    const int total = numFloors * totalSlots(slots);
+
+    vector<ParkingFloor *> floors;
+    for (int i = 1; i <= numFloors; i++)
+    {
+        floors.push_back(new ParkingFloor(i, slots));
+    }
+    SlotAllocator allocator(floors);
+
+    vector<Vehicle *> vehicles;
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        for (int i = 0; i < numFloors * slots[k]; i++)
+            vehicles.push_back(createVehicle(k, VEHICLE_KIND_NAMES[k][0] + to_string(i), 0));
+    }
+    mt19937 rng(42);
+    shuffle(vehicles.begin(), vehicles.end(), rng);
+
+    vector<SlotHandle> parked(total);
+    auto start = chrono::steady_clock::now();
+    int filled = 0;
+    for (int i = 0; i < total; i++)
+    {
+        parked[i] = allocator.allocate(vehicles[i]);
+        if (parked[i].valid())
+            filled++;
+    }
+    printBenchResult("fill 100k slots", total, elapsedMs(start));
+
+    shuffle(parked.begin(), parked.end(), rng);
+    start = chrono::steady_clock::now();
+    int drained = 0;
+    for (auto &handle : parked)
+    {
+        if (handle.valid() && allocator.release(handle))
+            drained++;
+    }
+    printBenchResult("drain 100k slots", total, elapsedMs(start));
+
+    bool ok = (filled == total && drained == total);
+    for (auto floor : floors)
+    {
+        for (int k = 0; k < KIND_COUNT; k++)
+            ok = ok && floor->availableOf(k) == slots[k];
+        delete floor;
+    }
+    for (auto vehicle : vehicles)
+    {
+        delete vehicle;
+    }
+    cout << (ok ? "✓ garage filled and drained consistently" : "✗ slot accounting mismatch") << endl;
+    return ok ? 0 : 1;
+}
+
+// Distance for the policy benchmark: the ramp arrives at the middle of each
+// floor, 60 m of ramp per floor, 2.5 m per slot along the aisle
+double benchSlotDistance(const ParkingFloor &floor, int floorIndex, int position)
+{
+    return floorIndex * 60.0 + fabs(position - floor.getSlotCount() / 2.0) * 2.5;
+}
+
+// Each policy fills a garage to 75%, then four lanes churn it; the fill must
+// show the policy's shape (nearest: the closest slots, spread: even floors,
+// grouped: as few floors as possible) and the churn must leave the slot
+// counts consistent. Two garage sizes show the choice stays sub-linear.
+int benchAllocationPolicies()
+{
+    const array<int, KIND_COUNT> slots = {400, 500, 100};
+    const int perFloor = totalSlots(slots);
+    const int lanes = 4, churnPerLane = 50000;
+    bool ok = true;
+    for (int numFloors : {5, 100})
+    {
+        const int total = numFloors * perFloor, fill = total * 3 / 4;
+        cout << numFloors << " floors, " << total << " slots:" << endl;
+        for (int p = 0; p < ALLOCATION_POLICY_COUNT; p++)
+        {
+            AllocationPolicy policy = (AllocationPolicy)p;
+            vector<ParkingFloor *> floors;
+            for (int i = 1; i <= numFloors; i++)
+            {
+                floors.push_back(new ParkingFloor(i, slots));
+            }
+            SlotAllocator allocator(floors, policy, [&floors](int floorIndex, int position) {
+                return benchSlotDistance(*floors[floorIndex], floorIndex, position);
+            });
+
+            vector<Vehicle *> vehicles;
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                for (int i = 0; i < numFloors * slots[k]; i++)
+                    vehicles.push_back(createVehicle(k, VEHICLE_KIND_NAMES[k][0] + to_string(i), 0));
+            }
+            mt19937 rng(42);
+            shuffle(vehicles.begin(), vehicles.end(), rng);
+
+            vector<SlotHandle> parked(total);
+            auto start = chrono::steady_clock::now();
+            int filled = 0;
+            for (int i = 0; i < fill; i++)
+            {
+                parked[i] = allocator.allocate(vehicles[i]);
+                filled += parked[i].valid();
+            }
+            double fillMs = elapsedMs(start);
+
+            // Shape of the fill, per kind
+            int parkedOf[KIND_COUNT] = {}, floorsUsed[KIND_COUNT] = {}, spreadOf[KIND_COUNT] = {};
+            double distanceSum = 0, nearestSum = 0;
+            for (int i = 0; i < fill; i++)
+            {
+                parkedOf[vehicles[i]->getKind()]++;
+                distanceSum += benchSlotDistance(*floors[parked[i].floorIndex], parked[i].floorIndex,
+                                                 parked[i].position);
+            }
+            bool shaped = filled == fill;
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                int most = 0, least = slots[k];
+                vector<double> distances;
+                for (int f = 0; f < numFloors; f++)
+                {
+                    int free = floors[f]->availableOf(k);
+                    floorsUsed[k] += free < slots[k];
+                    most = max(most, free);
+                    least = min(least, free);
+                    for (int pos = 0; pos < floors[f]->getSlotCount(); pos++)
+                    {
+                        if (floors[f]->slotKind(pos) == k)
+                            distances.push_back(benchSlotDistance(*floors[f], f, pos));
+                    }
+                }
+                spreadOf[k] = most - least;
+                sort(distances.begin(), distances.end());
+                for (int i = 0; i < parkedOf[k]; i++)
+                    nearestSum += distances[i];
+                if (policy == ALLOCATE_SPREAD)
+                    shaped = shaped && spreadOf[k] <= 1;
+                if (policy == ALLOCATE_GROUPED)
+                    shaped = shaped && floorsUsed[k] == (parkedOf[k] + slots[k] - 1) / slots[k];
+            }
+            if (policy == ALLOCATE_NEAREST)
+                shaped = shaped && fabs(distanceSum - nearestSum) < 1e-6 * nearestSum;
+
+            // Lanes churn disjoint parts of the parked and waiting vehicles
+            atomic<int> lost(0);
+            start = chrono::steady_clock::now();
+            vector<thread> workers;
+            for (int lane = 0; lane < lanes; lane++)
+            {
+                workers.emplace_back([&, lane]() {
+                    mt19937 laneRng(lane);
+                    int parkedEnd = fill * (lane + 1) / lanes, parkedBegin = fill * lane / lanes;
+                    int waitingBegin = fill + (total - fill) * lane / lanes;
+                    int waitingEnd = fill + (total - fill) * (lane + 1) / lanes;
+                    for (int i = 0; i < churnPerLane; i++)
+                    {
+                        int out = parkedBegin + (int)(laneRng() % (parkedEnd - parkedBegin));
+                        int in = waitingBegin + (int)(laneRng() % (waitingEnd - waitingBegin));
+                        if (!allocator.release(parked[out]))
+                            lost++;
+                        swap(vehicles[out], vehicles[in]);
+                        parked[out] = allocator.allocate(vehicles[out]);
+                        if (!parked[out].valid())
+                            lost++;
+                    }
+                });
+            }
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+            double churnMs = elapsedMs(start);
+
+            int stillParked = 0;
+            for (int i = 0; i < fill; i++)
+            {
+                if (allocator.release(parked[i]))
+                    stillParked++;
+            }
+            bool consistent = lost == 0 && stillParked == fill;
+            for (auto floor : floors)
+            {
+                for (int k = 0; k < KIND_COUNT; k++)
+                    consistent = consistent && floor->availableOf(k) == slots[k] && floor->recountAvailable(k) == slots[k];
+                delete floor;
+            }
+            for (auto vehicle : vehicles)
+            {
+                delete vehicle;
+            }
+
+            cout << "  " << left << setw(8) << ALLOCATION_POLICY_NAMES[p] << right << fixed << setprecision(0)
+                 << setw(6) << fillMs * 1e6 / fill << " ns/park fill, " << setw(6)
+                 << churnMs * 1e6 / (2.0 * lanes * churnPerLane) << " ns/op churn x" << lanes << " | car floors "
+                 << setw(3) << floorsUsed[KIND_CAR] << ", car spread " << setw(3) << spreadOf[KIND_CAR]
+                 << ", mean distance " << setprecision(1) << distanceSum / fill << " m"
+                 << (shaped ? "" : " ✗ shape") << (consistent ? "" : " ✗ counts") << endl;
+            ok = ok && shaped && consistent;
+        }
+    }
+    cout << (ok ? "✓ every policy filled to its shape and churned without losing a slot"
+                : "✗ a policy broke its shape or the slot counts")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Slot layout before the floor became a table: one heap object per slot
+struct LegacySlot
+{
+    int slotNumber;
+    string slotType;
+    bool isOccupied;
+    Vehicle *parkedVehicle;
+};
+
+// Compares memory and full-scan cost of per-slot objects and the slot table
+int benchSlotLayout()
+{
+    const int numFloors = 100;
+    const array<int, KIND_COUNT> slots = {400, 500, 100};
+    const int perFloor = totalSlots(slots);
+    const int total = numFloors * perFloor;
+    const int scans = 200;
+    mt19937 rng(7);
+
+    vector<ParkingFloor *> floors;
+    vector<vector<LegacySlot *>> legacyFloors(numFloors);
+    vector<Vehicle *> vehicles;
+    for (int f = 0; f < numFloors; f++)
+    {
+        ParkingFloor *floor = new ParkingFloor(f + 1, slots);
+        floors.push_back(floor);
+        for (int pos = 0; pos < perFloor; pos++)
+        {
+            int kind = floor->slotKind(pos);
+            LegacySlot *legacy = new LegacySlot{floor->slotNumberAt(pos), VEHICLE_KIND_NAMES[kind], false, nullptr};
+            legacyFloors[f].push_back(legacy);
+            // Half the garage is occupied, in both layouts alike
+            if (rng() % 2)
+            {
+                Vehicle *vehicle = createVehicle(kind, "V" + to_string(vehicles.size()), 0);
+                vehicles.push_back(vehicle);
+                lock_guard<mutex> lock(floor->kindLock(kind));
+                floor->occupySlot(pos, vehicle);
+                legacy->isOccupied = true;
+                legacy->parkedVehicle = vehicle;
+            }
+        }
+    }
+
+    // Each heap block carries roughly 16 bytes of allocator bookkeeping
+    size_t legacyBytes = 0, tableBytes = 0;
+    for (int f = 0; f < numFloors; f++)
+    {
+        legacyBytes += legacyFloors[f].capacity() * sizeof(LegacySlot *) +
+                       legacyFloors[f].size() * (sizeof(LegacySlot) + 16);
+        tableBytes += floors[f]->memoryFootprint();
+    }
+    cout << left << setw(28) << "per-slot objects" << right << setw(10) << legacyBytes << " bytes "
+         << fixed << setprecision(2) << setw(10) << (double)legacyBytes / total << " B/slot" << endl;
+    cout << left << setw(28) << "slot table" << right << setw(10) << tableBytes << " bytes "
+         << fixed << setprecision(2) << setw(10) << (double)tableBytes / total << " B/slot" << endl;
+
+    long long legacyFree = 0, tableFree = 0;
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < scans; s++)
+    {
+        for (auto &floorSlots : legacyFloors)
+        {
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                for (LegacySlot *slot : floorSlots)
+                {
+                    if (slot->slotType == VEHICLE_KIND_NAMES[k] && !slot->isOccupied)
+                        legacyFree++;
+                }
+            }
+        }
+    }
+    printBenchResult("scan per-slot objects", scans * total, elapsedMs(start));
+
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < scans; s++)
+    {
+        for (ParkingFloor *floor : floors)
+        {
+            for (int k = 0; k < KIND_COUNT; k++)
+            {
+                tableFree += floor->recountAvailable(k);
+            }
+        }
+    }
+    printBenchResult("scan slot table", scans * total, elapsedMs(start));
+
+    bool ok = (legacyFree == tableFree && tableBytes < legacyBytes);
+    for (int f = 0; f < numFloors; f++)
+    {
+        for (LegacySlot *slot : legacyFloors[f])
+        {
+            delete slot;
+        }
+        delete floors[f];
+    }
+    for (auto vehicle : vehicles)
+    {
+        delete vehicle;
+    }
+    cout << (ok ? "✓ both layouts report the same free slots" : "✗ slot layouts disagree") << endl;
+    return ok ? 0 : 1;
+}
+
+// Counts heap allocations while a benchmark has switched counting on, on the
+// benchmark's own thread only; the journal writer's buffers are not the gate
+// path's. The global operator new is only replaced in builds made with
+// -DPARKING_BENCH, so the product allocates through the library's own; other
+// builds count nothing. Only the plain forms are replaced; the library routes
+// the other forms through them.
+thread_local bool countingAllocations = false;
+atomic<long long> allocationCount(0);
+
+#ifdef PARKING_BENCH
+const bool ALLOCATIONS_COUNTED = true;
+
+void *operator new(size_t size)
+{
+    if (countingAllocations)
+        allocationCount.fetch_add(1, memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    while (true)
+    {
+        void *block = malloc(size);
+        if (block)
+            return block;
+        new_handler handler = get_new_handler();
+        if (!handler)
+            throw bad_alloc();
+        handler();
+    }
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+// GCC cannot tell that these frees pair with the malloc above
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *block) noexcept { free(block); }
+void operator delete[](void *block) noexcept { free(block); }
+void operator delete(void *block, size_t) noexcept { free(block); }
+void operator delete[](void *block, size_t) noexcept { free(block); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+const bool ALLOCATIONS_COUNTED = false;
+#endif
+
+// Pass lookups at 1M passes: the former sharded string maps against interned
+// ids with the hashed id table
+int benchPlateLookup()
+{
+    const int passCount = 1000000, lookups = 2000000, shardCount = 64;
+    vector<string> numbers;
+    numbers.reserve(passCount);
+    for (int i = 0; i < passCount; i++)
+    {
+        numbers.push_back("KA" + to_string(10000000 + i));
+    }
+
+    struct LegacyShard
+    {
+        shared_mutex lock;
+        map<string, int> items;
+    };
+    vector<LegacyShard> legacy(shardCount);
+    PlateInterner plates;
+    IdTable<int> passes;
+    for (int i = 0; i < passCount; i++)
+    {
+        legacy[hash<string>()(numbers[i]) % shardCount].items[numbers[i]] = i;
+        passes.insert(plates.intern(numbers[i]), i);
+    }
+
+    // One in ten queries is a plate without a pass
+    mt19937 rng(11);
+    vector<string> queries;
+    vector<PlateId> queryIds;
+    for (int i = 0; i < lookups; i++)
+    {
+        int pick = rng() % passCount;
+        queries.push_back(i % 10 == 0 ? "MH" + to_string(pick) : numbers[pick]);
+        queryIds.push_back(plates.find(queries.back()));
+    }
+
+    long long legacyHits = 0, internedHits = 0, idHits = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto &plate : queries)
+    {
+        LegacyShard &shard = legacy[hash<string>()(plate) % shardCount];
+        shared_lock<shared_mutex> guard(shard.lock);
+        legacyHits += shard.items.count(plate);
+    }
+    double legacyMs = elapsedMs(start);
+    printBenchResult("sharded map<string>", lookups, legacyMs);
+
+    start = chrono::steady_clock::now();
+    for (auto &plate : queries)
+    {
+        internedHits += passes.read(plates.find(plate), [](const int *pass) { return pass != nullptr; });
+    }
+    double internedMs = elapsedMs(start);
+    printBenchResult("intern + id table", lookups, internedMs);
+
+    start = chrono::steady_clock::now();
+    for (PlateId id : queryIds)
+    {
+        idHits += passes.read(id, [](const int *pass) { return pass != nullptr; });
+    }
+    double idMs = elapsedMs(start);
+    printBenchResult("id table by id", lookups, idMs);
+
+    cout << fixed << setprecision(1) << "lookups/s: map " << lookups / legacyMs / 1000 << "M, intern + table "
+         << lookups / internedMs / 1000 << "M, by id " << lookups / idMs / 1000 << "M" << endl;
+    bool ok = legacyHits == internedHits && internedHits == idHits && plates.size() == (size_t)passCount &&
+              passes.size() == (size_t)passCount;
+    cout << (ok ? "✓ all three found the same passes" : "✗ lookup results differ") << endl;
+    return ok ? 0 : 1;
+}
+
+string makeBenchDir(string name)
+{
+    filesystem::path dir = filesystem::temp_directory_path() / ("parking_bench_" + name);
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    return dir.string();
+}
+
+// Restarts a site with 10k active tickets and 300k passes from each format
+int benchStartup()
+{
+    const int numFloors = 10;
+    ParkingConfig config;
+    config.slotsPerFloor = {400, 500, 100};
+    const int ticketCount = 10000, passCount = 300000;
+    const time_t now = time(0);
+
+    string textDir = makeBenchDir("text");
+    string binaryDir = makeBenchDir("binary");
+    ofstream ticketFile(textDir + "/parking_tickets.txt");
+    ofstream passFile(textDir + "/monthly_passes.txt");
+    SnapshotWriter writer;
+    int perFloor = config.slotsPerFloorTotal();
+    int stride = slotNumberStride(perFloor);
+    for (int i = 0; i < ticketCount; i++)
+    {
+        int floor = 1 + i / perFloor, pos = i % perFloor;
+        int kind = 0;
+        for (int first = 0; pos >= first + config.slotsPerFloor[kind]; kind++)
+            first += config.slotsPerFloor[kind];
+        string plate = "KA01T" + to_string(i);
+        int slot = floor * stride + pos + 1;
+        time_t entry = now - (i % 7200);
+        // Some parked at a rate no type charges any more
+        double rate = VEHICLE_KIND_RATES[kind] + (i % 10 == 0 ? 5 : 0);
+        ticketFile << plate << "," << slot << "," << rate << "," << entry << "\n";
+        writer.addTicket(plate, slot, kind, rate, entry);
+    }
+    for (int i = 0; i < passCount; i++)
+    {
+        string plate = "MH12P" + to_string(i);
+        time_t start = now - (i % 86400);
+        passFile << plate << ",PASS" << start << "," << start << "," << start + 30 * 24 * 60 * 60 << "\n";
+        writer.addPass(plate, start, start + 30 * 24 * 60 * 60);
+    }
+    ticketFile.close();
+    passFile.close();
+    ofstream(textDir + "/revenue.txt") << "12345.5\n0\n";
+    writer.write(binaryDir + "/parking_snapshot.bin", 12345.5, 0);
+
+    bool ok = true;
+    string dirs[2] = {textDir, binaryDir};
+    string labels[2] = {"startup from text files", "startup from binary snapshot"};
+    double ms[2];
+    for (int i = 0; i < 2; i++)
+    {
+        config.dataDir = dirs[i];
+        auto start = chrono::steady_clock::now();
+        SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+        ms[i] = elapsedMs(start);
+        printBenchResult(labels[i], ticketCount + passCount, ms[i]);
+        ok = ok && system->getActiveTicketCount() == (size_t)ticketCount &&
+             system->getPassCount() == (size_t)passCount && system->getTotalRevenue() == 12345.5;
+        delete system;
+    }
+    cout << fixed << setprecision(1) << "speed-up " << ms[0] / ms[1] << "x" << endl;
+
+    // A flipped header bit must be caught, including a ticket count whose
+    // product with the record size wraps back to the real body size
+    string image;
+    {
+        ifstream file(binaryDir + "/parking_snapshot.bin", ios::binary);
+        image.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+    const size_t flips[4][2] = {{offsetof(SnapshotHeader, ticketCount) + 7, 3},
+                                {offsetof(SnapshotHeader, ticketCount) + 7, 7},
+                                {offsetof(SnapshotHeader, lastLsn), 0},
+                                {offsetof(SnapshotHeader, totalRevenue) + 2, 5}};
+    bool rejected = true;
+    for (auto &flip : flips)
+    {
+        string damaged = image;
+        damaged[flip[0]] ^= (char)(1 << flip[1]);
+        ofstream(binaryDir + "/damaged.bin", ios::binary) << damaged;
+        SnapshotReader reader;
+        string error;
+        rejected = !reader.open(binaryDir + "/damaged.bin", error) && rejected;
+    }
+    cout << (rejected ? "✓ " : "✗ ") << "snapshots with a flipped header bit were rejected" << endl;
+    ok = ok && rejected;
+
+    filesystem::remove_all(textDir);
+    filesystem::remove_all(binaryDir);
+    cout << (ok ? "✓ both formats restored identical state" : "✗ restored state differs") << endl;
+    return ok ? 0 : 1;
+}
+
+// Config for gate benchmarks: a temp data dir and no fsync or compaction
+ParkingConfig benchGateConfig(string name)
+{
+    ParkingConfig config;
+    config.slotsPerFloor = SIMULATED_SLOTS_PER_FLOOR;
+    config.dataDir = makeBenchDir(name);
+    config.journal.fsyncEveryRecords = 0;
+    config.journal.compactEveryRecords = 0;
+    return config;
+}
+
+// Lanes race to park and exit a shared pool of plates; afterwards every
+// plate, ticket and slot must still agree
+int benchGateStress()
+{
+    const int numFloors = 40, laneCount = 8, opsPerLane = 20000, plateCount = 3000;
+    ParkingConfig config = benchGateConfig("stress");
+    SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+    // A signage listener must see exactly one delta per park and per exit
+    atomic<long> signageDelta(0);
+    int listenerId = system->subscribeAvailability([&](const AvailabilityDelta &delta) {
+        signageDelta += delta.change;
+    });
+
+    vector<atomic<int>> parkedCount(plateCount);
+    atomic<long> parks(0), exits(0);
+    auto start = chrono::steady_clock::now();
+    vector<thread> lanes;
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        lanes.emplace_back([&, lane]() {
+            mt19937 rng(lane + 1);
+            for (int i = 0; i < opsPerLane; i++)
+            {
+                int plate = rng() % plateCount;
+                string number = "ST" + to_string(plate);
+                if (rng() % 2 == 0)
+                {
+                    if (system->admitVehicle(number, VEHICLE_KIND_NAMES[plate % KIND_COUNT]).status == PARK_OK)
+                    {
+                        parks++;
+                        parkedCount[plate]++;
+                    }
+                }
+                else if (system->releaseVehicle(number, "Card").status == EXIT_OK)
+                {
+                    exits++;
+                    parkedCount[plate]--;
+                }
+            }
+        });
+    }
+    for (auto &lane : lanes)
+    {
+        lane.join();
+    }
+    printBenchResult("8 lanes, shared plates", laneCount * opsPerLane, elapsedMs(start));
+    system->unsubscribeAvailability(listenerId);
+
+    // Every plate must have alternated park/exit, ending parked iff it holds a ticket
+    vector<TicketRecord> tickets = system->activeTicketRecords();
+    vector<int> expected(plateCount, 0), slotNumbers;
+    for (auto &t : tickets)
+    {
+        expected[stoi(t.vehicleNumber.substr(2))] = 1;
+        slotNumbers.push_back(t.slotNumber);
+    }
+    int violations = 0;
+    for (int p = 0; p < plateCount; p++)
+    {
+        if (parkedCount[p] != expected[p])
+            violations++;
+    }
+    sort(slotNumbers.begin(), slotNumbers.end());
+    bool uniqueSlots = adjacent_find(slotNumbers.begin(), slotNumbers.end()) == slotNumbers.end();
+    int capacity = numFloors * config.slotsPerFloorTotal();
+    int available = 0;
+    for (int k = 0; k < KIND_COUNT; k++)
+        available += system->getAvailableCount(VEHICLE_KIND_NAMES[k]);
+
+    AvailabilitySnapshot signage = system->availabilitySnapshot();
+    int signageAvailable = 0;
+    for (int k = 0; k < KIND_COUNT; k++)
+    {
+        signageAvailable += signage.totals[k];
+    }
+
+    bool ok = violations == 0 && uniqueSlots && (long)tickets.size() == parks - exits &&
+              capacity - available == (int)tickets.size() && signageAvailable == available &&
+              -signageDelta == (long)tickets.size();
+    cout << "parks " << parks << ", exits " << exits << ", active " << tickets.size()
+         << ", occupied " << capacity - available << ", violations " << violations << endl;
+
+    // The journal written under contention must rebuild the same garage
+    string replayDir = makeBenchDir("stress_replay");
+    system->flush();
+    filesystem::copy_file(config.dataDir + "/parking_journal.log", replayDir + "/parking_journal.log");
+    delete system;
+    filesystem::remove_all(config.dataDir);
+    config.dataDir = replayDir;
+    SmartParkingSystem *replayed = new SmartParkingSystem(numFloors, config);
+    vector<TicketRecord> replayedTickets = replayed->activeTicketRecords();
+    auto bySlot = [](const TicketRecord &a, const TicketRecord &b) { return a.slotNumber < b.slotNumber; };
+    sort(tickets.begin(), tickets.end(), bySlot);
+    sort(replayedTickets.begin(), replayedTickets.end(), bySlot);
+    bool sameState = tickets.size() == replayedTickets.size();
+    for (size_t i = 0; sameState && i < tickets.size(); i++)
+    {
+        sameState = tickets[i].vehicleNumber == replayedTickets[i].vehicleNumber &&
+                    tickets[i].slotNumber == replayedTickets[i].slotNumber;
+    }
+    cout << (sameState ? "✓ journal replay rebuilt the same tickets" : "✗ journal replay diverged") << endl;
+    ok = ok && sameState;
+    delete replayed;
+    filesystem::remove_all(replayDir);
+
+    cout << (ok ? "✓ no slot or ticket was double-booked" : "✗ concurrent gate invariants violated") << endl;
+    return ok ? 0 : 1;
+}
+
+// Counts heap allocations per park/exit cycle once the pools are warm
+int benchAllocations()
+{
+    if (!ALLOCATIONS_COUNTED)
+    {
+        cout << "skipped: allocations are only counted in a build made with -DPARKING_BENCH" << endl;
+        return 0;
+    }
+    const int numFloors = 40, plateCount = 1500, window = 500, cycles = 200000;
+    ParkingConfig config = benchGateConfig("alloc");
+    SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+    vector<string> plates, types;
+    for (int i = 0; i < plateCount; i++)
+    {
+        plates.push_back("AL" + to_string(i));
+        types.push_back(VEHICLE_KIND_NAMES[i % KIND_COUNT]);
+    }
+
+    // A rolling window of parked vehicles: each cycle one arrives and the
+    // longest parked one leaves, walking the plates round and round
+    int failures = 0;
+    auto runCycles = [&](int first, int count) {
+        for (int i = first; i < first + count; i++)
+        {
+            if (system->admitVehicle(plates[i % plateCount], types[i % plateCount]).status != PARK_OK)
+                failures++;
+            if (i >= window && system->releaseVehicle(plates[(i - window) % plateCount], "Card").status != EXIT_OK)
+                failures++;
+        }
+    };
+
+    long long slabsBefore = ticketPool().getSlabCount() + vehiclePool().getSlabCount();
+    allocationCount = 0;
+    countingAllocations = true;
+    auto start = chrono::steady_clock::now();
+    runCycles(0, 2 * plateCount);
+    double warmMs = elapsedMs(start);
+    countingAllocations = false;
+    long long warmAllocations = allocationCount;
+
+    int historyChunksBefore = system->getHistory().getChunkCount();
+    allocationCount = 0;
+    countingAllocations = true;
+    start = chrono::steady_clock::now();
+    runCycles(2 * plateCount, cycles);
+    double steadyMs = elapsedMs(start);
+    countingAllocations = false;
+    long long steadyAllocations = allocationCount;
+    long long slabsGrown = ticketPool().getSlabCount() + vehiclePool().getSlabCount() - slabsBefore;
+    int historyChunks = system->getHistory().getChunkCount() - historyChunksBefore;
+
+    printBenchResult("warm-up park/exit cycles", 2 * plateCount, warmMs);
+    printBenchResult("steady park/exit cycles", cycles, steadyMs);
+    cout << "heap allocations: " << warmAllocations << " during warm-up, " << steadyAllocations
+         << " over " << cycles << " steady cycles (" << fixed << setprecision(3)
+         << (double)steadyAllocations / cycles << " per cycle); pool slabs added " << slabsGrown
+         << "; history chunks added " << historyChunks << endl;
+
+    delete system;
+    filesystem::remove_all(config.dataDir);
+    // The history grows by one chunk allocation per 65536 exits
+    bool ok = failures == 0 && steadyAllocations == historyChunks;
+    cout << (ok ? "✓ no heap allocations per park/exit once warmed up, besides history chunks"
+                : "✗ gate path still allocates")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Entry and exit bursts with an fsync per journal write, one call per event
+// against processEvents batches
+int benchBatchIngest()
+{
+    const int numFloors = 120, vehicles = 3000, batchSize = 500;
+    vector<GateEvent> parks, exits;
+    for (int i = 0; i < vehicles; i++)
+    {
+        GateEvent event;
+        event.type = GATE_PARK;
+        event.vehicleNumber = "BT" + to_string(i);
+        event.detail = VEHICLE_KIND_NAMES[i % KIND_COUNT];
+        parks.push_back(event);
+        event.type = GATE_EXIT;
+        event.detail = "Card";
+        exits.push_back(event);
+    }
+
+    bool ok = true;
+    double ms[2];
+    for (int batched = 0; batched < 2; batched++)
+    {
+        ParkingConfig config = benchGateConfig(batched ? "batch" : "single");
+        // Inline writes, so every journal write waits for its fsync
+        config.journal.asyncWrites = false;
+        config.journal.fsyncEveryRecords = 1;
+        SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+        int parked = 0, exited = 0;
+        auto start = chrono::steady_clock::now();
+        for (auto *burst : {&parks, &exits})
+        {
+            if (batched)
+            {
+                vector<GateOutcome> outcomes;
+                for (int first = 0; first < vehicles; first += batchSize)
+                {
+                    vector<GateEvent> events(burst->begin() + first, burst->begin() + min(first + batchSize, vehicles));
+                    system->processEvents(events, outcomes);
+                    for (auto &outcome : outcomes)
+                    {
+                        parked += outcome.park.status == PARK_OK;
+                        exited += outcome.exit.status == EXIT_OK;
+                    }
+                }
+            }
+            else
+            {
+                for (auto &event : *burst)
+                {
+                    if (event.type == GATE_PARK)
+                        parked += system->admitVehicle(event.vehicleNumber, event.detail).status == PARK_OK;
+                    else
+                        exited += system->releaseVehicle(event.vehicleNumber, event.detail).status == EXIT_OK;
+                }
+            }
+        }
+        ms[batched] = elapsedMs(start);
+        printBenchResult(batched ? "batches of 500" : "one call per event", 2 * vehicles, ms[batched]);
+        ok = ok && parked == vehicles && exited == vehicles && system->getActiveTicketCount() == 0;
+        delete system;
+        filesystem::remove_all(config.dataDir);
+    }
+    cout << fixed << setprecision(1) << "speed-up " << ms[0] / ms[1] << "x" << endl;
+
+#ifndef _WIN32
+    // The same parks piped into stdin, as the cameras feed --stream: all of
+    // them are buffered before the stream starts, so they make one batch.
+    // The stream reports its batches on stderr.
+    const int piped = 1000;
+    string commands;
+    for (int i = 0; i < piped; i++)
+        commands += "PARK,PP" + to_string(i) + "," + VEHICLE_KIND_NAMES[i % KIND_COUNT] + "\n";
+    int pipeEnds[2];
+    GateStreamReport report;
+    if (pipe(pipeEnds) == 0)
+    {
+        bool written = write(pipeEnds[1], commands.data(), commands.size()) == (ssize_t)commands.size();
+        close(pipeEnds[1]);
+        int savedStdin = dup(0);
+        dup2(pipeEnds[0], 0);
+        close(pipeEnds[0]);
+        ParkingConfig config = benchGateConfig("piped");
+        SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+        DiscardBuffer discard;
+        ostream results(&discard);
+        if (written)
+            report = runStdinGateStream(*system, results);
+        dup2(savedStdin, 0);
+        close(savedStdin);
+        cin.clear();
+        delete system;
+        filesystem::remove_all(config.dataDir);
+    }
+    ok = ok && report.events == piped && report.batches == 1;
+#endif
+    cout << (ok ? "✓ every vehicle parked and left in both modes" : "✗ batch results differ") << endl;
+    return ok ? 0 : 1;
+}
+
+// Runs the same simulation twice: the outcome must repeat exactly
+int benchSimulation()
+{
+    SimulationConfig sim;
+    sim.arrivals = 300000;
+    sim.arrivalModel = "daily";
+    sim.dwellModel = "lognormal";
+    SimulationReport first = runSimulation(sim);
+    printSimulationReport(first, cout);
+    SimulationReport second = runSimulation(sim);
+
+    bool same = first.parks == second.parks && first.exits == second.exits &&
+                first.rejectedFull == second.rejectedFull && first.revenue == second.revenue &&
+                first.occupancy.size() == second.occupancy.size();
+    for (size_t i = 0; same && i < first.occupancy.size(); i++)
+    {
+        same = first.occupancy[i].occupied == second.occupancy[i].occupied;
+    }
+    bool ok = same && first.parks == first.exits;
+    cout << (ok ? "✓ a second run with the same seed matched exactly" : "✗ simulation is not repeatable") << endl;
+    return ok ? 0 : 1;
+}
+
+// Cost of one latency sample (two clock reads and a histogram update), alone
+// and with 8 lanes recording into the same histogram
+int benchMetricsOverhead()
+{
+    const int samples = 2000000;
+    LogHistogram histogram(LATENCY_SHIFT, LATENCY_BUCKETS);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++)
+    {
+        LatencyTimer timer(histogram);
+    }
+    printBenchResult("1 lane timed samples", samples, elapsedMs(start));
+
+    const int laneCount = 8;
+    vector<thread> lanes;
+    start = chrono::steady_clock::now();
+    for (int lane = 0; lane < laneCount; lane++)
+    {
+        lanes.emplace_back([&]() {
+            for (int i = 0; i < samples; i++)
+            {
+                LatencyTimer timer(histogram);
+            }
+        });
+    }
+    for (auto &lane : lanes)
+    {
+        lane.join();
+    }
+    printBenchResult("8 lanes timed samples", samples * laneCount, elapsedMs(start));
+
+    uint64_t total = 0;
+    for (int i = 0; i < histogram.getBucketCount(); i++)
+    {
+        total += histogram.bucketValue(i);
+    }
+    bool ok = total == (uint64_t)samples * (laneCount + 1);
+    cout << (ok ? "✓ every sample was counted" : "✗ histogram lost samples") << endl;
+    return ok ? 0 : 1;
+}
+
+// Books 20k windows over a week, then answers "capacity from 09:00 to
+// 18:00" from the timelines and by scanning every booking; the answers must
+// agree. A small garage then checks walk-ins leave booked capacity alone,
+// booked vehicles still get in, and bookings survive replay and restart.
+int benchReservations()
+{
+    const int numFloors = 20, bookings = 20000, queries = 100000, scanned = 1000;
+    const time_t dayStart = 1767225600, bucket = 15 * 60;
+    ManualClock clock(dayStart + 8 * 3600);
+    ParkingConfig config = benchGateConfig("reserve");
+    config.clock = &clock;
+    bool ok = true;
+
+    SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+    mt19937 rng(7);
+    vector<Reservation> accepted;
+    string error;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < bookings; i++)
+    {
+        int kind = (int)(rng() % KIND_COUNT);
+        time_t from = clock.now() + (time_t)(rng() % (7 * 96)) * bucket;
+        time_t to = from + (time_t)(4 + rng() % 40) * bucket;
+        string plate = "RS" + to_string(i);
+        long long id = system->reserveSlot(plate, (VehicleKind)kind, from, to, error);
+        if (id > 0)
+            accepted.push_back(Reservation{id, plate, kind, from, to, false});
+    }
+    printBenchResult("book a window", bookings, elapsedMs(start));
+
+    // Capacity in the busiest bucket of [from, to), found by walking every booking
+    auto scanCapacity = [&](int kind, time_t from, time_t to) {
+        vector<pair<time_t, int>> edges;
+        for (auto &booking : accepted)
+        {
+            time_t bookedFrom = booking.start - (booking.start - dayStart) % bucket;
+            time_t bookedTo = booking.end + (bucket - (booking.end - dayStart) % bucket) % bucket;
+            if (booking.kind == kind && bookedFrom < to && bookedTo > from)
+            {
+                edges.push_back({max(bookedFrom, from), 1});
+                edges.push_back({bookedTo, -1});
+            }
+        }
+        sort(edges.begin(), edges.end());
+        int booked = 0, busiest = 0;
+        for (auto &edge : edges)
+        {
+            booked += edge.second;
+            busiest = max(busiest, booked);
+        }
+        return (int)(numFloors * config.slotsPerFloor[kind] * config.reservations.bookableShare) - busiest;
+    };
+    vector<int> treeAnswers(queries);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++)
+    {
+        time_t from = dayStart + (i % 7) * 86400 + 9 * 3600;
+        treeAnswers[i] = system->reservableCapacity((VehicleKind)(i % KIND_COUNT), from, from + 9 * 3600);
+    }
+    printBenchResult("capacity, timeline", queries, elapsedMs(start));
+    int mismatches = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < scanned; i++)
+    {
+        time_t from = dayStart + (i % 7) * 86400 + 9 * 3600;
+        mismatches += scanCapacity(i % KIND_COUNT, from, from + 9 * 3600) != treeAnswers[i];
+    }
+    printBenchResult("capacity, scan all bookings", scanned, elapsedMs(start));
+    cout << accepted.size() << " of " << bookings << " windows booked, " << mismatches << " of " << scanned
+         << " answers differ" << endl;
+    ok = ok && mismatches == 0 && !accepted.empty() && accepted.size() < (size_t)bookings;
+    delete system;
+    filesystem::remove_all(config.dataDir);
+
+    // One floor, 50 car slots, 25 bookable; 10 bookings start in 20 minutes,
+    // after a parked one that ends in 15 and so must not shrink their hold
+    ParkingConfig small = benchGateConfig("reserve_walkin");
+    small.clock = &clock;
+    system = new SmartParkingSystem(1, small);
+    const int booked = 10, carSlots = small.slotsPerFloor[KIND_CAR];
+    int bookedOk = 0;
+    for (int i = 0; i < booked; i++)
+        bookedOk += system->reserveSlot("BK" + to_string(i), KIND_CAR, clock.now() + 1200, clock.now() + 7200, error) > 0;
+    bookedOk += system->reserveSlot("EARLY", KIND_CAR, clock.now(), clock.now() + 900, error) > 0;
+    system->flush();
+    string replayDir = makeBenchDir("reserve_replay");
+    filesystem::copy_file(small.dataDir + "/parking_journal.log", replayDir + "/parking_journal.log");
+    bool earlyParked = system->admitVehicle("EARLY", KIND_CAR).status == PARK_OK;
+    int walkIns = 0;
+    while (system->admitVehicle("WI" + to_string(walkIns), KIND_CAR).status == PARK_OK)
+        walkIns++;
+    int held = system->heldForBookings(KIND_CAR);
+    system->shutdown();
+    delete system;
+
+    system = new SmartParkingSystem(1, small);
+    int arrivals = 0;
+    for (int i = 0; i < booked; i++)
+        arrivals += system->admitVehicle("BK" + to_string(i), KIND_CAR).status == PARK_OK;
+    bool fullAfter = system->admitVehicle("WI_LATE", KIND_CAR).status == PARK_FULL;
+    system->releaseVehicle("BK0", "Card");
+    size_t leftAfterExit = system->getReservationCount();
+    delete system;
+    ParkingConfig replayed = small;
+    replayed.dataDir = replayDir;
+    system = new SmartParkingSystem(1, replayed);
+    size_t replayedBookings = system->getReservationCount();
+    delete system;
+    filesystem::remove_all(small.dataDir);
+    filesystem::remove_all(replayDir);
+    cout << walkIns << " walk-ins admitted with " << held << " of " << carSlots << " slots held, " << arrivals << " of "
+         << booked << " booked cars parked after a restart, " << replayedBookings << " bookings replayed" << endl;
+    ok = ok && bookedOk == booked + 1 && earlyParked && walkIns == carSlots - booked - 1 && held == booked &&
+         arrivals == booked && fullAfter && leftAfterExit == (size_t)booked && replayedBookings == (size_t)booked + 1;
+    cout << (ok ? "✓ timelines matched a full scan, and walk-ins never took booked capacity"
+                : "✗ booked capacity was miscounted")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Cost of the rolling statistics per event, then their accuracy on a
+// steadily filling floor and on one in balance with known rates and dwell
+int benchOccupancyForecast()
+{
+    const int numFloors = 50, events = 2000000;
+    OccupancyStats stats(numFloors, 15);
+    time_t t = 1767225600;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < events; i += 2)
+    {
+        int floor = i % numFloors, kind = i % KIND_COUNT;
+        stats.recordArrival(floor, kind, t + i);
+        stats.recordDeparture(floor, kind, t + i + 1, 3600 + i % 7200);
+    }
+    printBenchResult("record park/exit", events, elapsedMs(start));
+    start = chrono::steady_clock::now();
+    double sink = 0;
+    for (int i = 0; i < events; i++)
+        sink += stats.forecast(i % numFloors, i % KIND_COUNT, 10, 50, t + events, 30).minutesToFull;
+    printBenchResult("forecast a pool", events, elapsedMs(start) + (sink == 0.123 ? 1 : 0));
+    cout << "state for " << numFloors << " floors: " << stats.memoryFootprint() / 1024 << " KiB, whatever the traffic"
+         << endl;
+
+    auto near = [](double value, double expected, double tolerance) {
+        return fabs(value - expected) <= tolerance * expected;
+    };
+    bool ok = true;
+    ManualClock clock(t);
+    ParkingConfig config = benchGateConfig("forecast");
+    config.clock = &clock;
+    const int carSlots = config.slotsPerFloor[KIND_CAR];
+
+    // A car every 30 s into an empty floor: 120/h, 50 slots, full at 25 min
+    SmartParkingSystem *system = new SmartParkingSystem(1, config);
+    int parked = 0;
+    FillForecast early;
+    while (system->admitVehicle("FC" + to_string(parked), KIND_CAR).status == PARK_OK)
+    {
+        parked++;
+        if (parked == carSlots * 2 / 5)
+            early = system->forecastFill(0, KIND_CAR);
+        clock.advance(30);
+    }
+    double actualMinutes = (carSlots - carSlots * 2 / 5) * 30 / 60.0;
+    cout << fixed << setprecision(1) << "filling: " << early.arrivalsPerHour << "/h in, forecast full in "
+         << early.minutesToFull << " min, actually full in " << actualMinutes << " min" << endl;
+    ok = ok && parked == carSlots && near(early.arrivalsPerHour, 120, 0.1) && near(early.minutesToFull, actualMinutes, 0.15);
+
+    // Then 20 of them leave 10 s apart and nobody comes in: more would be
+    // free in 30 min than the floor has, so the outlook stops at full
+    for (int i = 0; i < 20; i++)
+    {
+        system->releaseVehicle("FC" + to_string(i), "Card");
+        clock.advance(10);
+    }
+    FillForecast draining = system->forecastFill(0, KIND_CAR);
+    cout << "draining: " << draining.departuresPerHour << "/h out, " << draining.available << " of " << carSlots
+         << " free, " << draining.availableAtHorizon << " in 30 min" << endl;
+    ok = ok && draining.departuresPerHour > draining.arrivalsPerHour && draining.availableAtHorizon == carSlots;
+    delete system;
+    filesystem::remove_all(config.dataDir);
+
+    // A car a minute, each staying 40 min: 60/h both ways, never filling
+    config.dataDir = makeBenchDir("forecast");
+    system = new SmartParkingSystem(1, config);
+    deque<pair<time_t, int>> leaving;
+    for (int minute = 0; minute < 180; minute++)
+    {
+        system->admitVehicle("FB" + to_string(minute), KIND_CAR);
+        leaving.push_back({clock.now() + 40 * 60, minute});
+        clock.advance(60);
+        while (!leaving.empty() && leaving.front().first <= clock.now())
+        {
+            system->releaseVehicle("FB" + to_string(leaving.front().second), "Card");
+            leaving.pop_front();
+        }
+    }
+    FillForecast steady = system->forecastFill(0, KIND_CAR);
+    double median = system->dwellMinutes(KIND_CAR, 0.5);
+    AvailabilitySnapshot snapshot = system->availabilitySnapshot();
+    cout << "balanced: " << steady.arrivalsPerHour << "/h in, " << steady.departuresPerHour << "/h out, "
+         << steady.available << " of " << carSlots << " free, " << steady.availableAtHorizon
+         << " in 30 min, median dwell " << median
+         << " min" << endl;
+    ok = ok && near(steady.arrivalsPerHour, 60, 0.1) && near(steady.departuresPerHour, 60, 0.1) &&
+         abs(steady.availableAtHorizon - steady.available) <= 2 && near(median, 40, 0.1) &&
+         snapshot.floors[0].minutesToFull[KIND_BIKE] < 0;
+    delete system;
+    filesystem::remove_all(config.dataDir);
+    cout << (ok ? "✓ rates, fill time and dwell matched the traffic driven through the gates"
+                : "✗ the forecast drifted from the traffic")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// A shift change: 4800 vehicles, 90% of them pass holders, leave after
+// 2.5 hours. Every exit path must charge the same, and the express lane
+// must turn away exactly the vehicles without a pass, leaving them parked.
+int benchPassHolderExits()
+{
+    const int numFloors = 100, fleet = 4800, lanes = 4;
+    const time_t entryAt = 1767258000, exitAt = entryAt + 9000;
+    ManualClock clock(entryAt);
+    vector<string> plates, holders;
+    for (int i = 0; i < fleet; i++)
+    {
+        plates.push_back("SC" + to_string(i));
+        if (i % 10 != 0)
+            holders.push_back(plates.back());
+    }
+    const int payers = fleet - (int)holders.size();
+    double expectedRevenue = payers * CompiledTariff(TariffRules()).fee(KIND_CAR, entryAt, exitAt);
+
+    enum Mode
+    {
+        RECEIPTS,
+        RELEASE,
+        RESTARTED,
+        EXPRESS,
+        EXPRESS_LANES
+    };
+    const char *labels[] = {"exitVehicle with receipts", "releaseVehicle", "releaseVehicle, restarted",
+                            "expressExit", "expressExit, 4 lanes"};
+    bool ok = true;
+    for (int mode = RECEIPTS; mode <= EXPRESS_LANES; mode++)
+    {
+        ParkingConfig config = benchGateConfig("pass_exit");
+        config.clock = &clock;
+        clock.set(entryAt - 86400);
+        SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+        vector<time_t> starts;
+        system->renewMonthlyPasses(holders, starts);
+        clock.set(entryAt);
+        for (auto &plate : plates)
+            system->admitVehicle(plate, KIND_CAR);
+        if (mode == RESTARTED)
+        {
+            // Restored tickets carry no entry-time terms, so every exit looks them up
+            delete system;
+            system = new SmartParkingSystem(numFloors, config);
+        }
+        clock.set(exitAt);
+        double revenueBefore = system->getTotalRevenue();
+
+        atomic<int> done(0), paymentDue(0);
+        auto exitRange = [&](int first, int last) {
+            for (int i = first; i < last; i++)
+            {
+                if (mode == RECEIPTS)
+                    done += system->exitVehicle(plates[i], "Card");
+                else if (mode == RELEASE || mode == RESTARTED)
+                    done += system->releaseVehicle(plates[i], "Card").status == EXIT_OK;
+                else
+                {
+                    ExitStatus status = system->expressExit(plates[i]).status;
+                    done += status == EXIT_OK;
+                    paymentDue += status == EXIT_PAYMENT_DUE;
+                }
+            }
+        };
+        DiscardBuffer discard;
+        streambuf *console = cout.rdbuf(mode == RECEIPTS ? &discard : cout.rdbuf());
+        auto start = chrono::steady_clock::now();
+        if (mode == EXPRESS_LANES)
+        {
+            vector<thread> workers;
+            for (int lane = 0; lane < lanes; lane++)
+                workers.emplace_back(exitRange, fleet * lane / lanes, fleet * (lane + 1) / lanes);
+            for (auto &worker : workers)
+                worker.join();
+        }
+        else
+            exitRange(0, fleet);
+        double ms = elapsedMs(start);
+        cout.rdbuf(console);
+        printBenchResult(labels[mode], fleet, ms);
+
+        if (mode >= EXPRESS)
+        {
+            // The payers are still parked and settle at a staffed lane
+            ok = ok && paymentDue == payers && done == fleet - payers &&
+                 system->getActiveTicketCount() == (size_t)payers;
+            for (int i = 0; i < fleet; i += 10)
+                done += system->releaseVehicle(plates[i], "Card").status == EXIT_OK;
+        }
+        double revenue = system->getTotalRevenue() - revenueBefore;
+        ok = ok && done == fleet && system->getActiveTicketCount() == 0 &&
+             fabs(revenue - expectedRevenue) < 0.005 * payers;
+        delete system;
+        filesystem::remove_all(config.dataDir);
+    }
+    cout << (ok ? "✓ every path charged only the payers, the same amount, and the pass lane held back the rest"
+                : "✗ exit paths disagree")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Gate lanes park and exit while the compactor checkpoints a site holding
+// 300k passes; traffic may only wait while each checkpoint is copied. Then
+// the files a crash could leave behind must restore the live site exactly.
+int benchCheckpoints()
+{
+    const int numFloors = 100, laneCount = 8, cyclesPerLane = 20000, passCount = 300000;
+    bool ok = true;
+    {
+        ParkingConfig config = benchGateConfig("checkpoint");
+        config.journal.compactEveryRecords = 40000;
+        SmartParkingSystem site(numFloors, config);
+        vector<string> passPlates;
+        vector<time_t> starts;
+        for (int i = 0; i < passCount; i++)
+            passPlates.push_back("CP" + to_string(i));
+        site.renewMonthlyPasses(passPlates, starts);
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> lanes;
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            lanes.emplace_back([&site, lane]() {
+                for (int i = 0; i < cyclesPerLane; i++)
+                {
+                    string plate = "LN" + to_string(lane) + "-" + to_string(i % 200);
+                    site.admitVehicle(plate, KIND_CAR);
+                    site.releaseVehicle(plate, "Card");
+                }
+            });
+        }
+        for (auto &lane : lanes)
+            lane.join();
+        printBenchResult("park/exit while checkpointing", 2 * laneCount * cyclesPerLane, elapsedMs(start));
+
+        const LogHistogram &pause = site.getCheckpointPause(), &write = site.getSnapshotLatency();
+        uint64_t checkpoints = pause.count();
+        double pauseMs = checkpoints ? pause.sum() / 1e6 / checkpoints : 0;
+        double writeMs = write.count() ? write.sum() / 1e6 / write.count() : 0;
+        cout << checkpoints << " checkpoints: lanes waited " << fixed << setprecision(2) << pauseMs
+             << " ms per checkpoint, which took " << writeMs << " ms more to write" << endl;
+        ok = checkpoints >= 2 && pauseMs < writeMs / 2;
+    }
+    filesystem::remove_all(filesystem::temp_directory_path() / "parking_bench_checkpoint");
+
+    // Crash images: the live site's files after flush(), then damaged the
+    // way a crash at each step of a checkpoint would leave them
+    ManualClock clock(1767258000);
+    ParkingConfig config = benchGateConfig("checkpoint_live");
+    config.clock = &clock;
+    SmartParkingSystem *live = new SmartParkingSystem(numFloors, config);
+    auto traffic = [&](int from, int to) {
+        vector<string> passes;
+        vector<time_t> starts;
+        for (int i = from; i < to; i++)
+        {
+            live->admitVehicle("CR" + to_string(i), i % 7 == 0 ? KIND_BIKE : KIND_CAR);
+            clock.advance(30);
+            if (i % 3 == 0)
+                live->releaseVehicle("CR" + to_string(i / 2), "Card");
+            if (i % 5 == 0)
+                passes.push_back("CR" + to_string(i + 1));
+            string error;
+            if (i % 50 == 0)
+                live->reserveSlot("RS" + to_string(i), KIND_TRUCK, clock.now() + 3600, clock.now() + 7200, error);
+        }
+        live->renewMonthlyPasses(passes, starts);
+    };
+    auto stateOf = [](SmartParkingSystem &site) {
+        return to_string(site.getActiveTicketCount()) + " parked, " + to_string(site.getPassCount()) + " passes, " +
+               to_string(site.getReservationCount()) + " bookings, " + to_string(site.getHistoryRowCount()) +
+               " exits, revenue " + formatAmount(site.getTotalRevenue());
+    };
+    auto takeImage = [&](const string &name) {
+        ParkingConfig image = config;
+        image.dataDir = makeBenchDir(name);
+        filesystem::copy(config.dataDir, image.dataDir,
+                         filesystem::copy_options::recursive | filesystem::copy_options::overwrite_existing);
+        return image;
+    };
+    auto appendTo = [](const string &path, const string &text) {
+        ofstream file(path, ios::binary | ios::app);
+        file << text;
+    };
+    DiscardBuffer discard;
+    // Restarts from an image, quietly, and says whether it matched
+    auto restores = [&](const ParkingConfig &image, const string &expected, const char *label) {
+        streambuf *console = cout.rdbuf(&discard), *errors = cerr.rdbuf(&discard);
+        SmartParkingSystem *restored = new SmartParkingSystem(numFloors, image);
+        string state = stateOf(*restored);
+        delete restored;
+        cout.rdbuf(console);
+        cerr.rdbuf(errors);
+        cout << (state == expected ? "✓ " : "✗ ") << label << ": " << state << endl;
+        return state == expected;
+    };
+
+    traffic(0, 3000);
+    live->checkpointNow();
+    traffic(3000, 4500);
+    live->flush();
+    string expected = stateOf(*live);
+    cout << "live site: " << expected << endl;
+
+    ParkingConfig torn = takeImage("checkpoint_torn");
+    appendTo(torn.dataDir + "/parking_journal.log", "999999,PARK,TORN,1");
+    ok = restores(torn, expected, "torn final journal record") && ok;
+
+    ParkingConfig interrupted = takeImage("checkpoint_interrupted");
+    appendTo(interrupted.dataDir + "/parking_snapshot.bin.tmp", string(4096, 'x'));
+    appendTo(interrupted.dataDir + "/parking_journal.log.tmp", "1,PARK");
+    ostringstream report;
+    int status = runRecoveryCheck(interrupted.dataDir, interrupted, numFloors, report);
+    ok = status == 1 && report.str().find("interrupted write") != string::npos && ok;
+    ok = restores(interrupted, expected, "checkpoint interrupted mid-write, then --recover") && ok;
+
+    // The snapshot landed but the journal was not cut yet
+    string uncut;
+    {
+        ifstream file(config.dataDir + "/parking_journal.log", ios::binary);
+        uncut.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+    live->checkpointNow();
+    ParkingConfig beforeCut = takeImage("checkpoint_uncut");
+    filesystem::remove(beforeCut.dataDir + "/parking_journal.log");
+    appendTo(beforeCut.dataDir + "/parking_journal.log", uncut);
+    ok = restores(beforeCut, expected, "snapshot written, journal not yet cut") && ok;
+
+    ParkingConfig corrupt = takeImage("checkpoint_corrupt");
+    {
+        fstream file(corrupt.dataDir + "/parking_snapshot.bin", ios::binary | ios::in | ios::out);
+        file.seekp(filesystem::file_size(corrupt.dataDir + "/parking_snapshot.bin") / 2);
+        file.put('\x5a');
+    }
+    report.str("");
+    streambuf *console = cout.rdbuf(&discard), *errors = cerr.rdbuf(&discard);
+    status = runRecoveryCheck(corrupt.dataDir, corrupt, numFloors, report);
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    bool caught = status == 1 && report.str().find("checksum mismatch") != string::npos &&
+                  filesystem::exists(corrupt.dataDir + "/parking_snapshot.bin.damaged");
+    cout << (caught ? "✓ " : "✗ ") << "corrupted snapshot: --recover reported the checksum mismatch" << endl;
+    ok = caught && ok;
+
+    // A checkpoint file that cannot be written keeps the snapshot and the
+    // journal where they were, so the journal still holds its records
+    string historyPath = config.dataDir + "/transaction_history.col";
+    filesystem::rename(historyPath, historyPath + ".aside");
+    filesystem::create_directory(historyPath);
+    errors = cerr.rdbuf(&discard);
+    traffic(4500, 5000);
+    bool refused = !live->checkpointNow();
+    cerr.rdbuf(errors);
+    live->flush();
+    expected = stateOf(*live);
+    filesystem::remove(historyPath);
+    filesystem::rename(historyPath + ".aside", historyPath);
+    ParkingConfig unwritable = takeImage("checkpoint_unwritable");
+    ok = refused && restores(unwritable, expected, "history write failed, journal kept") && ok;
+
+    delete live;
+    for (auto &image : {config, torn, interrupted, beforeCut, corrupt, unwritable})
+        filesystem::remove_all(image.dataDir);
+    cout << (ok ? "✓ checkpoints held traffic only while copying, and every crash image restored the live state"
+                : "✗ checkpointing paused traffic or lost state")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// A 1M-plate contract imported in one commit vs passes bought one at a
+// time, then a 2M-exit history exported to CSV and to columns. Exports must
+// allocate the same few buffers however many rows they write, and the
+// columnar file must read back to the same totals.
+int benchBulkImportExport()
+{
+    const int contractSize = 1000000, singlePurchases = 5000, historyRows = 2000000;
+    const long long day = 24 * 60 * 60;
+    bool ok = true;
+
+    ParkingConfig config = benchGateConfig("bulk");
+    config.journal.fsyncEveryRecords = 1;
+    string contract = config.dataDir + "/contract.csv";
+    size_t expectedPasses = 0, expectedDuplicates = 0, expectedRejected = 0;
+    {
+        ofstream out(contract);
+        out << "plate,employee\n";
+        for (int i = 0; i < contractSize; i++)
+        {
+            if (i % 100 == 7)
+            {
+                out << "BAD PLATE " << i << ",x\n";
+                expectedRejected++;
+            }
+            else if (i % 100 == 13)
+            {
+                out << "KA01-" << i - 1 << ",x\n";
+                expectedDuplicates++;
+            }
+            else
+            {
+                out << "KA01-" << i << ",E" << i << "\n";
+                expectedPasses++;
+            }
+        }
+    }
+
+    SmartParkingSystem *site = new SmartParkingSystem(3, config);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < singlePurchases; i++)
+    {
+        time_t startDate;
+        site->issueMonthlyPass("SP" + to_string(i), startDate);
+        site->flush();
+    }
+    printBenchResult("passes bought one at a time", singlePurchases, elapsedMs(start));
+
+    DiscardBuffer discard;
+    streambuf *console = cout.rdbuf(&discard), *errors = cerr.rdbuf(&discard);
+    PassImportReport report;
+    start = chrono::steady_clock::now();
+    bool imported = site->importPasses(contract, report);
+    double ms = elapsedMs(start);
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    printBenchResult("contract import, one commit", contractSize, ms);
+    ok = imported && report.started == expectedPasses && report.extended == 0 &&
+         report.duplicates == expectedDuplicates && report.rejected == expectedRejected &&
+         site->getPassCount() == expectedPasses + singlePurchases;
+
+    // Loading the same contract again changes no pass
+    ostringstream before, after;
+    site->exportPassesCsv(before);
+    PassImportReport again;
+    console = cout.rdbuf(&discard);
+    errors = cerr.rdbuf(&discard);
+    site->importPasses(contract, again);
+    cout.rdbuf(console);
+    cerr.rdbuf(errors);
+    site->exportPassesCsv(after);
+    bool idempotent = again.unchanged == expectedPasses && again.started == 0 && again.extended == 0 &&
+                      before.str() == after.str();
+    cout << (idempotent ? "✓ " : "✗ ") << "importing the contract again left all " << again.unchanged
+         << " passes as they were" << endl;
+    ok = ok && idempotent;
+
+    ostringstream passes, tickets;
+    size_t passRows = site->exportPassesCsv(passes);
+    ok = ok && passRows == expectedPasses + singlePurchases && site->exportTicketsCsv(tickets) == 0;
+    delete site;
+    site = new SmartParkingSystem(3, config);
+    bool restored = site->getPassCount() == expectedPasses + singlePurchases;
+    ok = ok && restored;
+    cout << report.started << " passes imported, " << report.duplicates << " duplicate and " << report.rejected
+         << " malformed lines skipped; all there after a restart: " << (restored ? "yes" : "no") << endl;
+    delete site;
+
+    TransactionHistory history;
+    const time_t firstExit = 1760000000;
+    mt19937 random(11);
+    for (int i = 0; i < historyRows; i++)
+    {
+        time_t exitTime = firstExit + (time_t)((long long)i * 90 * day / historyRows);
+        int kind = (int)(random() % KIND_COUNT);
+        long long duration = 600 + (long long)(random() % (8 * 3600));
+        bool pass = random() % 5 == 0;
+        history.append(exitTime, 101 + i % 40, kind, duration, pass ? 0.0 : VEHICLE_KIND_RATES[kind] * 2,
+                       pass ? "Pass" : (i % 2 ? "Card" : "Cash"), pass);
+    }
+
+    string csvPath = config.dataDir + "/history.csv", columnsPath = config.dataDir + "/history.col";
+    long long csvAllocations, columnAllocations;
+    size_t csvRows;
+    long long columnRows;
+    {
+        ofstream csv(csvPath, ios::binary);
+        start = chrono::steady_clock::now();
+        allocationCount = 0;
+        countingAllocations = true;
+        csvRows = history.exportCsv(csv);
+        countingAllocations = false;
+        csvAllocations = allocationCount;
+        printBenchResult("history to CSV", historyRows, elapsedMs(start));
+    }
+    start = chrono::steady_clock::now();
+    allocationCount = 0;
+    countingAllocations = true;
+    columnRows = history.exportColumns(columnsPath);
+    countingAllocations = false;
+    columnAllocations = allocationCount;
+    printBenchResult("history to columns", historyRows, elapsedMs(start));
+
+    size_t csvLines = 0;
+    {
+        LineReader reader(csvPath);
+        string_view line;
+        while (reader.next(line))
+            csvLines++;
+    }
+    error_code ec;
+    cout << "CSV " << filesystem::file_size(csvPath, ec) / 1000000 << " MB, columns "
+         << filesystem::file_size(columnsPath, ec) / 1000000 << " MB; heap allocations: ";
+    if (ALLOCATIONS_COUNTED)
+        cout << csvAllocations << " for CSV, " << columnAllocations << " for columns" << endl;
+    else
+        cout << "not counted without -DPARKING_BENCH" << endl;
+    ok = ok && csvRows == (size_t)historyRows && csvLines == csvRows + 1 && columnRows == historyRows &&
+         (!ALLOCATIONS_COUNTED || (csvAllocations < 64 && columnAllocations < 64));
+
+    // A month's window, read back from the columnar file, must sum the same
+    HistoryQuery month;
+    month.from = firstExit + 30 * day;
+    month.to = firstExit + 60 * day;
+    month.bucketSeconds = day;
+    month.groupBy = GROUP_METHOD;
+    string windowPath = config.dataDir + "/month.col";
+    long long windowRows = history.exportColumns(windowPath, month.from, month.to);
+    TransactionHistory fromFile;
+    fromFile.load(windowPath);
+    vector<HistoryBucket> expected = history.aggregate(month), actual = fromFile.aggregate(month);
+    bool same = expected.size() == actual.size() && (long long)fromFile.size() == windowRows;
+    for (size_t i = 0; same && i < expected.size(); i++)
+    {
+        same = expected[i].start == actual[i].start && expected[i].group == actual[i].group &&
+               expected[i].exits == actual[i].exits && expected[i].revenue == actual[i].revenue;
+    }
+    ok = ok && same && windowRows > 0;
+
+    filesystem::remove_all(config.dataDir);
+    cout << (ok ? "✓ the contract went in whole in one commit, and exports matched the history in flat memory"
+                : "✗ import or export lost rows")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Gate throughput as the number of concurrent lanes grows
+int benchGateThroughput()
+{
+    const int numFloors = 40, totalOps = 200000, parkedPerLane = 64;
+    for (int laneCount = 1; laneCount <= 8; laneCount *= 2)
+    {
+        ParkingConfig config = benchGateConfig("gates");
+        SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+        auto start = chrono::steady_clock::now();
+        vector<thread> lanes;
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            lanes.emplace_back([&, lane]() {
+                int opsPerLane = totalOps / laneCount / 2;
+                for (int i = 0; i < opsPerLane; i++)
+                {
+                    int plate = i % parkedPerLane;
+                    string number = "L" + to_string(lane) + "V" + to_string(plate);
+                    if (i >= parkedPerLane)
+                        system->releaseVehicle(number, "UPI");
+                    system->admitVehicle(number, VEHICLE_KIND_NAMES[plate % KIND_COUNT]);
+                }
+            });
+        }
+        for (auto &lane : lanes)
+        {
+            lane.join();
+        }
+        printBenchResult(to_string(laneCount) + " gate lanes", totalOps, elapsedMs(start));
+        delete system;
+        filesystem::remove_all(config.dataDir);
+    }
+    return 0;
+}
+
+// 4M exits over 90 days, then typical revenue questions: each query
+// scans the whole history (or skips to one week of it) and must add up
+// to what went in, also after a round trip through the history file
+int benchHistoryQueries()
+{
+    const int rows = 4000000, days = 90;
+    const long long day = 24 * 60 * 60;
+    const time_t firstExit = 1760000000;
+    const char *methods[] = {"Cash", "Card", "UPI"};
+    TransactionHistory history;
+    mt19937 random(7);
+    double totalRevenue = 0;
+    long long weekExits = 0;
+    const time_t weekStart = firstExit + 30 * day, weekEnd = weekStart + 7 * day;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < rows; i++)
+    {
+        time_t exitTime = firstExit + (time_t)((long long)i * days * day / rows) + (long long)(random() % 600);
+        int kind = (int)(random() % KIND_COUNT);
+        long long duration = 600 + (long long)(random() % (8 * 3600));
+        bool pass = random() % 5 == 0;
+        double amount = pass ? 0.0 : max(1.0, duration / 3600.0) * VEHICLE_KIND_RATES[kind];
+        history.append(exitTime, 101 + i % 12, kind, duration, amount, pass ? "Pass" : methods[i % 3], pass);
+        totalRevenue += amount;
+        weekExits += exitTime >= weekStart && exitTime < weekEnd;
+    }
+    printBenchResult("appends (gate path cost)", rows, elapsedMs(start));
+
+    auto check = [&](const vector<HistoryBucket> &buckets, long long expectedExits, double expectedRevenue) {
+        long long exits = 0;
+        double revenue = 0;
+        for (auto &bucket : buckets)
+        {
+            exits += bucket.exits;
+            revenue += bucket.revenue;
+        }
+        return exits == expectedExits && (expectedRevenue < 0 || fabs(revenue - expectedRevenue) < 1e-6 * expectedRevenue);
+    };
+
+    bool ok = true;
+    HistoryQuery query;
+    start = chrono::steady_clock::now();
+    vector<HistoryBucket> hourly = history.aggregate(query);
+    printBenchResult("revenue per hour, 90 days", rows, elapsedMs(start));
+    ok = ok && hourly.size() >= (size_t)days * 24 && check(hourly, rows, totalRevenue);
+
+    query.bucketSeconds = day;
+    query.groupBy = GROUP_KIND;
+    start = chrono::steady_clock::now();
+    ok = ok && check(history.aggregate(query), rows, totalRevenue);
+    printBenchResult("revenue per day by type", rows, elapsedMs(start));
+
+    query.groupBy = GROUP_METHOD;
+    start = chrono::steady_clock::now();
+    vector<HistoryBucket> byMethod = history.aggregate(query);
+    printBenchResult("revenue per day by method", rows, elapsedMs(start));
+    ok = ok && check(byMethod, rows, totalRevenue);
+
+    query.groupBy = GROUP_NONE;
+    query.bucketSeconds = 3600;
+    query.from = weekStart;
+    query.to = weekEnd;
+    start = chrono::steady_clock::now();
+    ok = ok && check(history.aggregate(query), weekExits, -1);
+    printBenchResult("revenue per hour, one week", rows, elapsedMs(start));
+
+    query = HistoryQuery();
+    start = chrono::steady_clock::now();
+    long long median = history.dwellPercentile(query, 0.5);
+    printBenchResult("median stay, 90 days", rows, elapsedMs(start));
+    cout << "median stay " << fixed << setprecision(2) << median / 3600.0 << " hours" << endl;
+
+    string dir = makeBenchDir("history");
+    start = chrono::steady_clock::now();
+    ok = ok && history.persist(dir + "/transaction_history.col", 1);
+    printBenchResult("write history file", rows, elapsedMs(start));
+    TransactionHistory reloaded;
+    start = chrono::steady_clock::now();
+    reloaded.load(dir + "/transaction_history.col");
+    printBenchResult("load history file", rows, elapsedMs(start));
+    ok = ok && reloaded.size() == (size_t)rows && check(reloaded.aggregate(query), rows, totalRevenue);
+    filesystem::remove_all(dir);
+
+    cout << (ok ? "✓ every query added up to the exits recorded" : "✗ history queries lost or miscounted exits")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Sells 200k passes over 20 days, then lets 110k of them lapse: gate
+// operations and one explicit sweep must archive exactly those, and a
+// restart must not bring them back. Then renews passes one call at a
+// time vs in one bulk call, with an fsync per journal write.
+int benchPassExpiry()
+{
+    const int days = 20, passesPerDay = 10000, gateCycles = 500, renewals = 2000;
+    const long long day = 24 * 60 * 60;
+    ManualClock clock(1760000000);
+    ParkingConfig config = benchGateConfig("expiry");
+    config.clock = &clock;
+    SmartParkingSystem *system = new SmartParkingSystem(4, config);
+
+    vector<time_t> starts;
+    auto start = chrono::steady_clock::now();
+    for (int d = 0; d < days; d++)
+    {
+        vector<string> plates;
+        for (int i = 0; i < passesPerDay; i++)
+        {
+            plates.push_back("EX" + to_string(d * passesPerDay + i));
+        }
+        system->renewMonthlyPasses(plates, starts);
+        clock.advance(day);
+    }
+    printBenchResult("passes sold in daily bulk calls", days * passesPerDay, elapsedMs(start));
+
+    // Passes from days 0-10 have lapsed by day 40
+    clock.advance(20 * day);
+    const size_t lapsed = 11 * passesPerDay, live = (size_t)(days - 11) * passesPerDay;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < gateCycles; i++)
+    {
+        string plate = "GV" + to_string(i);
+        system->admitVehicle(plate, "Car");
+        system->releaseVehicle(plate, "Cash");
+    }
+    printBenchResult("park/exit, sweeping as they go", 2 * gateCycles, elapsedMs(start));
+    size_t sweptByGates = (days * passesPerDay) - system->getPassCount();
+    start = chrono::steady_clock::now();
+    size_t swept = system->sweepExpiredPasses();
+    printBenchResult("explicit sweep of the rest", (int)swept, elapsedMs(start));
+    cout << "archived " << sweptByGates << " passes from the gate path, " << swept << " in the sweep; "
+         << system->getPassCount() << " live passes left" << endl;
+    bool ok = sweptByGates + swept == lapsed && system->getPassCount() == live;
+
+    delete system;
+    system = new SmartParkingSystem(4, config);
+    ok = ok && system->getPassCount() == live && system->sweepExpiredPasses() == 0;
+    delete system;
+    ifstream archive(config.dataDir + "/pass_archive.log");
+    size_t archivedLines = count(istreambuf_iterator<char>(archive), istreambuf_iterator<char>(), '\n');
+    ok = ok && archivedLines == lapsed;
+    filesystem::remove_all(config.dataDir);
+
+    config = benchGateConfig("renew");
+    config.clock = &clock;
+    config.journal.asyncWrites = false;
+    config.journal.fsyncEveryRecords = 1;
+    system = new SmartParkingSystem(4, config);
+    vector<string> plates;
+    for (int i = 0; i < renewals; i++)
+    {
+        plates.push_back("RN" + to_string(i));
+    }
+    start = chrono::steady_clock::now();
+    for (auto &plate : plates)
+    {
+        system->renewMonthlyPasses(vector<string>(1, plate), starts);
+    }
+    double singleMs = elapsedMs(start);
+    printBenchResult("renewals, one call each", renewals, singleMs);
+    start = chrono::steady_clock::now();
+    system->renewMonthlyPasses(plates, starts);
+    double bulkMs = elapsedMs(start);
+    printBenchResult("renewals, one bulk call", renewals, bulkMs);
+    for (auto startDate : starts)
+    {
+        // Still-valid passes run on from their expiry
+        ok = ok && startDate == clock.now() + 30 * day;
+    }
+    delete system;
+    filesystem::remove_all(config.dataDir);
+
+    // The shared directory keeps lapsed passes while its archive cannot be
+    // written, and archives them once it can
+    string sharedDir = makeBenchDir("expiry_shared");
+    PassDirectory *directory = new PassDirectory(sharedDir, JournalConfig(), &clock);
+    for (int i = 0; i < renewals; i++)
+    {
+        time_t startDate;
+        directory->issue("SD" + to_string(i), clock.now(), startDate);
+    }
+    clock.advance(31 * day);
+    filesystem::create_directory(sharedDir + "/pass_archive.log");
+    DiscardBuffer discard;
+    streambuf *errors = cerr.rdbuf(&discard);
+    delete directory;
+    directory = new PassDirectory(sharedDir, JournalConfig(), &clock);
+    cerr.rdbuf(errors);
+    ok = ok && directory->size() == (size_t)renewals;
+    filesystem::remove(sharedDir + "/pass_archive.log");
+    delete directory;
+    directory = new PassDirectory(sharedDir, JournalConfig(), &clock);
+    ok = ok && directory->size() == 0;
+    delete directory;
+    ifstream sharedArchive(sharedDir + "/pass_archive.log");
+    ok = ok && count(istreambuf_iterator<char>(sharedArchive), istreambuf_iterator<char>(), '\n') == renewals;
+    filesystem::remove_all(sharedDir);
+
+    cout << fixed << setprecision(1) << "bulk renewal speed-up " << singleMs / bulkMs << "x" << endl;
+    cout << (ok ? "✓ exactly the lapsed passes were archived, and stayed archived after a restart"
+                : "✗ pass expiry lost or kept the wrong passes")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Four sites share one pass directory: passes sold at one site must be
+// honoured at every other, across a restart, while pass checks from many
+// lanes never lock
+int benchMultiSite()
+{
+    const int siteCount = 4, numFloors = 80, passHolders = 1000, visitors = 1000;
+    const int checksPerLane = 1000000;
+    string root = makeBenchDir("sites");
+    ParkingConfig config = benchGateConfig("sites");
+    filesystem::remove_all(config.dataDir);
+    config.journal.compactEveryRecords = 1000;
+
+    vector<GateEvent> sales, parks, exits;
+    for (int i = 0; i < passHolders + visitors; i++)
+    {
+        GateEvent event;
+        event.vehicleNumber = (i < passHolders ? "MP" : "MV") + to_string(i);
+        event.type = GATE_PASS;
+        if (i < passHolders)
+            sales.push_back(event);
+        event.type = GATE_PARK;
+        event.detail = VEHICLE_KIND_NAMES[i % KIND_COUNT];
+        parks.push_back(event);
+        event.type = GATE_EXIT;
+        event.detail = "Cash";
+        exits.push_back(event);
+    }
+
+    bool ok = true;
+    {
+        ParkingHost host(root);
+        for (int s = 0; s < siteCount; s++)
+        {
+            host.addSite("site" + to_string(s), numFloors, config);
+        }
+        host.site(0).submit(sales).get();
+
+        // Every site admits and releases the same vehicles at once
+        auto start = chrono::steady_clock::now();
+        vector<future<vector<GateOutcome>>> parked, exited;
+        for (int s = 0; s < siteCount; s++)
+        {
+            parked.push_back(host.site(s).submit(parks));
+        }
+        for (int s = 0; s < siteCount; s++)
+        {
+            exited.push_back(host.site(s).submit(exits));
+        }
+        for (int s = 0; s < siteCount; s++)
+        {
+            vector<GateOutcome> in = parked[s].get(), out = exited[s].get();
+            for (int i = 0; i < passHolders + visitors; i++)
+            {
+                bool holder = i < passHolders;
+                ok = ok && in[i].park.status == PARK_OK && out[i].exit.status == EXIT_OK &&
+                     out[i].exit.passHolder == holder && (out[i].exit.amount == 0) == holder;
+            }
+        }
+        printBenchResult(to_string(siteCount) + " sites, one worker each", siteCount * 2 * (passHolders + visitors),
+                         elapsedMs(start));
+
+        // Pass checks: lock-free directory vs a shard-locked id table
+        IdTable<time_t> locked;
+        PlateInterner interner;
+        for (int i = 0; i < passHolders; i++)
+        {
+            locked.insert(interner.intern(sales[i].vehicleNumber), 0);
+        }
+        for (int laneCount = 1; laneCount <= 8; laneCount *= 2)
+        {
+            for (int useDirectory = 1; useDirectory >= 0; useDirectory--)
+            {
+                atomic<int> valid(0);
+                start = chrono::steady_clock::now();
+                vector<thread> lanes;
+                for (int lane = 0; lane < laneCount; lane++)
+                {
+                    lanes.emplace_back([&, lane]() {
+                        PassDirectory &directory = host.passDirectory();
+                        time_t now = time(0);
+                        int hits = 0;
+                        for (int i = 0; i < checksPerLane; i++)
+                        {
+                            const string &plate = sales[(i * 7 + lane) % passHolders].vehicleNumber;
+                            if (useDirectory)
+                                hits += directory.isValid(plate, now);
+                            else
+                                hits += locked.read(interner.find(plate), [](const time_t *start) { return start != nullptr; });
+                        }
+                        valid += hits;
+                    });
+                }
+                for (auto &lane : lanes)
+                {
+                    lane.join();
+                }
+                printBenchResult(to_string(laneCount) + (useDirectory ? " lanes, pass directory" : " lanes, locked table"),
+                                 laneCount * checksPerLane, elapsedMs(start));
+                ok = ok && valid == laneCount * checksPerLane;
+            }
+        }
+    }
+
+    // The directory and every site reload from their own files
+    {
+        ParkingHost host(root);
+        for (int s = 0; s < siteCount; s++)
+        {
+            host.addSite("site" + to_string(s), numFloors, config);
+        }
+        ok = ok && host.passDirectory().size() == (size_t)passHolders;
+        ExitResult result;
+        ok = ok && host.site(siteCount - 1).getSystem().admitVehicle("MP7", "Car").passHolder;
+        result = host.site(siteCount - 1).getSystem().releaseVehicle("MP7", "Cash");
+        ok = ok && result.status == EXIT_OK && result.passHolder;
+    }
+    filesystem::remove_all(root);
+
+    // Purchases from every site go on while the directory checkpoints a
+    // few hundred thousand passes in the background
+    {
+        const int contractPasses = 300000, buyers = 4, purchasesPerBuyer = 25000;
+        JournalConfig journal;
+        journal.fsyncEveryRecords = 0;
+        journal.compactEveryRecords = 40000;
+        filesystem::create_directories(root);
+        PassDirectory directory(root, journal);
+        vector<string> plates;
+        vector<time_t> starts;
+        for (int i = 0; i < contractPasses; i++)
+            plates.push_back("DC" + to_string(i));
+        directory.renew(plates, time(0), starts);
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> lanes;
+        for (int lane = 0; lane < buyers; lane++)
+        {
+            lanes.emplace_back([&directory, lane]() {
+                time_t startDate;
+                for (int i = 0; i < purchasesPerBuyer; i++)
+                    directory.issue("DB" + to_string(lane) + "-" + to_string(i), time(0), startDate);
+            });
+        }
+        for (auto &lane : lanes)
+            lane.join();
+        printBenchResult("pass purchases while checkpointing", buyers * purchasesPerBuyer, elapsedMs(start));
+
+        const LogHistogram &pause = directory.getCheckpointPause(), &write = directory.getSnapshotLatency();
+        uint64_t checkpoints = pause.count();
+        double pauseMs = checkpoints ? pause.sum() / 1e6 / checkpoints : 0;
+        double writeMs = write.count() ? write.sum() / 1e6 / write.count() : 0;
+        cout << checkpoints << " directory checkpoints: purchases waited " << fixed << setprecision(2) << pauseMs
+             << " ms per checkpoint, which took " << writeMs << " ms more to write" << endl;
+        ok = ok && checkpoints >= 1 && pauseMs < writeMs / 2 &&
+             directory.size() == (size_t)(contractPasses + buyers * purchasesPerBuyer);
+    }
+    filesystem::remove_all(root);
+    cout << (ok ? "✓ passes sold at one site were honoured at every site, before and after a restart"
+                : "✗ sites disagree about passes")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// The tariff rules applied the slow way, minute by minute, to check the
+// compiled tables against
+double naiveTariffFee(const TariffRules &rules, int kind, time_t entry, time_t exit)
+{
+    long long seconds = max<long long>(0, (long long)exit - entry);
+    if (rules.graceMinutes[kind] > 0 && seconds <= rules.graceMinutes[kind] * 60LL)
+        return 0.0;
+    long long minutes = max<long long>((seconds + 59) / 60, rules.minimumMinutes[kind]);
+    long long first = ((long long)entry + rules.utcOffsetMinutes * 60LL + 4LL * 86400) / 60;
+    double total = 0.0, today = 0.0;
+    for (long long i = 0; i < minutes; i++)
+    {
+        int minuteOfWeek = (int)((first + i) % WEEK_MINUTES);
+        int weekday = minuteOfWeek / DAY_MINUTES, minute = minuteOfWeek % DAY_MINUTES;
+        int yesterday = (weekday + 6) % 7;
+        double rate = rules.hourlyRate[kind];
+        for (const TariffPeriod &period : rules.periods)
+        {
+            int length = (period.toMinute - period.fromMinute + DAY_MINUTES - 1) % DAY_MINUTES + 1;
+            bool startedToday = (period.days >> weekday & 1) && minute >= period.fromMinute &&
+                                minute < period.fromMinute + length;
+            bool fromYesterday = (period.days >> yesterday & 1) && minute + DAY_MINUTES < period.fromMinute + length;
+            if ((period.kind < 0 || period.kind == kind) && (startedToday || fromYesterday))
+                rate = rules.hourlyRate[kind] * period.multiplier;
+        }
+        today += rate / 60.0;
+        if ((i + 1) % DAY_MINUTES == 0 || i + 1 == minutes)
+        {
+            total += rules.dailyCap[kind] > 0 ? min(rules.dailyCap[kind], today) : today;
+            today = 0.0;
+        }
+    }
+    return round(total * 100.0) / 100.0;
+}
+
+// Prices 1M stays under a tariff with peaks, night and weekend rates, caps
+// and grace, checks them against the rules applied minute by minute, then
+// swaps tariffs back and forth under four busy gate lanes
+int benchTariff()
+{
+    const int stays = 1000000, checked = 20000, lanes = 4, cyclesPerLane = 20000;
+    const char *tariffText = "name city-centre\n"
+                             "utc-offset 330\n"
+                             "rate Car 30\n"
+                             "period all 22:00-06:00 0.5\n"
+                             "period Mon-Fri 08:00-10:00 1.5\n"
+                             "period Mon-Fri 12:00-14:00 1.25\n"
+                             "period Mon-Fri 17:00-20:00 1.5\n"
+                             "period Mon-Fri 07:00-09:00 2 Truck\n"
+                             "period Sat,Sun 10:00-22:00 0.8\n"
+                             "period Sat 18:00-02:00 1.2 Car\n"
+                             "period Fri 20:00-23:30 1.1\n"
+                             "cap Bike 80\n"
+                             "cap Car 240\n"
+                             "grace 10\n"
+                             "minimum Truck 120\n";
+    TariffRules rules;
+    string error;
+    stringstream tariffFile(tariffText);
+    if (!readTariffRules(tariffFile, rules, error))
+    {
+        cout << "✗ tariff did not parse: " << error << endl;
+        return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    CompiledTariff compiled(rules);
+    printBenchResult("compile " + to_string(rules.periods.size()) + " periods", KIND_COUNT, elapsedMs(start));
+
+    mt19937_64 rng(17);
+    vector<int> kinds(stays);
+    vector<time_t> entries(stays), exits(stays);
+    for (int i = 0; i < stays; i++)
+    {
+        kinds[i] = (int)(rng() % KIND_COUNT);
+        entries[i] = 1767225600 + (time_t)(rng() % (365 * 86400));
+        // Mostly short visits, some overnight, a few of several days
+        long long limit = i % 20 == 0 ? 10 * 86400 : i % 5 == 0 ? 86400 : 4 * 3600;
+        exits[i] = entries[i] + (time_t)(rng() % limit);
+    }
+    double compiledTotal = 0.0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < stays; i++)
+    {
+        compiledTotal += compiled.fee(kinds[i], entries[i], exits[i]);
+    }
+    printBenchResult("fee from compiled tables", stays, elapsedMs(start));
+
+    int mismatches = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < checked; i++)
+    {
+        double expected = naiveTariffFee(rules, kinds[i], entries[i], exits[i]);
+        if (fabs(expected - compiled.fee(kinds[i], entries[i], exits[i])) > 0.011)
+            mismatches++;
+    }
+    printBenchResult("fee minute by minute", checked, elapsedMs(start));
+    cout << fixed << setprecision(2) << "revenue " << compiledTotal << " over " << stays << " stays; "
+         << mismatches << " of " << checked << " fees differ from the minute-by-minute rules" << endl;
+    bool ok = mismatches == 0;
+
+    // Hour-long minimum stays at a fixed time: each exit must be priced
+    // wholly by one tariff or the other, never a mix
+    ManualClock clock(1767225600);
+    ParkingConfig config = benchGateConfig("tariff");
+    config.clock = &clock;
+    SmartParkingSystem *system = new SmartParkingSystem(20, config);
+    TariffRules doubled;
+    doubled.name = "doubled";
+    for (int k = 0; k < KIND_COUNT; k++)
+        doubled.hourlyRate[k] *= 2;
+    atomic<bool> running(true);
+    atomic<int> badFees(0);
+    int swaps = 0;
+    start = chrono::steady_clock::now();
+    thread swapper([&]() {
+        while (running.load())
+        {
+            system->setTariff(swaps % 2 ? TariffRules() : doubled);
+            swaps++;
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    });
+    vector<thread> gates;
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        gates.emplace_back([&, lane]() {
+            for (int i = 0; i < cyclesPerLane; i++)
+            {
+                string number = "TF" + to_string(lane) + "V" + to_string(i % 32);
+                int kind = i % KIND_COUNT;
+                system->admitVehicle(number, (VehicleKind)kind);
+                ExitResult result = system->releaseVehicle(number, "UPI");
+                if (result.amount != VEHICLE_KIND_RATES[kind] && result.amount != 2 * VEHICLE_KIND_RATES[kind])
+                    badFees++;
+            }
+        });
+    }
+    for (auto &gate : gates)
+    {
+        gate.join();
+    }
+    double gateMs = elapsedMs(start);
+    running = false;
+    swapper.join();
+    printBenchResult("park/exit while swapping tariffs", 2 * lanes * cyclesPerLane, gateMs);
+    cout << swaps << " tariff swaps, " << badFees.load() << " exits priced by neither tariff" << endl;
+    ok = ok && badFees.load() == 0 && swaps > 1;
+    delete system;
+    filesystem::remove_all(config.dataDir);
+    cout << (ok ? "✓ compiled fees matched the rules, and every swap was atomic"
+                : "✗ tariff tables disagree with the rules")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// Park/exit latency with each record fsynced by the lane itself vs by the
+// journal writer, then checks that records reach the file within the
+// durability window, that flush() waits for them, and that shutdown()
+// leaves nothing to replay
+int benchDurability()
+{
+    const int numFloors = 40, cycles = 3000, flushed = 100;
+    auto journalLines = [](const string &path) {
+        ifstream file(path);
+        return (long long)count(istreambuf_iterator<char>(file), istreambuf_iterator<char>(), '\n');
+    };
+    bool ok = true;
+    for (int async = 0; async < 2; async++)
+    {
+        ParkingConfig config = benchGateConfig(async ? "async" : "inline");
+        config.journal.asyncWrites = async;
+        config.journal.fsyncEveryRecords = 1;
+        string journalPath = config.dataDir + "/parking_journal.log";
+        SmartParkingSystem *system = new SmartParkingSystem(numFloors, config);
+        vector<uint32_t> opNs;
+        opNs.reserve(2 * cycles);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < cycles; i++)
+        {
+            string plate = "DW" + to_string(i);
+            auto opStart = chrono::steady_clock::now();
+            system->admitVehicle(plate, KIND_CAR);
+            opNs.push_back((uint32_t)nanosSince(opStart));
+            opStart = chrono::steady_clock::now();
+            system->releaseVehicle(plate, "UPI");
+            opNs.push_back((uint32_t)nanosSince(opStart));
+        }
+        printBenchResult(async ? "park/exit, journal writer" : "park/exit, fsync in the lane", 2 * cycles,
+                         elapsedMs(start));
+        sort(opNs.begin(), opNs.end());
+        cout << fixed << setprecision(1) << "  p50 " << opNs[opNs.size() / 2] / 1000.0 << " us, p99 "
+             << opNs[opNs.size() * 99 / 100] / 1000.0 << " us, max " << opNs.back() / 1000.0 << " us" << endl;
+
+        if (async)
+        {
+            // PARK, EXIT and PAY per cycle, all on file within the window
+            this_thread::sleep_for(chrono::milliseconds(config.journal.durabilityWindowMs + 50));
+            long long lines = journalLines(journalPath);
+            for (int i = 0; i < flushed; i++)
+            {
+                system->admitVehicle("FL" + to_string(i), KIND_BIKE);
+            }
+            system->flush();
+            long long flushedLines = journalLines(journalPath);
+            cout << lines << " of " << 3 * cycles << " records on file after the window, " << flushedLines - lines
+                 << " of " << flushed << " after flush()" << endl;
+            ok = ok && lines == 3 * cycles && flushedLines == lines + flushed;
+        }
+        system->shutdown();
+        ok = ok && filesystem::file_size(journalPath) == 0;
+        delete system;
+        filesystem::remove_all(config.dataDir);
+    }
+    cout << (ok ? "✓ every acknowledged record was written in time, and shutdown left nothing to replay"
+                : "✗ the journal writer lost or delayed records")
+         << endl;
+    return ok ? 0 : 1;
+}
+
+// The text loader this file used before LineReader: a stream, a
+// stringstream and four strings per line
+size_t legacyReadTickets(const string &path, vector<TicketRecord> &out)
+{
+    ifstream file(path);
+    string line;
+    while (getline(file, line))
+    {
+        stringstream ss(line);
+        string vNum, slotStr, rateStr, timeStr;
+        getline(ss, vNum, ',');
+        getline(ss, slotStr, ',');
+        getline(ss, rateStr, ',');
+        getline(ss, timeStr, ',');
+        TicketRecord record;
+        record.vehicleNumber = vNum;
+        record.slotNumber = stoi(slotStr);
+        record.hourlyRate = stod(rateStr);
+        record.kind = -1;
+        record.entryTime = stoll(timeStr);
+        out.push_back(record);
+    }
+    return out.size();
+}
+
+// Parses 1M tickets and 1M passes, clean and with every 20th line
+// damaged; the damaged lines must be skipped and nothing else lost
+int benchRecordParsing()
+{
+    const int rows = 1000000, damageEvery = 20;
+    const time_t now = time(0);
+    string dir = makeBenchDir("parse");
+    string ticketPath = dir + "/tickets.txt", passPath = dir + "/passes.txt";
+    string badTicketPath = dir + "/tickets_damaged.txt", badPassPath = dir + "/passes_damaged.txt";
+    const char *ticketDamage[] = {"KA01X,12x,20,1700000000", "KA01X,12,20", "KA01X,12,20,1700000000,9",
+                                  ",12,20,1700000000", "KA01X,12,abc,1700000000", "KA01X,-4,20,1700000000"};
+    const char *passDamage[] = {"MH12X,PASS1,1700000000", "MH12X,PASS1,1700000000,1600000000",
+                                "MH12X,PASS1,17000z0000,1800000000", ",PASS1,1700000000,1800000000"};
+    {
+        ofstream tickets(ticketPath), passes(passPath), badTickets(badTicketPath), badPasses(badPassPath);
+        for (int i = 0; i < rows; i++)
+        {
+            int kind = i % KIND_COUNT;
+            string ticket = "KA01T" + to_string(i) + "," + to_string(101 + i % 5000) + "," +
+                            formatAmount(VEHICLE_KIND_RATES[kind]) + "," + to_string(now - i % 7200);
+            time_t start = now - i % 86400;
+            string pass = "MH12P" + to_string(i) + ",PASS" + to_string(start) + "," + to_string(start) + "," +
+                          to_string(start + 30 * 24 * 60 * 60);
+            tickets << ticket << "\n";
+            passes << pass << "\n";
+            // Windows line endings are tolerated, so they count as good rows
+            badTickets << ticket << (i % 7 == 0 ? "\r\n" : "\n");
+            badPasses << pass << "\n";
+            if (i % damageEvery == 0)
+            {
+                int n = i / damageEvery;
+                badTickets << ticketDamage[n % 6] << "\n";
+                badPasses << passDamage[n % 4] << "\n";
+            }
+        }
+        // One runaway line, as a partial overwrite might leave behind
+        badTickets << string(4 << 20, 'x') << "\n";
+    }
+    const size_t damaged = rows / damageEvery;
+
+    bool ok = true;
+    vector<TicketRecord> tickets;
+    vector<PassRecord> passes;
+    tickets.reserve(rows);
+    passes.reserve(rows);
+    auto start = chrono::steady_clock::now();
+    legacyReadTickets(ticketPath, tickets);
+    double legacyMs = elapsedMs(start);
+    printBenchResult("tickets, stringstream", rows, legacyMs);
+    ok = ok && tickets.size() == (size_t)rows;
+
+    tickets.clear();
+    ParseErrors ticketErrors(ticketPath, 0);
+    start = chrono::steady_clock::now();
+    readTextTickets(ticketPath, tickets, &ticketErrors);
+    double ticketMs = elapsedMs(start);
+    printBenchResult("tickets, in-place fields", rows, ticketMs);
+    ok = ok && tickets.size() == (size_t)rows && ticketErrors.getCount() == 0;
+
+    ParseErrors passErrors(passPath, 0);
+    start = chrono::steady_clock::now();
+    readTextPasses(passPath, passes, &passErrors);
+    printBenchResult("passes, in-place fields", rows, elapsedMs(start));
+    ok = ok && passes.size() == (size_t)rows && passErrors.getCount() == 0;
+
+    tickets.clear();
+    passes.clear();
+    ParseErrors badTicketErrors(badTicketPath, 0), badPassErrors(badPassPath, 0);
+    start = chrono::steady_clock::now();
+    readTextTickets(badTicketPath, tickets, &badTicketErrors);
+    readTextPasses(badPassPath, passes, &badPassErrors);
+    printBenchResult("damaged tickets + passes", 2 * rows + 2 * damaged + 1, elapsedMs(start));
+    cout << fixed << setprecision(1) << "  " << legacyMs / ticketMs << "x faster than stringstream, "
+         << rows / ticketMs / 1000 << "M rows/s; skipped " << badTicketErrors.getCount() << " + "
+         << badPassErrors.getCount() << " damaged lines" << endl;
+    ok = ok && tickets.size() == (size_t)rows && passes.size() == (size_t)rows &&
+         badTicketErrors.getCount() == damaged + 1 && badPassErrors.getCount() == damaged;
+    filesystem::remove_all(dir);
+    cout << (ok ? "✓ every good row kept, every damaged line skipped" : "✗ parsed row counts differ") << endl;
+    return ok ? 0 : 1;
+}
+
+int runBenchmark(string name)
+{
+    bool all = (name == "all");
+    bool found = false;
+    int status = 0;
+    if (all || name == "slots")
+    {
+        found = true;
+        cout << "\n--- Slot allocator ---" << endl;
+        status |= benchSlotAllocator();
+    }
+    if (all || name == "policies")
+    {
+        found = true;
+        cout << "\n--- Slot allocation policies ---" << endl;
+        status |= benchAllocationPolicies();
+    }
+    if (all || name == "layout")
+    {
+        found = true;
+        cout << "\n--- Slot layout: per-slot objects vs slot table ---" << endl;
+        status |= benchSlotLayout();
+    }
+    if (all || name == "startup")
+    {
+        found = true;
+        cout << "\n--- Startup: text vs binary snapshot ---" << endl;
+        status |= benchStartup();
+    }
+    if (all || name == "lookup")
+    {
+        found = true;
+        cout << "\n--- Pass lookups at 1M passes ---" << endl;
+        status |= benchPlateLookup();
+    }
+    if (all || name == "stress")
+    {
+        found = true;
+        cout << "\n--- Concurrent gate stress test ---" << endl;
+        status |= benchGateStress();
+    }
+    if (all || name == "alloc")
+    {
+        found = true;
+        cout << "\n--- Heap allocations per park/exit ---" << endl;
+        status |= benchAllocations();
+    }
+    if (all || name == "batch")
+    {
+        found = true;
+        cout << "\n--- Batch ingestion vs single events (fsync per write) ---" << endl;
+        status |= benchBatchIngest();
+    }
+    if (all || name == "durability")
+    {
+        found = true;
+        cout << "\n--- Journal writer vs inline fsync ---" << endl;
+        status |= benchDurability();
+    }
+    if (all || name == "parse")
+    {
+        found = true;
+        cout << "\n--- Record parsing, 1M rows ---" << endl;
+        status |= benchRecordParsing();
+    }
+    if (all || name == "sim")
+    {
+        found = true;
+        cout << "\n--- Simulated traffic, 300k arrivals ---" << endl;
+        status |= benchSimulation();
+    }
+    if (all || name == "metrics")
+    {
+        found = true;
+        cout << "\n--- Metrics recording overhead ---" << endl;
+        status |= benchMetricsOverhead();
+    }
+    if (all || name == "history")
+    {
+        found = true;
+        cout << "\n--- Transaction history queries ---" << endl;
+        status |= benchHistoryQueries();
+    }
+    if (all || name == "expiry")
+    {
+        found = true;
+        cout << "\n--- Pass expiry and bulk renewal ---" << endl;
+        status |= benchPassExpiry();
+    }
+    if (all || name == "sites")
+    {
+        found = true;
+        cout << "\n--- Multi-site hosting ---" << endl;
+        status |= benchMultiSite();
+    }
+    if (all || name == "tariff")
+    {
+        found = true;
+        cout << "\n--- Tariff tables vs rules ---" << endl;
+        status |= benchTariff();
+    }
+    if (all || name == "reserve")
+    {
+        found = true;
+        cout << "\n--- Reservations: capacity timelines ---" << endl;
+        status |= benchReservations();
+    }
+    if (all || name == "forecast")
+    {
+        found = true;
+        cout << "\n--- Rolling occupancy statistics and fill forecast ---" << endl;
+        status |= benchOccupancyForecast();
+    }
+    if (all || name == "passexit")
+    {
+        found = true;
+        cout << "\n--- Shift change: exits of a mostly pass holding fleet ---" << endl;
+        status |= benchPassHolderExits();
+    }
+    if (all || name == "checkpoint")
+    {
+        found = true;
+        cout << "\n--- Background checkpoints and crash recovery ---" << endl;
+        status |= benchCheckpoints();
+    }
+    if (all || name == "bulk")
+    {
+        found = true;
+        cout << "\n--- Bulk pass import and history export ---" << endl;
+        status |= benchBulkImportExport();
+    }
+    if (all || name == "gates")
+    {
+        found = true;
+        cout << "\n--- Gate throughput by lane count ---" << endl;
+        status |= benchGateThroughput();
+    }
+    if (!found)
+    {
+        cout << "✗ Unknown benchmark: " << name << endl;
+        cout << "Available: slots, policies, layout, startup, lookup, stress, alloc, batch, durability, parse, sim, metrics, history, expiry, sites, tariff, reserve, forecast, passexit, checkpoint, bulk, gates, all" << endl;
+        return 1;
+    }
+    return status;
+}
+
+// ==================== Main Application ====================
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench")
+    {
+        return runBenchmark(argc > 2 ? argv[2] : "all");
+    }
+    if (argc > 1 && string(argv[1]) == "--simulate")
+    {
+        SimulationConfig sim;
+        string csvPath;
+        for (int i = 2; i < argc; i++)
+        {
+            if (!applySimulationSetting(sim, argv[i], csvPath))
+            {
+                cerr << "✗ Unknown setting: " << argv[i] << endl;
+                cerr << "Settings: arrivals= rate= arrival=poisson|uniform|daily dwell=exponential|lognormal|fixed "
+                        "mean-dwell= pass-share= passes= floors= seed= sample-minutes= csv= "
+                        "policy=lowest|nearest|spread|grouped" << endl;
+                return 1;
+            }
+        }
+        SimulationReport report = runSimulation(sim);
+        printSimulationReport(report, cout);
+        if (!csvPath.empty())
+        {
+            ofstream csv(csvPath);
+            csv << "time,occupied,capacity\n";
+            for (auto &sample : report.occupancy)
+                csv << sample.time << "," << sample.occupied << "," << report.capacity << "\n";
+        }
+        return 0;
+    }
+    ParkingConfig config;
+    config.metricsFile = "parking_metrics.prom";
+    if (argc > 1 && string(argv[1]) == "--stream")
+    {
+        SmartParkingSystem parking(3, config);
+        if (argc > 2)
+        {
+            ifstream file(argv[2]);
+            if (!file.is_open())
+            {
+                cerr << "✗ Cannot open " << argv[2] << endl;
+                return 1;
+            }
+            return runGateStream(parking, file, cout).malformed == 0 ? 0 : 2;
+        }
+        return runStdinGateStream(parking, cout).malformed == 0 ? 0 : 2;
+    }
+    if (argc > 2 && string(argv[1]) == "--import-passes")
+    {
+        // --import-passes <file> [data-dir] [--extend]
+        bool extend = argc > 3 && string(argv[argc - 1]) == "--extend";
+        int positional = extend ? argc - 1 : argc;
+        config.dataDir = positional > 3 ? argv[3] : "";
+        SmartParkingSystem parking(3, config);
+        PassImportReport report;
+        if (!parking.importPasses(argv[2], report, extend))
+        {
+            cerr << "✗ Cannot open " << argv[2] << endl;
+            return 1;
+        }
+        cout << "✓ Imported " << report.started + report.extended << " passes: " << report.started << " started, "
+             << report.extended << " extended, " << report.unchanged << " already valid; " << report.duplicates
+             << " duplicate and " << report.rejected << " malformed lines skipped" << endl;
+        return report.rejected > 0 ? 1 : 0;
+    }
+    if (argc > 3 && string(argv[1]) == "--export")
+    {
+        // --export tickets|passes|history|history-col <file> [data-dir] [from] [to]
+        string what = argv[2], file = argv[3];
+        config.dataDir = argc > 4 ? argv[4] : "";
+        time_t from = argc > 5 ? atoll(argv[5]) : 0, to = argc > 6 ? atoll(argv[6]) : LLONG_MAX;
+        if (what != "tickets" && what != "passes" && what != "history" && what != "history-col")
+        {
+            cerr << "✗ Unknown export: " << what << " (tickets, passes, history, history-col)" << endl;
+            return 1;
+        }
+        SmartParkingSystem parking(3, config);
+        long long rows;
+        if (what == "history-col")
+            rows = parking.getHistory().exportColumns(file, from, to);
+        else
+        {
+            ofstream out(file, ios::binary);
+            if (what == "tickets")
+                rows = parking.exportTicketsCsv(out);
+            else if (what == "passes")
+                rows = parking.exportPassesCsv(out);
+            else
+                rows = parking.getHistory().exportCsv(out, from, to);
+            // A file that never opened fails every write
+            if (!out)
+                rows = -1;
+        }
+        if (rows < 0)
+        {
+            cerr << "✗ Could not write " << file << endl;
+            return 1;
+        }
+        cout << "✓ Exported " << rows << " rows to " << file << endl;
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--recover")
+    {
+        return runRecoveryCheck(argc > 2 ? argv[2] : "", config, 3, cout);
+    }
+    if (argc > 1 && string(argv[1]) == "--convert-text")
+    {
+        string report;
+        bool ok = convertTextSnapshot(argc > 2 ? argv[2] : "", report);
+        cout << (ok ? "✓ Converted: " : "✗ Conversion failed: ") << report << endl;
+        return ok ? 0 : 1;
+    }
+
+    SmartParkingSystem parking(3, config);
+    int choice;
+
+    cout << "\n╔═══════════════════════════════════════╗" << endl;
+    cout << "║         PARKING MANAGEMENT SYSTEM     ║" << endl;
+    cout << "╚═══════════════════════════════════════╝" << endl;
+
+    while (true)
+    {
+        cout << "\n========== MAIN MENU ==========" << endl;
+        cout << "1. View Parking Status" << endl;
+        cout << "2. Park Vehicle (Entry)" << endl;
+        cout << "3. Exit Vehicle (With Payment)" << endl;
+        cout << "4. Purchase Monthly Pass" << endl;
+        cout << "5. View Monthly Pass Details" << endl;
+        cout << "6. View Revenue Statistics" << endl;
+        cout << "7. View Metrics" << endl;
+        cout << "8. Reload Tariff" << endl;
+        cout << "9. Reserve a Slot" << endl;
+        cout << "0. Exit System" << endl;
+        cout << "===============================" << endl;
+        cout << "Enter your choice: ";
+        if (!(cin >> choice))
+            choice = 0;
+        cin.ignore();
+
+        string vehicleNum, vehicleType, paymentMethod;
+
+        switch (choice)
+        {
+        case 1:
+            parking.displayParkingStatus();
+            break;
+
+        case 2:
+            cout << "\n--- VEHICLE ENTRY ---" << endl;
+            cout << "Enter vehicle number: ";
+            getline(cin, vehicleNum);
+            cout << "Enter vehicle type (" << vehicleKindList() << "): ";
+            getline(cin, vehicleType);
+            parking.parkVehicle(vehicleNum, vehicleType);
+            break;
+
+        case 3:
+            cout << "\n--- VEHICLE EXIT ---" << endl;
+            cout << "Enter vehicle number: ";
+            getline(cin, vehicleNum);
+            cout << "Payment method (Cash/Card/UPI): ";
+            getline(cin, paymentMethod);
+            parking.exitVehicle(vehicleNum, paymentMethod);
+            break;
+
+        case 4:
+            cout << "\n--- PURCHASE MONTHLY PASS ---" << endl;
+            cout << "Enter vehicle number: ";
+            getline(cin, vehicleNum);
+            parking.purchaseMonthlyPass(vehicleNum);
+            break;
+
+        case 5:
+            cout << "\n--- VIEW MONTHLY PASS ---" << endl;
+            cout << "Enter vehicle number: ";
+            getline(cin, vehicleNum);
+            parking.viewMonthlyPass(vehicleNum);
+            break;
+
+        case 6:
+            parking.displayRevenue();
+            break;
+
+        case 7:
+            cout << "\n--- METRICS (Prometheus text format) ---" << endl;
+            cout << parking.metricsText();
+            break;
+
+        case 8:
+        {
+            string error;
+            if (parking.reloadTariff(error))
+                cout << "✓ Tariff " << parking.currentTariff().getName() << " is now in force" << endl;
+            else
+                cout << "✗ " << (error.empty() ? "No parking_tariff.txt found" : error) << "; tariff "
+                     << parking.currentTariff().getName() << " kept" << endl;
+            break;
+        }
+
+        case 9:
+        {
+            cout << "\n--- RESERVE A SLOT ---" << endl;
+            cout << "Enter vehicle number: ";
+            getline(cin, vehicleNum);
+            cout << "Enter vehicle type (" << vehicleKindList() << "): ";
+            getline(cin, vehicleType);
+            double startsIn = 0, hours = 0;
+            cout << "Starts in how many hours: ";
+            cin >> startsIn;
+            cout << "For how many hours: ";
+            cin >> hours;
+            cin.ignore();
+            int kind = vehicleKindFromName(vehicleType);
+            string error = "invalid vehicle type";
+            time_t start = parking.getClock().now() + (time_t)(startsIn * 3600);
+            long long id = kind < 0 ? 0
+                                    : parking.reserveSlot(vehicleNum, (VehicleKind)kind, start,
+                                                          start + (time_t)(hours * 3600), error);
+            if (id > 0)
+                cout << "✓ Booking " << id << " confirmed for " << vehicleNum << endl;
+            else
+                cout << "✗ Booking refused: " << error << endl;
+            break;
+        }
+
+        case 0:
+            parking.shutdown();
+            cout << "\n╔════════════════════════════════════╗" << endl;
+            cout << "║  Thank you for using our system!   ║" << endl;
+            cout << "║       Data saved successfully      ║" << endl;
+            cout << "╚════════════════════════════════════╝" << endl;
+            return 0;
+
+        default:
+            cout << "\n✗ Invalid choice! Please try again." << endl;
+        }
+    }
+
+    return 0;
 }
\ No newline at end of file